@@ -13,6 +13,7 @@ TEMPLATE = app
 
 INCLUDEPATH += include
 
+include(libs/calib_core/calib_core.pri)
 include(libs/opencv.pri)
 include(libs/gst_sink_opencv/gst_sink_opencv.pri)
 include(libs/qt_opencv_scene/qt_opencv_scene.pri)
@@ -21,17 +22,11 @@ include(libs/qt_opencv_scene/qt_opencv_scene.pri)
 SOURCES += \
     src/main.cpp\
     src/mainwindow.cpp \
-    src/qchessboardelab.cpp \
-    src/v4l2compcamera.cpp \
-    src/qcameracalibrate.cpp \
-    src/cameraundistort.cpp
+    src/v4l2compcamera.cpp
 
 HEADERS  += \
     include/mainwindow.h \
-    include/qchessboardelab.h \
-    include/v4l2compcamera.h \
-    include/qcameracalibrate.h \
-    include/cameraundistort.h
+    include/v4l2compcamera.h
 
 FORMS    += \
             forms/mainwindow.ui
@@ -0,0 +1,34 @@
+#-------------------------------------------------
+#
+# Headless batch calibration tool.
+# Uses QtCore only, no widgets are linked.
+#
+#-------------------------------------------------
+
+QT       += core
+QT       -= gui
+
+CONFIG   += console
+CONFIG   -= app_bundle
+
+TARGET = CameraCalibrationCli
+TEMPLATE = app
+
+QMAKE_CXXFLAGS += -std=c++11
+
+INCLUDEPATH += \
+            include
+
+include(../libs/calib_core/calib_core.pri)
+include(../libs/opencv.pri)
+
+LIBS += \
+        -lopencv_imgcodecs \
+        -lopencv_videoio
+
+SOURCES += \
+    src/main.cpp \
+    src/batchdetector.cpp
+
+HEADERS  += \
+    include/batchdetector.h
@@ -0,0 +1,108 @@
+#ifndef BATCHDETECTOR_H
+#define BATCHDETECTOR_H
+
+#include <opencv2/core/core.hpp>
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+
+/// Result of the chessboard detection on a single input frame
+struct BatchView
+{
+    size_t index;           ///< Position of the frame in the input sequence
+    double timestampMs;     ///< Video timestamp, frame index for image directories
+    std::string name;       ///< Source file name or video frame label
+
+    bool found;
+    std::vector<cv::Point2f> corners;
+
+    cv::Mat thumbnail;      ///< Only if requested with BatchDetector::setThumbnailWidth
+};
+
+/// Detects the chessboard on every frame of one or more image directories or video files.
+/// Every source has its own reader thread, all the sources share the same pool of
+/// detection threads. The views are always returned in input order, so the result
+/// does not depend on the number of threads.
+class BatchDetector
+{
+public:
+    BatchDetector( cv::Size cbSize, int threadCount );
+
+    /// Opens a directory of images (sorted by name) or a video file as the only source
+    bool open( const std::string& source, int frameStep=1 );
+
+    /// Adds a source (e.g. a camera of a stereo rig). Returns its index or -1 on error
+    int addSource( const std::string& source, int frameStep=1 );
+
+    /// Runs the detection on all the frames of all the sources. Blocking.
+    bool run();
+
+    /// Keeps a gray thumbnail of each frame with a chessboard. 0 disables them
+    void setThumbnailWidth( int width ){ mThumbnailWidth = width; }
+
+    int getSourceCount(){ return static_cast<int>(mSources.size()); }
+    const std::vector<BatchView>& getViews( int source=0 ){ return mSources[source].views; }
+    cv::Size getImageSize( int source=0 ){ return mSources[source].imgSize; }
+    std::string getErrorString(){ return mErrorString; }
+
+    double getReadTimeMsec(){ return mReadTimeMsec; }
+    double getDetectTimeMsec(){ return mDetectTimeMsec; }
+    double getDetectBusyMsec(){ return mDetectBusyMsec; }
+
+protected:
+    void reader( size_t source );
+    void worker();
+
+private:
+    struct Source
+    {
+        std::string path;
+        bool isVideo;
+        int frameStep;
+        std::vector<std::string> imageFiles;
+
+        std::vector<BatchView> views;
+        std::vector<cv::Size> viewSizes;
+        cv::Size imgSize;
+    };
+
+    struct WorkItem
+    {
+        size_t source;
+        size_t index;
+        double timestampMs;
+        std::string name;
+        cv::Mat frame;      ///< Decoded frame (video) or empty (the worker loads "name")
+    };
+
+    bool pushWork( WorkItem& item );
+    bool popWork( WorkItem& item );
+    void storeResult( size_t source, const BatchView& view, cv::Size imgSize, double elapsedMsec );
+
+    cv::Size mCbSize;
+    int mThreadCount;
+    int mThumbnailWidth;
+
+    std::vector<Source> mSources;
+
+    std::string mErrorString;
+
+    double mReadTimeMsec;
+    double mDetectTimeMsec;
+    double mDetectBusyMsec;
+
+    // >>>>> Work queue shared with the workers
+    std::queue<WorkItem> mWorkQueue;
+    size_t mWorkQueueSize;
+    size_t mActiveReaders;
+
+    std::mutex mWorkMutex;
+    std::condition_variable mWorkCond;
+    std::mutex mResultMutex;
+    // <<<<< Work queue shared with the workers
+};
+
+#endif // BATCHDETECTOR_H
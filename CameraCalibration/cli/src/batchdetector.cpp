@@ -0,0 +1,323 @@
+#include "batchdetector.h"
+
+#include <QDir>
+#include <QFileInfo>
+#include <QStringList>
+
+#include <opencv2/highgui/highgui.hpp>
+
+#include <chrono>
+#include <thread>
+
+#include "qcameracalibrate.h"
+#include "cornerdataset.h"
+
+using namespace std;
+
+BatchDetector::BatchDetector( cv::Size cbSize, int threadCount )
+{
+    mCbSize = cbSize;
+    mThreadCount = threadCount<1?1:threadCount;
+    mThumbnailWidth = 0;
+
+    mReadTimeMsec = 0.0;
+    mDetectTimeMsec = 0.0;
+    mDetectBusyMsec = 0.0;
+
+    // Bounded, so that decoded video frames do not pile up in memory
+    mWorkQueueSize = 4*mThreadCount;
+    mActiveReaders = 0;
+}
+
+bool BatchDetector::open( const string& source, int frameStep )
+{
+    mSources.clear();
+
+    return addSource( source, frameStep ) >= 0;
+}
+
+int BatchDetector::addSource( const string& source, int frameStep )
+{
+    QFileInfo info( QString::fromStdString(source) );
+
+    if( !info.exists() )
+    {
+        mErrorString = "Input not found: " + source;
+        return -1;
+    }
+
+    Source src;
+    src.path = source;
+    src.frameStep = frameStep<1?1:frameStep;
+
+    if( info.isDir() )
+    {
+        // >>>>> Image directory
+        QDir dir( QString::fromStdString(source) );
+
+        QStringList filters;
+        filters << "*.png" << "*.jpg" << "*.jpeg" << "*.bmp" << "*.tif" << "*.tiff" << "*.pgm" << "*.ppm";
+
+        QStringList files = dir.entryList( filters, QDir::Files, QDir::Name );
+
+        if( files.isEmpty() )
+        {
+            mErrorString = "No images found in " + source;
+            return -1;
+        }
+
+        foreach( const QString& file, files )
+        {
+            src.imageFiles.push_back( dir.absoluteFilePath(file).toStdString() );
+        }
+
+        src.isVideo = false;
+        src.frameStep = 1;
+        // <<<<< Image directory
+    }
+    else
+    {
+        // >>>>> Video file
+        cv::VideoCapture cap( source );
+
+        if( !cap.isOpened() )
+        {
+            mErrorString = "Cannot open video " + source;
+            return -1;
+        }
+
+        src.isVideo = true;
+        // <<<<< Video file
+    }
+
+    mSources.push_back( src );
+
+    return static_cast<int>(mSources.size())-1;
+}
+
+bool BatchDetector::run()
+{
+    if( mSources.empty() )
+    {
+        mErrorString = "No input sources";
+        return false;
+    }
+
+    for( size_t s=0; s<mSources.size(); s++ )
+    {
+        mSources[s].views.clear();
+        mSources[s].viewSizes.clear();
+        mSources[s].imgSize = cv::Size();
+    }
+
+    mReadTimeMsec = 0.0;
+    mDetectBusyMsec = 0.0;
+    mActiveReaders = mSources.size();
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    vector<thread> workers;
+    for( int i=0; i<mThreadCount; i++ )
+    {
+        workers.push_back( thread( &BatchDetector::worker, this ) );
+    }
+
+    // One reader per source, so the cameras of a rig are decoded in parallel
+    vector<thread> readers;
+    for( size_t s=0; s<mSources.size(); s++ )
+    {
+        readers.push_back( thread( &BatchDetector::reader, this, s ) );
+    }
+
+    for( size_t i=0; i<readers.size(); i++ )
+    {
+        readers[i].join();
+    }
+
+    for( size_t i=0; i<workers.size(); i++ )
+    {
+        workers[i].join();
+    }
+
+    mDetectTimeMsec = chrono::duration<double,milli>( chrono::steady_clock::now()-start ).count();
+
+    for( size_t s=0; s<mSources.size(); s++ )
+    {
+        Source& src = mSources[s];
+
+        // >>>>> All the frames of a source must share the size of the first one
+        for( size_t i=0; i<src.views.size(); i++ )
+        {
+            if( src.viewSizes[i].area()==0 )
+                continue;
+
+            if( src.imgSize.area()==0 )
+            {
+                src.imgSize = src.viewSizes[i];
+            }
+            else if( src.viewSizes[i] != src.imgSize )
+            {
+                mErrorString = "Image size mismatch: " + src.views[i].name;
+                return false;
+            }
+        }
+        // <<<<< All the frames of a source must share the size of the first one
+
+        if( src.imgSize.area()==0 )
+        {
+            mErrorString = "No valid frames in " + src.path;
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void BatchDetector::reader( size_t source )
+{
+    const Source& src = mSources[source];
+
+    double readMsec = 0.0;
+
+    if( src.isVideo )
+    {
+        cv::VideoCapture cap( src.path );
+
+        size_t frameIdx = 0;
+        size_t index = 0;
+
+        forever
+        {
+            chrono::steady_clock::time_point readStart = chrono::steady_clock::now();
+
+            WorkItem item;
+            item.source = source;
+
+            bool ok = cap.read( item.frame );
+
+            readMsec += chrono::duration<double,milli>( chrono::steady_clock::now()-readStart ).count();
+
+            if( !ok || item.frame.empty() )
+                break;
+
+            // Position of the frame just read
+            item.timestampMs = cap.get( cv::CAP_PROP_POS_MSEC );
+
+            if( (frameIdx++)%src.frameStep != 0 )
+                continue;
+
+            item.index = index++;
+            item.name = "frame_" + to_string( frameIdx-1 );
+
+            pushWork( item );
+        }
+    }
+    else
+    {
+        for( size_t i=0; i<src.imageFiles.size(); i++ )
+        {
+            WorkItem item;
+            item.source = source;
+            item.index = i;
+            item.timestampMs = static_cast<double>(i);
+            item.name = src.imageFiles[i];
+
+            pushWork( item );
+        }
+    }
+
+    {
+        lock_guard<mutex> lock( mWorkMutex );
+        mActiveReaders--;
+        mReadTimeMsec += readMsec;
+    }
+    mWorkCond.notify_all();
+}
+
+bool BatchDetector::pushWork( WorkItem& item )
+{
+    unique_lock<mutex> lock( mWorkMutex );
+
+    mWorkCond.wait( lock, [this]{ return mWorkQueue.size()<mWorkQueueSize; } );
+
+    mWorkQueue.push( item );
+
+    lock.unlock();
+    mWorkCond.notify_all();
+
+    return true;
+}
+
+bool BatchDetector::popWork( WorkItem& item )
+{
+    unique_lock<mutex> lock( mWorkMutex );
+
+    mWorkCond.wait( lock, [this]{ return !mWorkQueue.empty() || mActiveReaders==0; } );
+
+    if( mWorkQueue.empty() )
+        return false;
+
+    item = mWorkQueue.front();
+    mWorkQueue.pop();
+
+    lock.unlock();
+    mWorkCond.notify_all();
+
+    return true;
+}
+
+void BatchDetector::worker()
+{
+    WorkItem item;
+
+    while( popWork( item ) )
+    {
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        if( item.frame.empty() )
+        {
+            item.frame = cv::imread( item.name, cv::IMREAD_COLOR );
+        }
+
+        BatchView view;
+        view.index = item.index;
+        view.timestampMs = item.timestampMs;
+        view.name = item.name;
+        view.found = false;
+
+        if( !item.frame.empty() )
+        {
+            view.found = QCameraCalibrate::detectChessboard( item.frame, mCbSize, view.corners );
+
+            if( view.found && mThumbnailWidth>0 )
+            {
+                view.thumbnail = CornerDataset::makeThumbnail( item.frame, mThumbnailWidth );
+            }
+        }
+
+        double elapsed = chrono::duration<double,milli>( chrono::steady_clock::now()-start ).count();
+
+        storeResult( item.source, view, item.frame.size(), elapsed );
+
+        item.frame.release();
+    }
+}
+
+void BatchDetector::storeResult( size_t source, const BatchView& view, cv::Size imgSize, double elapsedMsec )
+{
+    lock_guard<mutex> lock( mResultMutex );
+
+    Source& src = mSources[source];
+
+    // Results are stored by input index, so the order does not depend on the scheduling
+    if( src.views.size() <= view.index )
+    {
+        src.views.resize( view.index+1 );
+        src.viewSizes.resize( view.index+1 );
+    }
+
+    src.views[view.index] = view;
+    src.viewSizes[view.index] = imgSize;
+
+    mDetectBusyMsec += elapsedMsec;
+}
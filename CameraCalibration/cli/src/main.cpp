@@ -0,0 +1,999 @@
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QThread>
+#include <QDir>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+#include "batchdetector.h"
+#include "qcameracalibrate.h"
+#include "cornerdataset.h"
+#include "multicameracalibrate.h"
+#include "cameraundistort.h"
+#include "fastremap.h"
+#include "undistortmapbuilder.h"
+#include "undistortmapcache.h"
+
+using namespace std;
+
+static double elapsedMsec( chrono::steady_clock::time_point start )
+{
+    return chrono::duration<double,milli>( chrono::steady_clock::now()-start ).count();
+}
+
+static const char* terminationName( SolveStats::Termination termination )
+{
+    switch( termination )
+    {
+    case SolveStats::TermConverged:
+        return "converged";
+    case SolveStats::TermMaxIter:
+        return "iteration cap";
+    case SolveStats::TermNotTraced:
+        return "not traced";
+    default:
+        return "failed";
+    }
+}
+
+/// Largest difference between two CV_16SC2 + CV_16UC1 maps, in 1/32 pixel units
+static int mapDiff( const cv::Mat& map1, const cv::Mat& map2, const cv::Mat& ref1, const cv::Mat& ref2 )
+{
+    const int tab = cv::INTER_TAB_SIZE;
+    int maxDiff = 0;
+
+    for( int y=0; y<map1.rows; y++ )
+    {
+        const short* refXY = ref1.ptr<short>(y);
+        const ushort* refFrac = ref2.ptr<ushort>(y);
+        const short* xy = map1.ptr<short>(y);
+        const ushort* frac = map2.ptr<ushort>(y);
+
+        for( int x=0; x<map1.cols; x++ )
+        {
+            int dx = (refXY[2*x]-xy[2*x])*tab + (refFrac[x]%tab) - (frac[x]%tab);
+            int dy = (refXY[2*x+1]-xy[2*x+1])*tab + (refFrac[x]/tab) - (frac[x]/tab);
+
+            maxDiff = max( maxDiff, max( abs(dx), abs(dy) ) );
+        }
+    }
+
+    return maxDiff;
+}
+
+/// Map generation with the calibrated parameters: OpenCV against buildUndistortMaps
+static void benchMaps( QCameraCalibrate& calib, int count )
+{
+    CameraUndistort* undist = calib.getUndistort();
+    UndistortMapsPtr maps = undist->getMaps();
+
+    if( !maps )
+        return;
+
+    cv::Size imgSize;
+    bool fishEye;
+    cv::Mat K, D;
+    double alpha;
+    undist->getCameraParams( imgSize, fishEye, K, D, alpha );
+
+    if( fishEye )
+        D = D.rowRange(0,4).clone();
+
+    cv::Mat cvMap1, cvMap2, map1, map2;
+
+    // >>>>> OpenCV
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for( int i=0; i<count; i++ )
+    {
+        if( fishEye )
+            cv::fisheye::initUndistortRectifyMap( K, D, cv::Matx33d::eye(), maps->newK, imgSize, CV_16SC2, cvMap1, cvMap2 );
+        else
+            cv::initUndistortRectifyMap( K, D, cv::Matx33d::eye(), maps->newK, imgSize, CV_16SC2, cvMap1, cvMap2 );
+    }
+
+    double msecCv = elapsedMsec( start )/count;
+    // <<<<< OpenCV
+
+    start = chrono::steady_clock::now();
+
+    for( int i=0; i<count; i++ )
+    {
+        buildUndistortMaps( K, D, cv::Mat(), maps->newK, imgSize, fishEye, map1, map2 );
+    }
+
+    double msecBuilder = elapsedMsec( start )/count;
+
+    int maxDiff = mapDiff( map1, map2, cvMap1, cvMap2 );
+
+    cout << "Undistort maps: OpenCV " << msecCv << " msec, parallel builder " << msecBuilder
+         << " msec (x" << msecCv/msecBuilder << "), max diff " << maxDiff << "/" << cv::INTER_TAB_SIZE
+         << " pixels" << endl;
+}
+
+/// Average time of count undistort calls with the given remap engine
+static double benchRemap( CameraUndistort* undist, RemapEngine engine, const cv::Mat& frame, cv::Mat& dst, int count )
+{
+    undist->setRemapEngine( engine );
+    undist->resetUndistortCounters();
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for( int i=0; i<count; i++ )
+    {
+        undist->undistort( frame, dst );
+    }
+
+    return elapsedMsec( start )/count;
+}
+
+/// Compares the remap engines on 1, 3 and 4 channel frames: speed and output difference
+static void benchUndistort( QCameraCalibrate& calib, cv::Size imgSize, int count )
+{
+    if( count<1 )
+        return;
+
+    CameraUndistort* undist = calib.getUndistort();
+    RemapEngine engine = undist->getRemapEngine();
+
+    benchMaps( calib, min(count, 10) );
+
+    cout << "Undistort: " << count << " frames " << imgSize.width << "x" << imgSize.height
+         << ", fixed-point kernel " << fastRemapIsa() << endl;
+
+    const int channels[] = { 1, 3, 4 };
+
+    for( int c=0; c<3; c++ )
+    {
+        cv::Mat frame( imgSize, CV_8UC(channels[c]) );
+        cv::randu( frame, cv::Scalar::all(0), cv::Scalar::all(255) );
+
+        cv::Mat dstCv, dstFixed, dstScalar;
+
+        double msecCv = benchRemap( undist, RemapOpenCV, frame, dstCv, count );
+        double msecFixed = benchRemap( undist, RemapFixedPoint, frame, dstFixed, count );
+        uint64_t allocs = undist->getUndistortAllocCount();
+
+        // >>>>> Output check: against cv::remap and against the portable kernel
+        fastRemapForceScalar( true );
+        undist->undistort( frame, dstScalar );
+        fastRemapForceScalar( false );
+
+        cv::Mat diff;
+        double maxDiff = 0.0;
+        cv::absdiff( dstCv, dstFixed, diff );
+        cv::minMaxLoc( diff.reshape(1), NULL, &maxDiff );
+        int diffCount = cv::countNonZero( diff.reshape(1) );
+
+        cv::absdiff( dstScalar, dstFixed, diff );
+        bool simdExact = cv::countNonZero( diff.reshape(1) )==0;
+        // <<<<< Output check: against cv::remap and against the portable kernel
+
+        cout << "  " << channels[c] << " ch: cv::remap " << msecCv << " msec/frame, fixed-point "
+             << msecFixed << " msec/frame (x" << msecCv/msecFixed << "), max diff " << maxDiff
+             << " (" << diffCount << " values), SIMD " << (simdExact?"bit-exact":"DIFFERS")
+             << " with the portable kernel, " << allocs << " buffer allocations" << endl;
+    }
+
+    // >>>>> I420 frames: conversion to BGR then 3 channel remap, against the planar remap
+    if( imgSize.width%2==0 && imgSize.height%2==0 )
+    {
+        // Smooth content, so the difference measures the chroma interpolation and not the noise
+        cv::Mat bgr( imgSize, CV_8UC3 ), yuv;
+        cv::randu( bgr, cv::Scalar::all(0), cv::Scalar::all(255) );
+        cv::GaussianBlur( bgr, bgr, cv::Size(15, 15), 4.0 );
+        cv::cvtColor( bgr, yuv, cv::COLOR_BGR2YUV_I420 );
+
+        undist->setRemapEngine( RemapFixedPoint );
+
+        cv::Mat converted, dstBgr, dstYuv, check;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        for( int i=0; i<count; i++ )
+        {
+            cv::cvtColor( yuv, converted, cv::COLOR_YUV2BGR_I420 );
+            undist->undistort( converted, dstBgr );
+        }
+
+        double msecBgr = elapsedMsec( start )/count;
+
+        undist->undistortI420( yuv, dstYuv ); // The first call derives the chroma maps
+
+        start = chrono::steady_clock::now();
+
+        for( int i=0; i<count; i++ )
+        {
+            undist->undistortI420( yuv, dstYuv );
+        }
+
+        double msecYuv = elapsedMsec( start )/count;
+
+        cv::Mat diff;
+        double maxDiff = 0.0;
+        cv::cvtColor( dstYuv, check, cv::COLOR_YUV2BGR_I420 );
+        cv::absdiff( dstBgr, check, diff );
+        cv::minMaxLoc( diff.reshape(1), NULL, &maxDiff );
+
+        cout << "  I420: to BGR + 3 ch remap " << msecBgr << " msec/frame, planar remap " << msecYuv
+             << " msec/frame (x" << msecBgr/msecYuv << "), max diff in BGR " << maxDiff << endl;
+    }
+    // <<<<< I420 frames: conversion to BGR then 3 channel remap, against the planar remap
+
+    // >>>>> Preview: output view of a quarter of the size, the cost follows the output pixels
+    cv::Size viewSize( max( 1, imgSize.width/4 ), max( 1, imgSize.height/4 ) );
+    undist->setOutputView( viewSize );
+
+    cv::Mat frame( imgSize, CV_8UC3 );
+    cv::randu( frame, cv::Scalar::all(0), cv::Scalar::all(255) );
+
+    cv::Mat preview;
+    double msecPreview = benchRemap( undist, RemapFixedPoint, frame, preview, count );
+
+    cout << "  3 ch preview " << viewSize.width << "x" << viewSize.height << ": fixed-point "
+         << msecPreview << " msec/frame" << endl;
+
+    // >>>>> Display buffer: remap, then channel swap and RGB32 conversion, against the fused pass
+    // cv::cvtColor stands for QImage::rgbSwapped and for the RGB888 to RGB32 conversion of
+    // QPixmap::fromImage, this tool does not link QtGui
+    cv::Mat rgb, rgb32, display;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for( int i=0; i<count; i++ )
+    {
+        undist->undistort( frame, preview );
+        cv::cvtColor( preview, rgb, cv::COLOR_BGR2RGB );
+        cv::cvtColor( rgb, rgb32, cv::COLOR_RGB2BGRA );
+    }
+
+    double msecChain = elapsedMsec( start )/count;
+
+    start = chrono::steady_clock::now();
+
+    for( int i=0; i<count; i++ )
+    {
+        undist->undistortDisplay( frame, display );
+    }
+
+    double msecFused = elapsedMsec( start )/count;
+
+    cv::Mat diff;
+    cv::absdiff( rgb32, display, diff );
+    bool sameBytes = cv::countNonZero( diff.reshape(1) )==0;
+
+    cout << "  3 ch preview to RGB32: remap + 2 conversions " << msecChain << " msec/frame, fused "
+         << msecFused << " msec/frame (x" << msecChain/msecFused << "), output "
+         << (sameBytes?"identical":"DIFFERS") << endl;
+    // <<<<< Display buffer: remap, then channel swap and RGB32 conversion, against the fused pass
+
+    undist->setOutputView( cv::Size() );
+    // <<<<< Preview: output view of a quarter of the size, the cost follows the output pixels
+
+    undist->setRemapEngine( engine );
+}
+
+/// Sparse grid maps against the dense maps: memory, accuracy and speed of the 3 channel remap
+static void benchGrid( QCameraCalibrate& calib, const vector<double>& maxErrors, int count )
+{
+    CameraUndistort* undist = calib.getUndistort();
+    UndistortMapsPtr maps = undist->getMaps();
+
+    if( !maps || count<1 )
+        return;
+
+    cv::Size imgSize;
+    bool fishEye;
+    cv::Mat K, D;
+    double alpha;
+    undist->getCameraParams( imgSize, fishEye, K, D, alpha );
+
+    if( fishEye )
+        D = D.rowRange(0,4).clone();
+
+    cv::Mat frame( imgSize, CV_8UC3 );
+    cv::randu( frame, cv::Scalar::all(0), cv::Scalar::all(255) );
+
+    // >>>>> Dense maps
+    cv::Mat map1, map2, dstDense;
+    buildUndistortMaps( K, D, cv::Mat(), maps->newK, imgSize, fishEye, map1, map2 );
+
+    double kbDense = (map1.total()*map1.elemSize() + map2.total()*map2.elemSize())/1024.0;
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for( int i=0; i<count; i++ )
+    {
+        fastRemap( frame, dstDense, map1, map2 );
+    }
+
+    double msecDense = elapsedMsec( start )/count;
+    // <<<<< Dense maps
+
+    cout << "Grid maps: dense maps " << kbDense/1024.0 << " MB, fixed-point remap (3 ch) "
+         << msecDense << " msec/frame" << endl;
+
+    for( size_t e=0; e<maxErrors.size(); e++ )
+    {
+        cv::Mat grid, gridMap1, gridMap2, dstGrid;
+
+        start = chrono::steady_clock::now();
+        int step = selectUndistortGrid( K, D, cv::Mat(), maps->newK, imgSize, fishEye, maxErrors[e], grid );
+        double msecSelect = elapsedMsec( start );
+
+        if( step==0 )
+        {
+            cout << "  max error " << maxErrors[e] << " px: no grid within the bound, dense maps" << endl;
+            continue;
+        }
+
+        double error = undistortGridError( K, D, cv::Mat(), maps->newK, imgSize, fishEye, step, grid );
+        double kbGrid = grid.total()*grid.elemSize()/1024.0;
+
+        expandRemapGrid( grid, step, imgSize, gridMap1, gridMap2 );
+        int maxDiff = mapDiff( gridMap1, gridMap2, map1, map2 );
+
+        start = chrono::steady_clock::now();
+
+        for( int i=0; i<count; i++ )
+        {
+            fastRemapGrid( frame, dstGrid, imgSize, grid, step );
+        }
+
+        double msecGrid = elapsedMsec( start )/count;
+
+        cv::Mat diff;
+        double maxPixDiff = 0.0;
+        cv::absdiff( dstDense, dstGrid, diff );
+        cv::minMaxLoc( diff.reshape(1), NULL, &maxPixDiff );
+
+        cout << "  max error " << maxErrors[e] << " px: step " << step << ", " << kbGrid << " KB (x"
+             << kbDense/kbGrid << " smaller), error " << error << " px, max diff " << maxDiff << "/"
+             << cv::INTER_TAB_SIZE << " pixels with the dense maps (" << maxPixDiff << " on the output), selected in "
+             << msecSelect << " msec, remap " << msecGrid << " msec/frame (x" << msecDense/msecGrid << ")" << endl;
+    }
+}
+
+/// Largest distance between two sets of points
+static double pointDiff( const vector<cv::Point2f>& pts, const vector<cv::Point2f>& ref )
+{
+    double maxDiff = 0.0;
+
+    for( size_t i=0; i<pts.size(); i++ )
+    {
+        maxDiff = max( maxDiff, static_cast<double>( cv::norm( pts[i]-ref[i] ) ) );
+    }
+
+    return maxDiff;
+}
+
+/// Batch point undistortion against OpenCV: throughput on a large batch and cost of a
+/// feature-sized batch
+static void benchPoints( QCameraCalibrate& calib, int count )
+{
+    CameraUndistort* undist = calib.getUndistort();
+    UndistortMapsPtr maps = undist->getMaps();
+
+    if( !maps || count<1 )
+        return;
+
+    cv::Size imgSize;
+    bool fishEye;
+    cv::Mat K, D;
+    double alpha;
+    undist->getCameraParams( imgSize, fishEye, K, D, alpha );
+
+    if( fishEye )
+        D = D.rowRange(0,4).clone();
+
+    const int bigBatch = 1<<20;
+    const int smallBatch = 300;
+
+    // >>>>> Raw pixels and their normalized undistorted rays, input of cv::projectPoints
+    vector<cv::Point2f> raw( bigBatch );
+    cv::RNG rng;
+
+    for( size_t i=0; i<raw.size(); i++ )
+    {
+        raw[i] = cv::Point2f( rng.uniform( 0.0f, imgSize.width-1.0f ), rng.uniform( 0.0f, imgSize.height-1.0f ) );
+    }
+
+    vector<cv::Point2f> rays, undistorted, cvUndistorted, distorted, cvDistorted;
+    cv::undistortPoints( raw, rays, K, D );
+    // <<<<< Raw pixels and their normalized undistorted rays, input of cv::projectPoints
+
+    cout << "Points (" << (fishEye ? "FishEye" : "pinhole") << " model):" << endl;
+
+    // >>>>> Undistort
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    for( int i=0; i<count; i++ )
+    {
+        if( fishEye )
+            cv::fisheye::undistortPoints( raw, cvUndistorted, K, D, cv::noArray(), maps->outK );
+        else
+            cv::undistortPoints( raw, cvUndistorted, K, D, cv::noArray(), maps->outK );
+    }
+
+    double msecCv = elapsedMsec( start )/count;
+
+    start = chrono::steady_clock::now();
+
+    for( int i=0; i<count; i++ )
+    {
+        undist->undistortPoints( raw, undistorted );
+    }
+
+    double msecBatch = elapsedMsec( start )/count;
+
+    // The round trip checks the inverse, OpenCV stops after a fixed number of iterations
+    undist->distortPoints( undistorted, distorted );
+
+    cout << "  undistort: OpenCV " << bigBatch/msecCv/1000.0 << " Mpoints/s, batch " << bigBatch/msecBatch/1000.0
+         << " Mpoints/s (x" << msecCv/msecBatch << "), max diff " << pointDiff( undistorted, cvUndistorted )
+         << " px with OpenCV, round trip " << pointDiff( distorted, raw ) << " px" << endl;
+    // <<<<< Undistort
+
+    // >>>>> Distort
+    cv::Mat rvec = cv::Mat::zeros( 3, 1, CV_64F );
+    cv::Mat tvec = cv::Mat::zeros( 3, 1, CV_64F );
+
+    vector<cv::Point3f> rays3d( rays.size() );
+    for( size_t i=0; i<rays.size(); i++ )
+    {
+        rays3d[i] = cv::Point3f( rays[i].x, rays[i].y, 1.0f );
+    }
+
+    start = chrono::steady_clock::now();
+
+    for( int i=0; i<count; i++ )
+    {
+        if( fishEye )
+            cv::fisheye::distortPoints( rays, cvDistorted, K, D );
+        else
+            cv::projectPoints( rays3d, rvec, tvec, K, D, cvDistorted );
+    }
+
+    msecCv = elapsedMsec( start )/count;
+
+    start = chrono::steady_clock::now();
+
+    for( int i=0; i<count; i++ )
+    {
+        undist->distortPoints( undistorted, distorted );
+    }
+
+    msecBatch = elapsedMsec( start )/count;
+
+    cout << "  distort: OpenCV (from the rays) " << bigBatch/msecCv/1000.0 << " Mpoints/s, batch "
+         << bigBatch/msecBatch/1000.0 << " Mpoints/s (x" << msecCv/msecBatch << ")" << endl;
+    // <<<<< Distort
+
+    // >>>>> A few hundred features, single thread
+    vector<cv::Point2f> features( raw.begin(), raw.begin()+smallBatch );
+    const int calls = 100*count;
+
+    start = chrono::steady_clock::now();
+
+    for( int i=0; i<calls; i++ )
+    {
+        if( fishEye )
+            cv::fisheye::undistortPoints( features, cvUndistorted, K, D, cv::noArray(), maps->outK );
+        else
+            cv::undistortPoints( features, cvUndistorted, K, D, cv::noArray(), maps->outK );
+    }
+
+    msecCv = elapsedMsec( start )/calls;
+
+    start = chrono::steady_clock::now();
+
+    for( int i=0; i<calls; i++ )
+    {
+        undist->undistortPoints( features, undistorted );
+    }
+
+    msecBatch = elapsedMsec( start )/calls;
+
+    cout << "  " << smallBatch << " points: OpenCV " << msecCv*1000.0 << " usec, batch " << msecBatch*1000.0
+         << " usec (x" << msecCv/msecBatch << ")" << endl;
+    // <<<<< A few hundred features, single thread
+}
+
+/// Synthetic target of the interpolation benchmark: sums of sinusoids with 12 to 20 pixel periods
+static double targetValue( double x, double y )
+{
+    const double twoPi = 2.0*M_PI;
+
+    return 127.5 + 60.0*sin( twoPi*x/16.0 )*cos( twoPi*y/20.0 ) + 40.0*sin( twoPi*(x+y)/12.0 );
+}
+
+/// Interpolation tiers: cost per output megapixel and error against the target evaluated exactly
+/// at the source position of every output pixel
+static void benchInterpolation( QCameraCalibrate& calib, int count )
+{
+    CameraUndistort* undist = calib.getUndistort();
+    UndistortMapsPtr maps = undist->getMaps();
+
+    if( !maps || count<1 )
+        return;
+
+    RemapEngine engine = undist->getRemapEngine();
+    int interpolation = undist->getInterpolation( UndistortExport );
+
+    // >>>>> Target sampled at the pixel centers of the raw frame
+    cv::Size imgSize = maps->imgSize;
+    cv::Mat target( imgSize, CV_8UC1 ), target3;
+
+    for( int y=0; y<imgSize.height; y++ )
+    {
+        uchar* row = target.ptr<uchar>(y);
+
+        for( int x=0; x<imgSize.width; x++ )
+        {
+            row[x] = cv::saturate_cast<uchar>( targetValue( x, y ) );
+        }
+    }
+
+    cv::cvtColor( target, target3, cv::COLOR_GRAY2BGR );
+    // <<<<< Target sampled at the pixel centers of the raw frame
+
+    // >>>>> Reference: the target at the exact source position of every output pixel
+    cv::Size outSize = maps->outSize;
+    vector<cv::Point2f> pixels, sources;
+    pixels.reserve( outSize.area() );
+
+    for( int y=0; y<outSize.height; y++ )
+    {
+        for( int x=0; x<outSize.width; x++ )
+        {
+            pixels.push_back( cv::Point2f( x, y ) );
+        }
+    }
+
+    undist->distortPoints( pixels, sources );
+    // <<<<< Reference: the target at the exact source position of every output pixel
+
+    double mpix = outSize.area()/1e6;
+
+    cout << "Interpolation (" << outSize.width << "x" << outSize.height << " output, fixed-point maps, "
+         << "error in gray levels away from the borders):" << endl;
+
+    const int tiers[] = { cv::INTER_NEAREST, cv::INTER_LINEAR, cv::INTER_CUBIC, cv::INTER_LANCZOS4 };
+    const char* names[] = { "nearest", "linear", "cubic", "Lanczos" };
+
+    undist->setRemapEngine( RemapFixedPoint );
+
+    for( int t=0; t<4; t++ )
+    {
+        undist->setInterpolation( UndistortExport, tiers[t] );
+
+        cv::Mat dst, dst3;
+
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        for( int i=0; i<count; i++ )
+        {
+            undist->undistort( target3, dst3 );
+        }
+
+        double msec = elapsedMsec( start )/count;
+
+        // >>>>> Error, where the 8x8 support of Lanczos stays in the frame
+        undist->undistort( target, dst );
+
+        double sum2 = 0.0;
+        double maxErr = 0.0;
+        size_t n = 0;
+
+        for( int y=0; y<outSize.height; y++ )
+        {
+            const uchar* row = dst.ptr<uchar>(y);
+
+            for( int x=0; x<outSize.width; x++ )
+            {
+                const cv::Point2f& q = sources[y*outSize.width+x];
+
+                if( q.x<4.0f || q.y<4.0f || q.x>imgSize.width-5.0f || q.y>imgSize.height-5.0f )
+                    continue;
+
+                double err = row[x] - targetValue( q.x, q.y );
+
+                sum2 += err*err;
+                maxErr = max( maxErr, fabs(err) );
+                n++;
+            }
+        }
+        // <<<<< Error, where the 8x8 support of Lanczos stays in the frame
+
+        cout << "  " << names[t] << ": " << msec/mpix << " msec/Mpixel (3 ch), RMS error "
+             << (n>0 ? sqrt(sum2/n) : 0.0) << ", max " << maxErr << endl;
+    }
+
+    undist->setInterpolation( UndistortExport, interpolation );
+    undist->setRemapEngine( engine );
+}
+
+/// Stereo/multi-camera rig: one input per camera, the first one is the reference
+static int calibrateRig( const QStringList& inputs, cv::Size cbSize, float cbSizeMm, bool fisheye, double alpha,
+                         int threads, int step, double syncMs, const string& output )
+{
+    // >>>>> Detection
+    BatchDetector detector( cbSize, threads );
+
+    for( int c=0; c<inputs.size(); c++ )
+    {
+        if( detector.addSource( inputs.at(c).toStdString(), step ) < 0 )
+        {
+            cerr << detector.getErrorString() << endl;
+            return 1;
+        }
+    }
+
+    if( !detector.run() )
+    {
+        cerr << detector.getErrorString() << endl;
+        return 1;
+    }
+
+    MultiCameraCalibrate rig( inputs.size(), cbSize, cbSizeMm, fisheye );
+    rig.setSyncTolerance( syncMs );
+
+    for( int c=0; c<inputs.size(); c++ )
+    {
+        const vector<BatchView>& views = detector.getViews( c );
+        size_t found = 0;
+
+        rig.setImageSize( c, detector.getImageSize(c) );
+
+        for( size_t i=0; i<views.size(); i++ )
+        {
+            if( views[i].found )
+            {
+                rig.addView( c, views[i].timestampMs, views[i].corners );
+                found++;
+            }
+        }
+
+        cout << "Camera " << c << ": " << found << "/" << views.size() << " chessboards found" << endl;
+    }
+
+    cout << "Detection: " << detector.getDetectTimeMsec() << " msec (" << threads << " threads, worker busy "
+         << detector.getDetectBusyMsec() << " msec, video decoding " << detector.getReadTimeMsec() << " msec)" << endl;
+    // <<<<< Detection
+
+    // >>>>> Calibration
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    if( !rig.calibrate( alpha ) )
+    {
+        cerr << rig.getErrorString() << endl;
+        return 1;
+    }
+
+    for( int c=0; c<rig.getCameraCount(); c++ )
+    {
+        cv::Mat K, D;
+        double err;
+        rig.getIntrinsics( c, K, D, err );
+
+        cout << "Camera " << c << ": reprojection error " << err << " px" << endl;
+    }
+
+    const vector<CameraPairCalib>& pairs = rig.getPairs();
+    for( size_t p=0; p<pairs.size(); p++ )
+    {
+        cout << "Pair 0-" << pairs[p].camera << ": " << pairs[p].pairCount << " synchronized views, "
+             << "reprojection error " << pairs[p].reprojErr << " px" << endl;
+    }
+
+    cout << "Calibration: " << (fisheye?"FishEye":"Pinhole") << " model, " << rig.getCameraCount()
+         << " cameras in " << elapsedMsec( start ) << " msec" << endl;
+    // <<<<< Calibration
+
+    // >>>>> Output
+    if( !rig.saveCameraParams( output ) )
+    {
+        cerr << "Cannot write " << output << endl;
+        return 1;
+    }
+
+    cout << "Output: " << output << endl;
+    // <<<<< Output
+
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName( "CameraCalibrationCli" );
+
+    // >>>>> Command line
+    QCommandLineParser parser;
+    parser.setApplicationDescription( "Headless camera calibration from an image directory or a video file" );
+    parser.addHelpOption();
+    parser.addPositionalArgument( "input", "Directory of images or video file (not used with --load-corners). "
+                                           "More inputs calibrate a synchronized multi-camera rig", "input..." );
+
+    QCommandLineOption colsOpt( "cols", "Chessboard inner corners per row", "n", "10" );
+    QCommandLineOption rowsOpt( "rows", "Chessboard inner corners per column", "n", "7" );
+    QCommandLineOption sizeOpt( "square", "Chessboard square size [mm]", "mm", "25" );
+    QCommandLineOption fisheyeOpt( "fisheye", "Use the FishEye camera model" );
+    QCommandLineOption compareOpt( "compare-models", "Solve all the camera models and keep the one with the lowest held-out error" );
+    QCommandLineOption alphaOpt( "alpha", "Undistortion alpha [0,1]", "alpha", "0" );
+    QCommandLineOption threadsOpt( QStringList() << "j" << "threads", "Detection threads (default: all cores)", "n",
+                                   QString::number( QThread::idealThreadCount() ) );
+    QCommandLineOption stepOpt( "step", "Use one video frame every <n>", "n", "1" );
+    QCommandLineOption outputOpt( QStringList() << "o" << "output", "Output calibration file (YAML or XML)", "file" );
+    QCommandLineOption saveCornersOpt( "save-corners", "Save the detected corners to a corner dataset file", "file" );
+    QCommandLineOption loadCornersOpt( "load-corners", "Solve a corner dataset file instead of detecting the chessboards", "file" );
+    QCommandLineOption maxIterOpt( "max-iter", "Solver iteration cap (default: OpenCV default of the model)", "n", "0" );
+    QCommandLineOption traceStepOpt( "trace-step", "Sample the solver error every <n> iterations with extra probe solves, 0 disables", "n", "0" );
+    QCommandLineOption mapCacheOpt( "map-cache", "Folder of the undistortion map cache, maps are loaded from it if already built", "dir" );
+    QCommandLineOption gridOpt( "grid-maps", "Undistort with sparse grid maps within <px> pixels of the model, 0 for dense maps", "px", "0" );
+    QCommandLineOption benchOpt( "bench", "Undistort <n> synthetic frames after the calibration and report the timing", "n" );
+    QCommandLineOption syncOpt( "sync-ms", "Multi-camera: max timestamp difference of synchronized video frames [msec]", "msec", "5" );
+
+    parser.addOption( colsOpt );
+    parser.addOption( rowsOpt );
+    parser.addOption( sizeOpt );
+    parser.addOption( fisheyeOpt );
+    parser.addOption( compareOpt );
+    parser.addOption( alphaOpt );
+    parser.addOption( threadsOpt );
+    parser.addOption( stepOpt );
+    parser.addOption( outputOpt );
+    parser.addOption( saveCornersOpt );
+    parser.addOption( loadCornersOpt );
+    parser.addOption( maxIterOpt );
+    parser.addOption( traceStepOpt );
+    parser.addOption( syncOpt );
+    parser.addOption( mapCacheOpt );
+    parser.addOption( gridOpt );
+    parser.addOption( benchOpt );
+
+    parser.process( app );
+
+    QStringList args = parser.positionalArguments();
+    bool loadCorners = parser.isSet(loadCornersOpt);
+    if( (loadCorners ? !args.isEmpty() : args.isEmpty()) || !parser.isSet(outputOpt) )
+    {
+        parser.showHelp( 1 );
+    }
+
+    cv::Size cbSize( parser.value(colsOpt).toInt(), parser.value(rowsOpt).toInt() );
+    float cbSizeMm = parser.value(sizeOpt).toFloat();
+    bool fisheye = parser.isSet(fisheyeOpt);
+    double alpha = parser.value(alphaOpt).toDouble();
+    int threads = parser.value(threadsOpt).toInt();
+    int step = parser.value(stepOpt).toInt();
+    string input = loadCorners ? parser.value(loadCornersOpt).toStdString() : args.at(0).toStdString();
+    string output = parser.value(outputOpt).toStdString();
+
+    if( cbSize.width<2 || cbSize.height<2 || cbSizeMm<=0.0f )
+    {
+        cerr << "Invalid chessboard geometry" << endl;
+        return 1;
+    }
+    // <<<<< Command line
+
+    if( args.size() > 1 )
+    {
+        return calibrateRig( args, cbSize, cbSizeMm, fisheye, alpha, threads, step,
+                             parser.value(syncOpt).toDouble(), output );
+    }
+
+    vector< vector<cv::Point2f> > imgCornersVec;
+    cv::Size imgSize;
+
+    if( loadCorners )
+    {
+        // >>>>> Corner dataset
+        chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+        CornerDataset dataset;
+
+        if( !dataset.load( input, false ) )
+        {
+            cerr << "Invalid corner dataset " << input << endl;
+            return 1;
+        }
+
+        imgCornersVec = dataset.getCornersVec();
+        imgSize = dataset.getImgSize();
+        cbSize = dataset.getCbSize();
+        cbSizeMm = dataset.getCbSizeMm();
+
+        cout << "Corner dataset: " << imgCornersVec.size() << " chessboards loaded in "
+             << elapsedMsec( start ) << " msec" << endl;
+        // <<<<< Corner dataset
+    }
+    else
+    {
+        // >>>>> Detection
+        BatchDetector detector( cbSize, threads );
+
+        if( parser.isSet(saveCornersOpt) )
+        {
+            detector.setThumbnailWidth( 160 );
+        }
+
+        if( !detector.open( input, step ) || !detector.run() )
+        {
+            cerr << detector.getErrorString() << endl;
+            return 1;
+        }
+
+        const vector<BatchView>& views = detector.getViews();
+        imgSize = detector.getImageSize();
+
+        CornerDataset dataset;
+        if( parser.isSet(saveCornersOpt) &&
+                !dataset.create( parser.value(saveCornersOpt).toStdString(), cbSize, cbSizeMm, imgSize ) )
+        {
+            cerr << "Cannot write " << parser.value(saveCornersOpt).toStdString() << endl;
+            return 1;
+        }
+
+        for( size_t i=0; i<views.size(); i++ )
+        {
+            if( views[i].found )
+            {
+                imgCornersVec.push_back( views[i].corners );
+
+                if( dataset.isOpen() )
+                {
+                    dataset.append( views[i].corners, views[i].thumbnail );
+                }
+            }
+        }
+
+        cout << "Detection: " << imgCornersVec.size() << "/" << views.size() << " chessboards found in "
+             << detector.getDetectTimeMsec() << " msec (" << threads << " threads, worker busy "
+             << detector.getDetectBusyMsec() << " msec, video decoding " << detector.getReadTimeMsec() << " msec)" << endl;
+        // <<<<< Detection
+    }
+
+    // >>>>> Calibration
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+
+    QCameraCalibrate calib( imgSize, cbSize, cbSizeMm, fisheye, INT_MAX );
+
+    if( parser.isSet(mapCacheOpt) )
+    {
+        QString cacheDir = parser.value(mapCacheOpt);
+
+        if( !QDir().mkpath( cacheDir ) )
+        {
+            cerr << "Cannot create " << cacheDir.toStdString() << endl;
+            return 1;
+        }
+
+        calib.getUndistort()->setMapCache( make_shared<UndistortMapCache>( cacheDir.toStdString() ) );
+    }
+
+    double gridMaxError = parser.value(gridOpt).toDouble();
+    calib.getUndistort()->setGridMaps( gridMaxError );
+
+    calib.setNewAlpha( alpha );
+    calib.setSolverCriteria( parser.value(maxIterOpt).toInt(), parser.value(traceStepOpt).toInt() );
+
+    if( !calib.calibrateBatch( imgCornersVec ) )
+    {
+        cerr << "At least 5 chessboards are required, " << imgCornersVec.size() << " found" << endl;
+        return 1;
+    }
+
+    SolveStats stats = calib.getLastSolveStats();
+
+    if( stats.termination == SolveStats::TermFailed )
+    {
+        cerr << "Calibration failed" << endl;
+        return 1;
+    }
+
+    cout << "Calibration: " << (fisheye?"FishEye":"Pinhole") << " model, reprojection error "
+         << calib.getReprojErr() << " px in " << elapsedMsec( start ) << " msec" << endl;
+
+    cout << "Solver: " << stats.views << " views, " << stats.corners << " corners, "
+         << (stats.iterations<0?string("n/a"):to_string(stats.iterations)) << "/" << stats.maxIterations
+         << " iterations (" << terminationName( stats.termination ) << "), wall "
+         << stats.wallMsec << " msec, CPU " << stats.cpuMsec << " msec" << endl;
+
+    cout << "Solver RMS:";
+    for( size_t i=0; i<stats.errTrajectory.size(); i++ )
+    {
+        cout << " " << stats.errTrajectory[i];
+    }
+    cout << endl;
+    // <<<<< Calibration
+
+    if( parser.isSet(compareOpt) )
+    {
+        // >>>>> Model selection
+        start = chrono::steady_clock::now();
+
+        if( !calib.compareModels() )
+        {
+            cerr << "Model comparison failed" << endl;
+            return 1;
+        }
+
+        vector<ModelCandidate> candidates = calib.getModelCandidates();
+        CameraModel best = calib.getRecommendedModel();
+
+        for( size_t i=0; i<candidates.size(); i++ )
+        {
+            cout << "Model " << QCameraCalibrate::modelName(candidates[i].model) << ": ";
+
+            if( candidates[i].valid )
+            {
+                cout << "held-out error " << candidates[i].heldOutErr << " px, RMS " << candidates[i].reprojErr
+                     << " px, " << candidates[i].stats.wallMsec << " msec";
+            }
+            else
+            {
+                cout << "failed";
+            }
+
+            cout << (candidates[i].model==best?" [best]":"") << endl;
+        }
+
+        calib.applyModel( best );
+
+        cout << "Model selection: " << QCameraCalibrate::modelName(best) << " in " << elapsedMsec( start ) << " msec" << endl;
+        // <<<<< Model selection
+    }
+
+    // >>>>> Output
+    start = chrono::steady_clock::now();
+
+    if( !calib.saveCameraParams( output ) )
+    {
+        cerr << "Cannot write " << output << endl;
+        return 1;
+    }
+
+    cout << "Output: " << output << " written in " << elapsedMsec( start ) << " msec" << endl;
+    // <<<<< Output
+
+    if( parser.isSet(mapCacheOpt) )
+    {
+        CameraUndistort* undist = calib.getUndistort();
+
+        cout << "Map cache: " << undist->getMapCacheHitCount() << " maps loaded, "
+             << undist->getMapBuildCount() << " built" << endl;
+    }
+
+    if( parser.isSet(benchOpt) )
+    {
+        // The remap engines are compared on dense maps, benchGrid reports the grid ones
+        calib.getUndistort()->setGridMaps( 0.0 );
+
+        benchUndistort( calib, imgSize, parser.value(benchOpt).toInt() );
+
+        vector<double> maxErrors;
+        if( gridMaxError>0.0 )
+            maxErrors.push_back( gridMaxError );
+        else
+            maxErrors = { 0.02, 0.05, 0.1, 0.25 };
+
+        benchGrid( calib, maxErrors, parser.value(benchOpt).toInt() );
+
+        benchPoints( calib, parser.value(benchOpt).toInt() );
+
+        benchInterpolation( calib, parser.value(benchOpt).toInt() );
+    }
+
+    return 0;
+}
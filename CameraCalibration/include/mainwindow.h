@@ -5,15 +5,19 @@
 #include <QLabel>
 #include <QCameraInfo>
 #include <QProcess>
-#include <QThreadPool>
 #include <QSound>
+#include <QTimer>
 
 #include <opencv2/core/core.hpp>
 
+#include <memory>
+
 class CameraThread;
 class QOpenCVScene;
 
 class QCameraCalibrate;
+class UndistortMapCache;
+class CalibPipeline;
 
 namespace Ui
 {
@@ -35,19 +39,25 @@ protected:
     bool killGstLaunch();
     bool startCamera();
     void stopCamera();
+    void showUndistorted( cv::Mat& image, bool undistorted );
+    bool isViewShown( QWidget* view );
+    void updateViewCost( int view, qint64 nsecs );
 
 public slots:
     void onNewImage(cv::Mat frame);
     void onNewCbImage(cv::Mat cbImage);
     void onCbDetected();
     void onNewCameraParams(cv::Mat K, cv::Mat D, bool refining, double calibReprojErr );
+    void onModelsCompared();
 
 protected slots:
     void onCameraConnected();
     void onCameraDisconnected();
     void onProcessReadyRead();
+    void onDisplayTimer();
 
     void updateParamGUI(cv::Mat K, cv::Mat D);
+    void updateSolverStatsGUI();
     void updateCbParams();
     void setNewCameraParams();
 
@@ -85,14 +95,34 @@ private slots:
 
     void on_checkBox_fisheye_clicked(bool checked);
 
+    void on_pushButton_session_record_clicked(bool checked);
+    void on_pushButton_session_load_clicked();
+
+    void on_pushButton_compare_models_clicked();
+    void on_comboBox_model_activated(int index);
+    void on_checkBox_progressive_clicked(bool checked);
+
 private:
+    /// Outputs computed only while their view is on screen
+    enum PreviewView
+    {
+        ViewRaw=0,
+        ViewCheckboard,
+        ViewUndistorted,
+        ViewCount
+    };
+
     Ui::MainWindow *ui;
 
     QLabel mOpenCvVer;
     QLabel mCalibInfo;
+    QLabel mUndistInfo;
+    QLabel mPipelineInfo;
 
     QProcess mGstProcess;
 
+    QTimer mDisplayTimer; ///< Takes the latest camera frame at the refresh rate of the screen
+
     QList<QCameraInfo> mCameras;
     CameraThread* mCameraThread;
     bool mCameraConnected;
@@ -102,6 +132,13 @@ private:
     QOpenCVScene* mCameraSceneUndistorted;
 
     cv::Mat mLastFrame;
+    CalibPipeline* mPipeline;   // Detection, calibration and undistortion off the GUI thread
+    quint64 mLastFoundCount;    // Chessboards found by the pipeline, for the detection sound
+    cv::Size mUndistPreviewSize; // Output view requested to CameraUndistort
+    cv::Size mUndistShownSize;   // Image size the undistorted view is fitted to
+
+    quint64 mViewSkips[ViewCount]; // Frames not processed because the view was hidden
+    double mViewMsec[ViewCount];   // Average cost of a frame of the view, to estimate the CPU saved
 
     QString mCamDev;
     int mSrcWidth;
@@ -113,9 +150,8 @@ private:
     cv::Size mCbSize;
     float mCbSizeMm;
 
-    QThreadPool mElabPool;
-
     QCameraCalibrate* mCameraCalib;
+    std::shared_ptr<UndistortMapCache> mMapCache; // Shared by all the calibrators
 
     QSound* mCbDetectedSnd;
 };
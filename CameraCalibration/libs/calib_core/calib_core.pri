@@ -0,0 +1,18 @@
+message("Added calib_core")
+
+# Links the static library built by calib_core.pro. Build from the top level project
+# (qt_camera_calibration.pro), which builds the library first
+
+PATH = $$PWD
+INC = $$PATH/include
+
+INCLUDEPATH += $$INC
+DEPENDPATH += $$INC
+
+LIBS += -L$$CALIB_LIB_DIR -lcalib_core
+
+win32-msvc* {
+    PRE_TARGETDEPS += $$CALIB_LIB_DIR/calib_core.lib
+} else {
+    PRE_TARGETDEPS += $$CALIB_LIB_DIR/libcalib_core.a
+}
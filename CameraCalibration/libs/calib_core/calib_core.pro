@@ -0,0 +1,49 @@
+#-------------------------------------------------
+#
+# Chessboard detection, calibration and undistortion
+# without GUI. Static library linked by the GUI and
+# by the CLI: QtCore only, no widgets.
+#
+#-------------------------------------------------
+
+QT       = core
+
+TARGET = calib_core
+TEMPLATE = lib
+CONFIG   += staticlib
+
+# One folder for every configuration, found by calib_core.pri
+DESTDIR = $$CALIB_LIB_DIR
+
+QMAKE_CXXFLAGS += -std=c++11
+
+INCLUDEPATH += include
+
+include(../opencv.pri)
+
+SOURCES += \
+    src/qcameracalibrate.cpp \
+    src/cameraundistort.cpp \
+    src/fastremap.cpp \
+    src/undistortmapbuilder.cpp \
+    src/undistortmapcache.cpp \
+    src/pointundistorter.cpp \
+    src/cornerdataset.cpp \
+    src/multicameracalibrate.cpp \
+    src/pipelinestage.cpp \
+    src/calibpipeline.cpp
+
+HEADERS  += \
+    include/qcameracalibrate.h \
+    include/cameraundistort.h \
+    include/fastremap.h \
+    include/undistortmapbuilder.h \
+    include/undistortmapcache.h \
+    include/pointundistorter.h \
+    include/cornerdataset.h \
+    include/multicameracalibrate.h \
+    include/publishedptr.h \
+    include/spscqueue.h \
+    include/pipelinestage.h \
+    include/calibpipeline.h \
+    src/distortionmodels.h
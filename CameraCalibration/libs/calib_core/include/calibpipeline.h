@@ -0,0 +1,120 @@
+#ifndef CALIBPIPELINE_H
+#define CALIBPIPELINE_H
+
+#include <opencv2/core/core.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "pipelinestage.h"
+
+class QCameraCalibrate;
+
+/// Live processing of the camera frames, as a chain of pipeline stages:
+///
+///     convert --> detect (pool) --> accumulate --> solve (QCameraCalibrate)
+///             \-> undistort --> present
+///
+/// capture is the CameraThread with its latest-frame mailbox, present is the consumer taking the
+/// outputs (the GUI timer). Every stage has its own threads, bounded lock-free queues, drop policy
+/// and counters (getStats):
+/// - convert: 1 thread, a new frame replaces the one not converted yet. Gray image for the detection, fan out
+/// - detect: a pool, drops the frames when all the detectors are busy
+/// - accumulate: 1 thread, blocks the detectors when full, so no detected view is lost.
+///   Adds the views to the calibration, which may solve the coarse stages inline
+/// - undistort: 1 thread, a new frame replaces the one not undistorted yet. Display buffers (undistortDisplay)
+///
+/// Thread safety: push() from one thread only, the takes from one consumer thread, setCalibration()
+/// and the statistics from any thread. No Qt dependency besides QCameraCalibrate
+class CalibPipeline
+{
+public:
+    explicit CalibPipeline( int detectThreads=3 );
+    ~CalibPipeline();
+
+    /// Calibration used by the next frames, NULL to stop. Waits for the stages using the previous one,
+    /// which can be deleted on return. The detected views still queued for it are discarded
+    void setCalibration( QCameraCalibrate* calib );
+
+    /// Single producer (the GUI thread). undistort: the frame is needed by the undistorted view.
+    /// detect: the chessboard is searched, drawCorners: the result is needed by the chessboard view
+    void push( const cv::Mat& frame, bool undistort, bool detect, bool drawCorners, cv::Size cbSize );
+
+    /// Latest undistorted frame: the CV_8UC4 display buffer if undistorted is set, else the raw
+    /// frame (maps not ready). Returns false if there is no new result
+    bool takeUndistorted( cv::Mat& image, bool& undistorted );
+
+    /// Latest checked frame with the detected corners drawn. Returns false if there is no new result
+    bool takeCbImage( cv::Mat& cbImage );
+
+    /// Chessboards found since the start
+    uint64_t getFoundCount(){ return mFoundCount; }
+
+    /// Statistics of the stages since the previous call, in pipeline order
+    std::vector<StageStats> getStats();
+
+private:
+    struct Frame
+    {
+        cv::Mat frame;
+        cv::Mat gray;
+        cv::Size cbSize;
+        bool undistort;
+        bool detect;
+        bool drawCorners;
+        uint64_t generation;            ///< Calibration the frame was taken for
+        PipelineClock::time_point entered;
+
+        Frame();
+    };
+
+    struct View
+    {
+        std::vector<cv::Point2f> corners;
+        cv::Mat gray;                   ///< For the thumbnail of the recorded sessions
+        uint64_t generation;
+
+        View();
+    };
+
+    struct Undistorted
+    {
+        cv::Mat image;
+        bool undistorted;
+
+        Undistorted();
+    };
+
+    void convert( Frame& frame, int worker );
+    void detect( Frame& frame, int worker );
+    void accumulate( View& view, int worker );
+    void undistort( Frame& frame, int worker );
+
+    std::atomic<uint64_t> mGeneration;  ///< Incremented by setCalibration
+    std::atomic<uint64_t> mFoundCount;
+
+    // >>>>> Calibration, one lock per stage using it
+    std::mutex mAccumulateMutex;        ///< Held while a view is added
+    std::mutex mUndistortMutex;         ///< Held while a frame is undistorted
+    QCameraCalibrate* mCalib;
+    // <<<<< Calibration, one lock per stage using it
+
+    /// Display buffers of the undistort stage: one queued as result, one shown by the scene, one
+    /// written. A buffer still referenced is replaced by undistortDisplay, never overwritten
+    cv::Mat mBuffers[3];
+    int mBufferIdx;
+
+    // >>>>> Stages, the consumers first: destroyed after their producers
+    PipelineOutput<Undistorted> mUndistortedOut;
+    PipelineOutput<cv::Mat> mCbImageOut;
+
+    PipelineStage<View> mAccumulateStage;
+    PipelineStage<Frame> mUndistortStage;
+    PipelineStage<Frame> mDetectStage;
+    PipelineStage<Frame> mConvertStage;
+    // <<<<< Stages, the consumers first: destroyed after their producers
+};
+
+#endif // CALIBPIPELINE_H
@@ -0,0 +1,233 @@
+#ifndef QCAMERAUNDISTORT_H
+#define QCAMERAUNDISTORT_H
+
+#include <opencv2/core/core.hpp>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+
+#include "fastremap.h"
+#include "publishedptr.h"
+
+class UndistortMapCache;
+class PointUndistorter;
+
+/// Set of undistortion maps. A new one is built for every parameter change and published as
+/// a whole, so readers never see a partially built map. Only the chroma maps are written after
+/// the publication, once, under chromaOnce.
+struct UndistortMaps
+{
+    cv::Size imgSize;
+    bool fishEye;
+    double alpha;
+
+    cv::Mat newK;       ///< Camera matrix of the undistorted image
+
+    cv::Size outSize;   ///< Size of the maps and of the undistorted output
+    cv::Rect roi;       ///< Region of the full undistorted image covered by the output
+    cv::Mat outK;       ///< Camera matrix of the output: newK scaled and moved to roi
+
+    cv::Mat remap1;     ///< Loaded from UndistortMapCache: read-only, the file mapping lives with the Mat
+    cv::Mat remap2;
+
+    int gridStep = 0;   ///< Sparse maps: remap1 and remap2 are empty, grid is expanded by the remap. 0 if dense
+    cv::Mat grid;
+
+    bool empty() const { return gridStep>0 ? grid.empty() : (remap1.empty() || remap2.empty()); }
+
+    std::shared_ptr<const PointUndistorter> points; ///< Points between the raw image and the output
+
+    // >>>>> Chroma maps of I420 frames, derived from the luma maps by the first undistortI420 call
+    mutable std::once_flag chromaOnce;
+    mutable cv::Mat chroma1;
+    mutable cv::Mat chroma2;
+    // <<<<< Chroma maps of I420 frames, derived from the luma maps by the first undistortI420 call
+};
+
+typedef std::shared_ptr<const UndistortMaps> UndistortMapsPtr;
+
+/// Outputs with their own interpolation setting
+enum UndistortUse
+{
+    UndistortPreview = 0,   ///< undistortDisplay
+    UndistortExport         ///< undistort and undistortI420
+};
+
+/// Parameter setters are serialized between them. undistort() and getMaps() never
+/// wait for them: they use the last published maps.
+///
+/// With a rebuild delay the setters only store the parameters: a builder thread rebuilds
+/// the maps when no edit arrived for the delay, dropping builds made stale by newer edits.
+class CameraUndistort
+{
+public:
+    explicit CameraUndistort( cv::Size imgSize, bool fishEye=false,
+                              cv::Mat intr=cv::Mat(), cv::Mat dist=cv::Mat(),
+                              double alpha=0.0 );
+    ~CameraUndistort();
+
+    bool setCameraParams( cv::Size imgSize, bool fishEye, cv::Mat intr, cv::Mat dist, double alpha );
+    void getCameraParams( cv::Size& imgSize, bool& fishEye, cv::Mat& intr, cv::Mat& dist, double& alpha );
+
+    bool loadCameraParams( std::string fileName );
+    bool saveCameraParams( std::string fileName );
+
+    bool setNewAlpha( double alpha );
+    bool setFisheye( bool fisheye );
+
+    // >>>>> Output view
+    /// The maps produce outSize pixels covering roi of the full undistorted image, so previews
+    /// and consumers of a region only remap the pixels they use. An empty roi is the full image,
+    /// an empty outSize is the size of roi. Downscaled outputs sample the source bilinearly,
+    /// without prefiltering. Default: full image at full resolution
+    bool setOutputView( cv::Size outSize, cv::Rect roi=cv::Rect() );
+
+    /// Camera matrix of the undistorted output (UndistortMaps::outK of the last published maps).
+    /// Empty until the maps are ready
+    cv::Mat getOutputCameraMatrix();
+
+    /// newK of the full undistorted image moved to outSize pixels covering roi. Pixel centers
+    /// are aligned as in cv::resize
+    static cv::Mat viewCameraMatrix( const cv::Mat& newK, cv::Rect roi, cv::Size outSize );
+    // <<<<< Output view
+
+    cv::Mat undistort( cv::Mat& frame );
+
+    /// Remaps into dst, reusing its buffer when it has the right size and type and it is not
+    /// shared with other cv::Mat. Returns false if the maps are not ready
+    bool undistort( const cv::Mat& frame, cv::Mat& dst );
+
+    /// Same as undistort into dst, written as a display-ready CV_8UC4 image (fastRemapDisplay,
+    /// whatever the remap engine): the preview goes from the capture to a QImage::Format_RGB32
+    /// buffer in one pass. Returns false if the maps are not ready or the frame is not 8-bit
+    bool undistortDisplay( const cv::Mat& frame, cv::Mat& dst );
+
+    /// Same as undistort into dst for I420 frames (CV_8UC1, height*3/2 rows, as cv::COLOR_YUV2BGR_I420):
+    /// Y is remapped with the maps and U, V with half resolution maps derived from them, so the
+    /// frame is never converted to BGR. dst is I420 too, the output view must have even sizes.
+    /// Returns false if the maps are not ready or the frame does not match them
+    bool undistortI420( const cv::Mat& frame, cv::Mat& dst );
+
+    // >>>>> Points
+    /// Raw image pixels to pixels of the undistorted output (outK), with the parameters of the
+    /// last published maps, without remapping a frame. dst may be src. Returns false if the
+    /// maps are not ready
+    bool undistortPoints( const std::vector<cv::Point2f>& src, std::vector<cv::Point2f>& dst );
+
+    /// Pixels of the undistorted output to raw image pixels
+    bool distortPoints( const std::vector<cv::Point2f>& src, std::vector<cv::Point2f>& dst );
+    // <<<<< Points
+
+    // >>>>> Output buffer allocations of the undistort calls
+    uint64_t getUndistortCount(){ return mUndistortCount; }
+    uint64_t getUndistortAllocCount(){ return mUndistortAllocCount; }
+    void resetUndistortCounters(){ mUndistortCount=0; mUndistortAllocCount=0; }
+    // <<<<< Output buffer allocations of the undistort calls
+
+    // >>>>> Deferred map rebuild
+    /// 0 (default): the setters rebuild the maps before returning
+    void setRebuildDelay( int msec );
+
+    uint64_t getMapBuildCount(){ return mMapBuildCount; }
+    uint64_t getMapDropCount(){ return mMapDropCount; }   ///< Deferred builds dropped as stale
+    // <<<<< Deferred map rebuild
+
+    // >>>>> Map cache
+    /// Maps are looked up in the cache before being built, and stored after. NULL disables it
+    void setMapCache( std::shared_ptr<UndistortMapCache> cache );
+
+    uint64_t getMapCacheHitCount(){ return mMapCacheHitCount; }
+    // <<<<< Map cache
+
+    // >>>>> Sparse grid maps
+    /// maxError>0: the maps are the coarsest grid within maxError pixels of the model, expanded
+    /// while remapping with the fixed-point kernels whatever the remap engine. Dense maps are
+    /// used if no grid step is within the bound. 0 (default): dense maps
+    bool setGridMaps( double maxError );
+    // <<<<< Sparse grid maps
+
+    // >>>>> Interpolation
+    /// cv::INTER_NEAREST, INTER_LINEAR (default), INTER_CUBIC or INTER_LANCZOS4 for one use. Linear
+    /// follows the remap engine, nearest always uses the fixed-point kernels (rounded maps), cubic
+    /// and Lanczos always use cv::remap (grid maps are expanded for the frame, the preview is
+    /// converted to the display format after the remap). Returns false for other values
+    bool setInterpolation( UndistortUse use, int interpolation );
+    int getInterpolation( UndistortUse use ){ return mInterpolation[use]; }
+    // <<<<< Interpolation
+
+    /// Remap implementation used by both undistort calls, cv::remap by default
+    void setRemapEngine( RemapEngine engine ){ mRemapEngine = engine; }
+    RemapEngine getRemapEngine(){ return mRemapEngine; }
+
+    /// Last published maps, NULL until the first valid parameters are set
+    UndistortMapsPtr getMaps();
+
+protected:
+    bool buildMaps(); // mParamMutex must be locked by the caller
+
+    /// Returns NULL if abort is set during the build. cacheHit is set if the maps come from cache
+    static UndistortMapsPtr makeMaps( cv::Size imgSize, bool fishEye, const cv::Mat& intr, const cv::Mat& dist,
+                                      double alpha, cv::Size outSize, cv::Rect roi, double gridMaxError,
+                                      const std::atomic<bool>* abort,
+                                      UndistortMapCache* cache, bool& cacheHit );
+
+    void builderLoop();
+
+    void remap( const cv::Mat& frame, cv::Mat& dst, const UndistortMaps& maps, int interpolation );
+
+    /// One plane or frame with the given maps: the remap engine for linear, as remap()
+    void remapWith( const cv::Mat& frame, cv::Mat& dst, const cv::Mat& map1, const cv::Mat& map2, int interpolation );
+
+    /// Reuses dst when it has the given size and type and it is not shared, else allocates it
+    void prepareOutput( const cv::Mat& frame, cv::Mat& dst, cv::Size size, int type );
+
+private:
+    std::mutex mParamMutex;
+
+    cv::Size mImgSize;
+
+    bool mFishEye;
+
+    double mAlpha;
+
+    cv::Size mOutSize;  ///< Requested output view, empty values are resolved by makeMaps
+    cv::Rect mOutRoi;
+
+    double mGridMaxError; ///< 0 for dense maps
+
+    cv::Mat mIntrinsic;
+    cv::Mat mDistCoeffs; // 4x1 if FishEye, 8x1 or 12x1 (thin prism) if not Fisheye
+
+    PublishedPtr<const UndistortMaps> mMaps; // Stored under mParamMutex, loaded lock-free
+
+    std::atomic<uint64_t> mUndistortCount;
+    std::atomic<uint64_t> mUndistortAllocCount;
+
+    std::atomic<RemapEngine> mRemapEngine;
+
+    std::atomic<int> mInterpolation[2]; ///< By UndistortUse
+
+    // >>>>> Deferred map rebuild, guarded by mParamMutex
+    int mRebuildDelayMsec;
+    std::thread mBuilder;
+    std::condition_variable mBuildCond;
+    bool mBuildPending;
+    bool mStopBuilder;
+    std::chrono::steady_clock::time_point mBuildDeadline;
+
+    std::atomic<bool> mBuildStale;  ///< Set by every edit: the build in progress is obsolete
+    std::atomic<uint64_t> mMapBuildCount;
+    std::atomic<uint64_t> mMapDropCount;
+    // <<<<< Deferred map rebuild
+
+    std::shared_ptr<UndistortMapCache> mMapCache; // Guarded by mParamMutex
+    std::atomic<uint64_t> mMapCacheHitCount;
+};
+
+#endif // QCAMERAUNDISTORT_H
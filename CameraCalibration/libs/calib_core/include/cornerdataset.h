@@ -0,0 +1,59 @@
+#ifndef CORNERDATASET_H
+#define CORNERDATASET_H
+
+#include <opencv2/core/core.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+/// Binary store of the detected chessboard corners of a calibration session.
+///
+/// File layout, in host byte order (little endian on the supported x86 and ARM targets, the files
+/// are not portable to big endian hosts):
+///   header  : "QCCD", version, board cols/rows, square size [mm], image width/height
+///   records : corner count, thumbnail width/height, float32 corners (x,y), 8 bit gray thumbnail
+///
+/// Records are only appended and flushed one by one, so a file left by a crash
+/// is still valid up to the last complete record.
+///
+/// Not thread safe: QCameraCalibrate serializes its recording with its own mutex.
+class CornerDataset
+{
+public:
+    CornerDataset();
+    ~CornerDataset();
+
+    /// Creates a new file for appending views. An existing file is overwritten
+    bool create( std::string fileName, cv::Size cbSize, float cbSizeMm, cv::Size imgSize );
+    bool append( const std::vector<cv::Point2f>& corners, const cv::Mat& thumbnail=cv::Mat() );
+    void close();
+
+    bool isOpen(){ return mFile.is_open(); }
+
+    /// Loads a whole file. Incomplete trailing records are discarded.
+    /// The getters below return the loaded views, appended views are only written to disk
+    bool load( std::string fileName, bool loadThumbnails=true );
+
+    cv::Size getCbSize(){ return mCbSize; }
+    float getCbSizeMm(){ return mCbSizeMm; }
+    cv::Size getImgSize(){ return mImgSize; }
+
+    const std::vector< std::vector<cv::Point2f> >& getCornersVec(){ return mCornersVec; }
+    const std::vector<cv::Mat>& getThumbnails(){ return mThumbnails; }
+
+    /// Gray thumbnail of a frame, small enough to be stored with every view
+    static cv::Mat makeThumbnail( const cv::Mat& frame, int width=160 );
+
+private:
+    std::ofstream mFile;
+
+    cv::Size mCbSize;
+    float mCbSizeMm;
+    cv::Size mImgSize;
+
+    std::vector< std::vector<cv::Point2f> > mCornersVec;
+    std::vector<cv::Mat> mThumbnails;
+};
+
+#endif // CORNERDATASET_H
@@ -0,0 +1,65 @@
+#ifndef FASTREMAP_H
+#define FASTREMAP_H
+
+#include <opencv2/core/core.hpp>
+
+/// Engines available for the undistortion remap
+enum RemapEngine
+{
+    RemapOpenCV = 0,    ///< cv::remap
+    RemapFixedPoint     ///< fastRemap, cv::remap is still used for the inputs it does not support
+};
+
+/// Bilinear remap of 8-bit images with 1, 3 or 4 channels, using the fixed-point maps
+/// built by cv::initUndistortRectifyMap (CV_16SC2 + CV_16UC1) and a black constant border.
+///
+/// The weights have 10 fractional bits, as the ones of cv::remap for these maps, and the
+/// rounding is the same. The rows are split in stripes on all the cores and every stripe is
+/// processed in tiles, so the source rows used by neighbouring map rows stay in cache.
+/// nearest: the fraction of the maps rounds to the closest source pixel instead of weighting the
+/// 4 neighbours (cv::remap INTER_NEAREST ignores it and takes the top-left one).
+/// Returns false if the input is not supported.
+bool fastRemap( const cv::Mat& src, cv::Mat& dst, const cv::Mat& map1, const cv::Mat& map2, bool nearest=false );
+
+/// fastRemap with the maps interpolated on the fly from a sparse grid (buildUndistortGrid,
+/// CV_32FC2, gridStep power of two). The maps of every tile row are expanded in fixed point
+/// into a buffer that stays in L1: only the grid is read from memory. dstSize is the size
+/// of the output. Returns false if the input is not supported.
+bool fastRemapGrid( const cv::Mat& src, cv::Mat& dst, cv::Size dstSize, const cv::Mat& grid, int gridStep,
+                    bool nearest=false );
+
+// >>>>> Display buffers
+/// fastRemap and fastRemapGrid writing a display-ready CV_8UC4 image: the bytes of
+/// QImage::Format_RGB32 on little-endian CPUs (B G R 255), from gray, BGR or BGRA sources.
+/// The channel conversion happens in the remap pass, the output is wrapped by a QImage without
+/// copies. Returns false if the input is not supported.
+bool fastRemapDisplay( const cv::Mat& src, cv::Mat& dst, const cv::Mat& map1, const cv::Mat& map2, bool nearest=false );
+bool fastRemapGridDisplay( const cv::Mat& src, cv::Mat& dst, cv::Size dstSize, const cv::Mat& grid, int gridStep,
+                           bool nearest=false );
+// <<<<< Display buffers
+
+// >>>>> Planar YUV 4:2:0
+/// Y, U and V planes of an I420 image with lumaSize pixels, as headers on its data. The image is
+/// CV_8UC1 with lumaSize.height*3/2 rows, the layout of cv::COLOR_YUV2BGR_I420. Returns false if
+/// the image does not match or lumaSize is odd
+bool i420Planes( const cv::Mat& img, cv::Size lumaSize, cv::Mat planes[3] );
+
+/// Half resolution maps of the chroma planes, derived from the CV_16SC2 + CV_16UC1 maps of the luma
+/// plane (even size): every chroma pixel samples the source at the center of its 2x2 luma block
+bool chromaRemapMaps( const cv::Mat& map1, const cv::Mat& map2, cv::Mat& chroma1, cv::Mat& chroma2 );
+// <<<<< Planar YUV 4:2:0
+
+/// Dense CV_16SC2 + CV_16UC1 maps equal to the ones fastRemapGrid expands, for cv::remap
+bool expandRemapGrid( const cv::Mat& grid, int gridStep, cv::Size dstSize, cv::Mat& map1, cv::Mat& map2 );
+
+/// Instruction set used by fastRemap on this CPU
+const char* fastRemapIsa();
+
+/// Uses the portable kernel even if SIMD is available (reference output for the benchmarks)
+void fastRemapForceScalar( bool force );
+
+/// Uses the kernels of one instruction set ("Scalar", "SSE4.1", "AVX2", "NEON"), NULL for the best
+/// one, so the tests compare all the kernels of the CPU. Returns false if the CPU does not run it
+bool fastRemapUseIsa( const char* isa );
+
+#endif // FASTREMAP_H
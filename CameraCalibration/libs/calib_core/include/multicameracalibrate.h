@@ -0,0 +1,99 @@
+#ifndef MULTICAMERACALIBRATE_H
+#define MULTICAMERACALIBRATE_H
+
+#include <opencv2/core/core.hpp>
+
+#include <string>
+#include <vector>
+
+/// Extrinsic calibration of a camera of the rig with respect to camera 0
+struct CameraPairCalib
+{
+    int camera;             ///< Index of the second camera, the first one is always camera 0
+    size_t pairCount;       ///< Synchronized chessboard pairs used by the solver
+    double reprojErr;
+
+    cv::Mat R, T, E, F;
+
+    // >>>>> Rectification
+    cv::Mat R1, R2, P1, P2, Q;
+
+    cv::Mat map1First, map2First;   ///< Rectification maps of camera 0 (CV_16SC2)
+    cv::Mat map1Second, map2Second; ///< Rectification maps of the second camera (CV_16SC2)
+    // <<<<< Rectification
+};
+
+/// Calibration of a rig of N synchronized cameras (e.g. a stereo pair).
+///
+/// Each camera collects its own timestamped chessboard views. The intrinsic
+/// parameters of all the cameras are solved in parallel, then the views are
+/// paired by timestamp and every camera is calibrated against camera 0, again
+/// in parallel, producing the rectification maps of each pair.
+///
+/// Not thread safe: one thread adds the views and calls calibrate(), which uses all the cores itself.
+class MultiCameraCalibrate
+{
+public:
+    MultiCameraCalibrate( int cameraCount, cv::Size cbSize, float cbSizeMm, bool fishEye );
+
+    int getCameraCount(){ return static_cast<int>(mCameras.size()); }
+
+    void setImageSize( int camera, cv::Size imgSize );
+
+    /// Two views of different cameras are a pair if their timestamps differ less than this
+    void setSyncTolerance( double msec ){ mSyncTolMsec = msec; }
+
+    void addView( int camera, double timestampMs, const std::vector<cv::Point2f>& corners );
+
+    /// Uses known intrinsic parameters for a camera instead of solving them
+    void setIntrinsics( int camera, cv::Mat K, cv::Mat D );
+
+    /// Blocking. Solves all the cameras and all the pairs using all the cores
+    bool calibrate( double alpha=0.0 );
+
+    void getIntrinsics( int camera, cv::Mat& K, cv::Mat& D, double& reprojErr );
+    const std::vector<CameraPairCalib>& getPairs(){ return mPairs; }
+
+    bool saveCameraParams( std::string fileName );
+
+    std::string getErrorString(){ return mErrorString; }
+
+protected:
+    struct View
+    {
+        double timestampMs;
+        std::vector<cv::Point2f> corners;
+    };
+
+    struct Camera
+    {
+        cv::Size imgSize;
+        std::vector<View> views;
+
+        bool intrinsicsSet;
+        cv::Mat K;
+        cv::Mat D;      ///< 8x1, FishEye uses the first 4 coefficients
+        double reprojErr;
+    };
+
+    bool calibrateIntrinsics( int camera );
+    /// error: why it failed, empty if the views are missing. Solver errors are caught
+    bool calibratePair( int camera, double alpha, CameraPairCalib& pair, std::string& error );
+
+    /// Indexes of the synchronized views of camera 0 and of another camera
+    void syncViews( int camera, std::vector< std::pair<size_t,size_t> >& pairs );
+
+private:
+    cv::Size mCbSize;
+    float mCbSizeMm;
+    bool mFishEye;
+
+    double mSyncTolMsec;
+
+    std::vector<Camera> mCameras;
+    std::vector<CameraPairCalib> mPairs;
+
+    std::string mErrorString;
+};
+
+#endif // MULTICAMERACALIBRATE_H
@@ -0,0 +1,497 @@
+#ifndef PIPELINESTAGE_H
+#define PIPELINESTAGE_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "spscqueue.h"
+
+typedef std::chrono::steady_clock PipelineClock;
+
+/// What a stage does with an item pushed when its queues are full
+enum QueuePolicy
+{
+    QueueBlock = 0,     ///< The producer waits for a free slot: backpressure, nothing is lost
+    QueueDropNewest,    ///< The new item is dropped
+    QueueKeepLatest     ///< A single slot (LatestSlot): the new item replaces the one not processed yet
+};
+
+/// Counters of a stage over the period since the previous getStats()
+struct StageStats
+{
+    std::string name;
+    int workers;
+    uint64_t processed;
+    uint64_t dropped;       ///< Dropped by the queue policy
+    size_t queueDepth;      ///< Items waiting when the stats were taken
+    size_t queueCapacity;
+    double fps;             ///< Items processed per second
+    double latencyMsec;     ///< Average time from the push to the end of the processing
+    double busyMsec;        ///< Average processing time
+
+    StageStats();
+};
+
+/// Counters and statistics shared by the stages, whatever their item type
+class PipelineStageBase
+{
+public:
+    PipelineStageBase( const std::string& name, QueuePolicy policy );
+    virtual ~PipelineStageBase();
+
+    const std::string& getName() const { return mName; }
+    QueuePolicy getPolicy() const { return mPolicy; }
+
+    /// Statistics since the previous call. Thread safe
+    StageStats getStats();
+
+    virtual size_t getQueueDepth() const = 0;
+    virtual size_t getQueueCapacity() const = 0;
+    virtual int getWorkerCount() const = 0;
+
+protected:
+    void countProcessed( PipelineClock::time_point pushed, PipelineClock::time_point start,
+                         PipelineClock::time_point end );
+    void countDropped( uint64_t count=1 );
+
+    const std::string mName;
+    const QueuePolicy mPolicy;
+
+private:
+    std::atomic<uint64_t> mProcessed;
+    std::atomic<uint64_t> mDropped;
+    std::atomic<uint64_t> mLatencyUsec;
+    std::atomic<uint64_t> mBusyUsec;
+
+    // >>>>> Guarded by mStatsMutex: totals at the previous getStats
+    std::mutex mStatsMutex;
+    PipelineClock::time_point mLastStatsTime;
+    uint64_t mLastProcessed;
+    uint64_t mLastDropped;
+    uint64_t mLastLatencyUsec;
+    uint64_t mLastBusyUsec;
+    // <<<<< Guarded by mStatsMutex
+};
+
+/// Stage of a dataflow pipeline: a pool of worker threads running the same function on the items
+/// pushed by the previous stages.
+///
+/// Every producer has a bounded lock-free queue (SpscQueue, LatestSlot for QueueKeepLatest) to
+/// every worker, so the queues stay single producer and single consumer: producer p must always
+/// push with the same index, from one thread at a time. A push takes the next worker with a free
+/// slot, round robin, and wakes it only if it sleeps. When all the queues of the producer are full
+/// the policy decides.
+/// T must be default constructible and swappable; an item is released as soon as it is processed.
+///
+/// The workers start with the stage. stop() (or the destructor) discards the queued items and
+/// waits for the items in progress.
+template<class T>
+class PipelineStage : public PipelineStageBase
+{
+public:
+    /// Runs on the worker threads. worker: index of the thread in the stage, the producer index
+    /// of its pushes to the next stage
+    typedef std::function<void(T& item, int worker)> Process;
+
+    /// capacity: slots of each queue, 1 with QueueKeepLatest. With more than one worker the items
+    /// complete out of order
+    PipelineStage( const std::string& name, Process process, size_t capacity=2,
+                   QueuePolicy policy=QueueDropNewest, int workers=1, int producers=1 )
+        : PipelineStageBase( name, policy )
+        , mProcess( process )
+    {
+        mStop = false;
+        mBlocked = 0;
+
+        workers = std::max( 1, workers );
+        producers = std::max( 1, producers );
+
+        mNextWorker.assign( producers, 0 );
+
+        for( int w=0; w<workers; w++ )
+        {
+            std::unique_ptr<Worker> worker( new Worker );
+            worker->index = w;
+            worker->nextQueue = 0;
+            worker->sleeping = false;
+
+            for( int p=0; p<producers; p++ )
+            {
+                if( policy==QueueKeepLatest )
+                    worker->latest.emplace_back( new LatestSlot<Slot>() );
+                else
+                    worker->queues.emplace_back( new SpscQueue<Slot>( capacity ) );
+            }
+
+            mWorkers.push_back( std::move(worker) );
+        }
+
+        for( size_t w=0; w<mWorkers.size(); w++ )
+        {
+            mWorkers[w]->thread = std::thread( &PipelineStage::run, this, mWorkers[w].get() );
+        }
+    }
+
+    virtual ~PipelineStage()
+    {
+        stop();
+    }
+
+    void stop()
+    {
+        mStop = true;
+
+        for( size_t w=0; w<mWorkers.size(); w++ )
+        {
+            std::lock_guard<std::mutex> lock( mWorkers[w]->mutex );
+            mWorkers[w]->cond.notify_one();
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( mSpaceMutex );
+            mSpaceCond.notify_all();
+        }
+
+        for( size_t w=0; w<mWorkers.size(); w++ )
+        {
+            if( mWorkers[w]->thread.joinable() )
+                mWorkers[w]->thread.join();
+        }
+    }
+
+    /// Returns false if the item was dropped by the policy or because the stage is stopped
+    bool push( T item, int producer=0 )
+    {
+        Slot slot;
+        std::swap( slot.item, item );
+        slot.pushed = PipelineClock::now();
+
+        if( mPolicy==QueueKeepLatest )
+            return pushLatest( slot, producer );
+
+        size_t count = mWorkers.size();
+
+        for(;;)
+        {
+            if( mStop )
+                break;
+
+            // >>>>> First worker with a free slot, round robin
+            for( size_t n=0; n<count; n++ )
+            {
+                size_t w = (mNextWorker[producer]+n)%count;
+                Worker& worker = *mWorkers[w];
+
+                if( worker.queues[producer]->tryPush( slot ) )
+                {
+                    mNextWorker[producer] = (w+1)%count;
+                    wake( worker );
+                    return true;
+                }
+            }
+            // <<<<< First worker with a free slot, round robin
+
+            if( mPolicy!=QueueBlock )
+                break;
+
+            waitForSpace( producer );
+        }
+
+        countDropped();
+        return false;
+    }
+
+    size_t getQueueDepth() const override
+    {
+        size_t depth = 0;
+        for( size_t w=0; w<mWorkers.size(); w++ )
+        {
+            for( size_t p=0; p<mWorkers[w]->queues.size(); p++ )
+            {
+                depth += mWorkers[w]->queues[p]->size();
+            }
+            for( size_t p=0; p<mWorkers[w]->latest.size(); p++ )
+            {
+                depth += mWorkers[w]->latest[p]->empty() ? 0 : 1;
+            }
+        }
+        return depth;
+    }
+
+    size_t getQueueCapacity() const override
+    {
+        size_t capacity = 0;
+        for( size_t w=0; w<mWorkers.size(); w++ )
+        {
+            for( size_t p=0; p<mWorkers[w]->queues.size(); p++ )
+            {
+                capacity += mWorkers[w]->queues[p]->capacity();
+            }
+            capacity += mWorkers[w]->latest.size();
+        }
+        return capacity;
+    }
+
+    int getWorkerCount() const override { return static_cast<int>(mWorkers.size()); }
+
+private:
+    struct Slot
+    {
+        T item;
+        PipelineClock::time_point pushed;
+    };
+
+    struct Worker
+    {
+        int index;
+        std::vector< std::unique_ptr< SpscQueue<Slot> > > queues; ///< One per producer
+        std::vector< std::unique_ptr< LatestSlot<Slot> > > latest; ///< Instead of queues, QueueKeepLatest
+        size_t nextQueue;
+
+        std::mutex mutex;
+        std::condition_variable cond;
+        std::atomic<bool> sleeping;
+
+        std::thread thread;
+    };
+
+    void run( Worker* worker )
+    {
+        for(;;)
+        {
+            Slot slot;
+
+            if( !popNext( *worker, slot ) )
+            {
+                std::unique_lock<std::mutex> lock( worker->mutex );
+
+                // Paired with the fence of wake(): either the producer sees the flag or the
+                // worker sees the item
+                worker->sleeping = true;
+                std::atomic_thread_fence( std::memory_order_seq_cst );
+
+                worker->cond.wait( lock, [&](){ return mStop || hasItems( *worker ); } );
+
+                worker->sleeping = false;
+
+                if( mStop )
+                    return;
+
+                continue;
+            }
+
+            if( mStop )
+                return;
+
+            // >>>>> A slot is free: wake the blocked producers
+            std::atomic_thread_fence( std::memory_order_seq_cst );
+
+            if( mBlocked>0 )
+            {
+                std::lock_guard<std::mutex> lock( mSpaceMutex );
+                mSpaceCond.notify_all();
+            }
+            // <<<<< A slot is free: wake the blocked producers
+
+            PipelineClock::time_point start = PipelineClock::now();
+            mProcess( slot.item, worker->index );
+            countProcessed( slot.pushed, start, PipelineClock::now() );
+        }
+    }
+
+    /// Next item of the worker, its queues in turn
+    bool popNext( Worker& worker, Slot& slot )
+    {
+        if( mStop )
+            return false;
+
+        size_t count = worker.queues.size() + worker.latest.size();
+
+        for( size_t n=0; n<count; n++ )
+        {
+            size_t q = (worker.nextQueue+n)%count;
+
+            bool popped = (q<worker.queues.size()) ? worker.queues[q]->tryPop( slot )
+                                                   : worker.latest[q-worker.queues.size()]->take( slot );
+
+            if( popped )
+            {
+                worker.nextQueue = (q+1)%count;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    bool hasItems( const Worker& worker ) const
+    {
+        for( size_t p=0; p<worker.queues.size(); p++ )
+        {
+            if( !worker.queues[p]->empty() )
+                return true;
+        }
+        for( size_t p=0; p<worker.latest.size(); p++ )
+        {
+            if( !worker.latest[p]->empty() )
+                return true;
+        }
+        return false;
+    }
+
+    /// QueueKeepLatest: the first worker without an item of the producer, else the next one round
+    /// robin, where the item not processed yet is replaced and dropped
+    bool pushLatest( Slot& slot, int producer )
+    {
+        if( mStop )
+        {
+            countDropped();
+            return false;
+        }
+
+        size_t count = mWorkers.size();
+        size_t target = mNextWorker[producer];
+
+        for( size_t n=0; n<count; n++ )
+        {
+            size_t w = (mNextWorker[producer]+n)%count;
+
+            if( mWorkers[w]->latest[producer]->empty() )
+            {
+                target = w;
+                break;
+            }
+        }
+
+        mNextWorker[producer] = (target+1)%count;
+
+        Worker& worker = *mWorkers[target];
+
+        if( worker.latest[producer]->put( slot ) )
+            countDropped();
+
+        wake( worker );
+        return true;
+    }
+
+    void wake( Worker& worker )
+    {
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        if( worker.sleeping )
+        {
+            std::lock_guard<std::mutex> lock( worker.mutex );
+            worker.cond.notify_one();
+        }
+    }
+
+    /// QueueBlock: sleeps until a queue of the producer has a free slot
+    void waitForSpace( int producer )
+    {
+        std::unique_lock<std::mutex> lock( mSpaceMutex );
+
+        mBlocked++;
+        std::atomic_thread_fence( std::memory_order_seq_cst );
+
+        mSpaceCond.wait( lock, [&]()
+        {
+            if( mStop )
+                return true;
+
+            for( size_t w=0; w<mWorkers.size(); w++ )
+            {
+                const SpscQueue<Slot>& queue = *mWorkers[w]->queues[producer];
+
+                if( queue.size()<queue.capacity() )
+                    return true;
+            }
+            return false;
+        } );
+
+        mBlocked--;
+    }
+
+    Process mProcess;
+
+    std::vector< std::unique_ptr<Worker> > mWorkers;
+    std::vector<size_t> mNextWorker;    ///< Round robin position of each producer
+
+    std::atomic<bool> mStop;
+
+    // >>>>> QueueBlock
+    std::mutex mSpaceMutex;
+    std::condition_variable mSpaceCond;
+    std::atomic<int> mBlocked;          ///< Producers waiting for a free slot
+    // <<<<< QueueBlock
+};
+
+/// Latest result of a pipeline, taken by a consumer with its own pace (the GUI timer).
+/// A result replaced before being taken counts as dropped; the latency is measured from the
+/// time the frame entered the pipeline
+template<class T>
+class PipelineOutput : public PipelineStageBase
+{
+public:
+    explicit PipelineOutput( const std::string& name )
+        : PipelineStageBase( name, QueueKeepLatest )
+    {
+        mFull = false;
+    }
+
+    /// Any thread
+    void post( T item, PipelineClock::time_point entered )
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+
+        if( mFull )
+            countDropped();
+
+        std::swap( mItem, item );
+        mEntered = entered;
+        mFull = true;
+    }
+
+    /// Returns false if there is no new result
+    bool take( T& item )
+    {
+        PipelineClock::time_point entered;
+
+        {
+            std::lock_guard<std::mutex> lock( mMutex );
+
+            if( !mFull )
+                return false;
+
+            std::swap( item, mItem );
+            mItem = T();
+            entered = mEntered;
+            mFull = false;
+        }
+
+        PipelineClock::time_point now = PipelineClock::now();
+        countProcessed( entered, now, now );
+
+        return true;
+    }
+
+    size_t getQueueDepth() const override { return mFull ? 1 : 0; }
+    size_t getQueueCapacity() const override { return 1; }
+    int getWorkerCount() const override { return 1; }
+
+private:
+    std::mutex mMutex;
+    T mItem;
+    PipelineClock::time_point mEntered;
+    std::atomic<bool> mFull;
+};
+
+#endif // PIPELINESTAGE_H
@@ -0,0 +1,44 @@
+#ifndef POINTUNDISTORTER_H
+#define POINTUNDISTORTER_H
+
+#include <opencv2/core/core.hpp>
+#include <memory>
+#include <vector>
+
+struct MapParams; // Internal to calib_core (distortionmodels.h)
+
+/// Batch conversion of points between the raw image and an undistorted image, for one set of
+/// calibration parameters. Immutable after construction, so it is shared between threads.
+///
+/// distort() is the projection of the undistortion maps. undistort() inverts it: a table of the
+/// inverse of the radial distortion gives the first guess, then a fixed number of Newton steps
+/// remove the tangential and thin prism terms. All the points run the same instructions, two by
+/// two in SIMD registers, and batches of more than POINT_PARALLEL_MIN points use all the cores.
+class PointUndistorter
+{
+public:
+    /// K, D: calibration (D as in CameraUndistort, only the first 4 values are used for FishEye).
+    /// newK: camera matrix of the undistorted points. imgSize: raw image, the first guess of
+    /// undistort() is precise within its borders
+    PointUndistorter( const cv::Mat& K, const cv::Mat& D, bool fishEye, const cv::Mat& newK, cv::Size imgSize );
+    ~PointUndistorter();
+
+    bool empty() const { return !mValid; }
+
+    /// Raw image pixels to undistorted pixels, as cv::undistortPoints with P=newK. dst may be src
+    void undistort( const cv::Point2f* src, cv::Point2f* dst, size_t count ) const;
+
+    /// Undistorted pixels to raw image pixels, as the undistortion maps. dst may be src
+    void distort( const cv::Point2f* src, cv::Point2f* dst, size_t count ) const;
+
+private:
+    std::unique_ptr<MapParams> mParams; ///< ir is the inverse of newK
+    double mNewK[9];
+
+    std::vector<double> mRadialLut; ///< Undistorted radius of the distorted radius i*mLutStep
+    double mLutStep;
+
+    bool mValid;
+};
+
+#endif // POINTUNDISTORTER_H
@@ -0,0 +1,96 @@
+#ifndef PUBLISHEDPTR_H
+#define PUBLISHEDPTR_H
+
+#include <atomic>
+#include <memory>
+#include <thread>
+
+#define PUBLISHED_SLOTS 3
+
+/// Shared pointer published by one writer at a time and loaded by any number of readers without
+/// locks (std::atomic_load on a shared_ptr takes a mutex of a global pool in libstdc++).
+///
+/// The pointer lives in preallocated slots: the current one is an atomic index and each slot
+/// counts the readers copying it. A reader registers on the current slot, checks it is still
+/// current and copies the pointer (an atomic reference increment). The writer fills a slot
+/// that is neither current nor read, then makes it current, so a slot is never written while
+/// a reader copies it. The writer spins only while readers copy a pointer.
+template<class T>
+class PublishedPtr
+{
+public:
+    PublishedPtr()
+    {
+        mCurrent = 0;
+
+        for( int s=0; s<PUBLISHED_SLOTS; s++ )
+        {
+            mReaders[s] = 0;
+        }
+    }
+
+    /// Any thread, lock-free
+    std::shared_ptr<T> load() const
+    {
+        for(;;)
+        {
+            int s = mCurrent.load();
+
+            mReaders[s].fetch_add( 1 );
+
+            // Paired with the writer: a slot that is still current has been filled before
+            if( mCurrent.load()==s )
+            {
+                std::shared_ptr<T> ptr = mSlots[s];
+                mReaders[s].fetch_sub( 1 );
+                return ptr;
+            }
+
+            mReaders[s].fetch_sub( 1 );
+        }
+    }
+
+    /// One writer at a time (serialized by the caller). The previous pointers are released
+    /// unless a reader is copying them
+    void store( std::shared_ptr<T> ptr )
+    {
+        int current = mCurrent.load();
+        int next = current;
+
+        while( next==current )
+        {
+            for( int s=0; s<PUBLISHED_SLOTS; s++ )
+            {
+                if( s!=current && mReaders[s].load()==0 )
+                {
+                    next = s;
+                    break;
+                }
+            }
+
+            if( next==current )
+                std::this_thread::yield();
+        }
+
+        mSlots[next].swap( ptr );
+        mCurrent.store( next );
+
+        // >>>>> Release the older pointers not being copied
+        for( int s=0; s<PUBLISHED_SLOTS; s++ )
+        {
+            if( s!=next && mReaders[s].load()==0 )
+                mSlots[s].reset();
+        }
+        // <<<<< Release the older pointers not being copied
+    }
+
+private:
+    PublishedPtr( const PublishedPtr& );
+    PublishedPtr& operator=( const PublishedPtr& );
+
+    std::shared_ptr<T> mSlots[PUBLISHED_SLOTS];
+    std::atomic<int> mCurrent;
+    mutable std::atomic<int> mReaders[PUBLISHED_SLOTS];
+};
+
+#endif // PUBLISHEDPTR_H
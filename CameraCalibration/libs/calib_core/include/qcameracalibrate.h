@@ -0,0 +1,269 @@
+#ifndef QFISHEYEUNDISTORT_H
+#define QFISHEYEUNDISTORT_H
+
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <opencv2/core/core.hpp>
+
+#include <vector>
+#include <string>
+#include <atomic>
+
+class CameraUndistort;
+class CornerDataset;
+struct StageStats;
+
+template<class T> class PipelineStage;
+
+/// Camera models supported by the solver
+enum CameraModel
+{
+    ModelPinhole5 = 0,  ///< k1, k2, p1, p2, k3
+    ModelRational,      ///< 8 coefficients, the default pinhole model
+    ModelThinPrism,     ///< 12 coefficients, rational model plus s1..s4
+    ModelFisheye,       ///< cv::fisheye, 4 coefficients
+
+    ModelCount
+};
+
+/// Stages of the progressive calibration
+enum SolveStage
+{
+    StageCoarse = 0,    ///< Subsampled corners, higher-order distortion terms fixed
+    StageIntermediate,  ///< Subsampled corners, all the terms
+    StageFull           ///< All the corners and all the terms
+};
+
+/// Cost and convergence of a single solver run
+struct SolveStats
+{
+    /// TermNotTraced: the solve was not traced, so its convergence is unknown
+    enum Termination { TermConverged, TermMaxIter, TermNotTraced, TermFailed };
+
+    double wallMsec;
+    double cpuMsec;         ///< CPU time of the solving thread
+    int iterations;         ///< LM iterations, rounded up to the trace step. -1 if not traced
+    int maxIterations;
+    size_t views;
+    size_t corners;
+    CameraModel model;
+    SolveStage stage;
+    bool useGuess;
+    Termination termination;
+    double reprojErr;
+    std::vector<double> errTrajectory; ///< RMS error every trace step, empty if not traced
+
+    SolveStats();
+};
+
+/// Result of a camera model solved on the same views of the other models
+struct ModelCandidate
+{
+    CameraModel model;
+    bool valid;
+    cv::Mat K;
+    cv::Mat D;
+    double reprojErr;       ///< RMS on all the views
+    double heldOutErr;      ///< RMS on the views excluded from the training solve, NAN if too few views
+    SolveStats stats;       ///< Final solve on all the views
+};
+
+/// Live and batch calibration of a single camera.
+///
+/// Thread safety: the views and the solver state are guarded by an internal mutex, so views can be
+/// added from any thread while another one changes the parameters. undistort() is lock free and the
+/// statistics have their own mutex: they never wait for a solve in progress. getCbCount() reads
+/// without locking. Signals are emitted from the solving thread. Needs QtCore only
+class QCameraCalibrate : public QObject
+{
+    Q_OBJECT
+public:
+    explicit QCameraCalibrate(cv::Size imgSize, cv::Size cbSize, float cbSquareSizeMm, bool fishEye,
+                              int refineThreshm = 10, QObject *parent = nullptr );
+
+    virtual ~QCameraCalibrate();
+
+    /// Lock free: uses the last undistortion maps published by the solver
+    cv::Mat undistort(cv::Mat &raw);
+    /// Same as undistort, remapping into a caller buffer reused between calls
+    bool undistort( const cv::Mat& raw, cv::Mat& dst );
+    /// Same as undistort, into a display-ready CV_8UC4 buffer (CameraUndistort::undistortDisplay)
+    bool undistortDisplay( const cv::Mat& raw, cv::Mat& dst );
+
+    CameraUndistort* getUndistort(){ return mUndistort; }
+
+    size_t getCbCount()
+    {
+        return mImgCornersVec.size();
+    }
+
+    void getCameraParams( cv::Size& imgSize, cv::Mat& K, cv::Mat& D, double& alpha, bool& fisheye);
+    bool setCameraParams(cv::Size imgSize, cv::Mat& K, cv::Mat& D, double alpha, bool fishEye);
+
+    void setNewAlpha( double alpha );
+    void setFisheye( bool fisheye );
+
+    /// Model used by the next solves. The current parameters are kept as initial guess
+    void setModel( CameraModel model );
+    CameraModel getModel();
+
+    bool saveCameraParams( std::string fileName );
+
+    /// Replaces the stored views and runs a single solve on all of them
+    bool calibrateBatch( const std::vector< std::vector<cv::Point2f> >& imgCornersVec );
+
+    /// Solves again the stored views from scratch with the current camera model
+    bool recalibrate();
+
+    double getReprojErr(){ return mReprojErr; }
+
+    /// maxIter=0 uses the OpenCV default of the model. traceStep>0 samples the error every traceStep
+    /// iterations with extra probe solves, which do not change the result but cost more solver
+    /// time. traceStep=0 (default) only runs the solve
+    void setSolverCriteria( int maxIter, int traceStep );
+
+    SolveStats getLastSolveStats();
+    std::vector<SolveStats> getSolveHistory(); ///< Last solves, oldest first
+
+    /// Solves all the camera models in parallel on the stored views. Blocking.
+    /// Emits modelsCompared when done
+    bool compareModels();
+    /// Same as compareModels, on a background thread
+    void compareModelsAsync();
+
+    std::vector<ModelCandidate> getModelCandidates();
+    /// Model with the lowest held-out error of the last comparison
+    CameraModel getRecommendedModel();
+
+    /// Switches to a model of the last comparison without solving again
+    bool applyModel( CameraModel model );
+
+    static const char* modelName( CameraModel model );
+
+    /// Live solves start coarse and unlock corners and terms as the views accumulate.
+    /// From fullViews on, the full solve runs in background and addCorners does not wait for it
+    void setProgressive( bool enable, int intermediateViews=8, int fullViews=16 );
+    /// Stage of the parameters in use
+    SolveStage getSolveStage();
+
+    static const char* stageName( SolveStage stage );
+
+    /// Counters of the background full solves (pipeline stage "solve")
+    StageStats getSolveStats();
+
+    /// Appends every new view to a corner dataset file. The views already stored are written first
+    bool startRecording( std::string fileName );
+    void stopRecording();
+    bool isRecording();
+
+    /// Loads the views of a corner dataset file and solves them with the current camera model.
+    /// Returns false if the chessboard (square size included) or the image size differ
+    bool loadSession( std::string fileName );
+
+    /// Chessboard detection with sub-pixel refinement, shared by the GUI and the batch tools
+    static bool detectChessboard( const cv::Mat& frame, cv::Size cbSize, std::vector<cv::Point2f>& corners );
+
+    /// 3D chessboard corners in the board reference frame
+    static std::vector<cv::Point3f> chessboardCorners3D( cv::Size boardSize, double squareSize );
+
+    /// Runs the OpenCV solver for the given model. K and D are used as initial guess if useGuess is set.
+    /// D is returned with 8 coefficients (12 for ModelThinPrism). Returns NAN if the solver fails
+    static double calibrate( const std::vector< std::vector<cv::Point3f> >& objCornersVec,
+                             const std::vector< std::vector<cv::Point2f> >& imgCornersVec,
+                             cv::Size imgSize, CameraModel model, bool useGuess, cv::Mat& K, cv::Mat& D,
+                             SolveStats* stats=NULL, int maxIter=0, int traceStep=0, bool fixHighOrder=false );
+
+    /// RMS reprojection error of views not used by the solver: only their pose is estimated
+    static double viewsReprojErr( const std::vector< std::vector<cv::Point3f> >& objCornersVec,
+                                  const std::vector< std::vector<cv::Point2f> >& imgCornersVec,
+                                  CameraModel model, const cv::Mat& K, const cv::Mat& D );
+
+protected:
+    void create3DChessboardCorners(cv::Size boardSize, double squareSize);
+
+    void solve( bool useGuess, SolveStage stage=StageFull ); // mMutex must be locked by the caller
+
+    // >>>>> mMutex must be locked by the caller
+    void publishSolve( const SolveStats& stats, cv::Mat K, cv::Mat D, double alpha );
+    SolveStage progressiveStage();
+    void scheduleFullSolve();
+    // <<<<< mMutex must be locked by the caller
+
+    static double calibrateStep( const std::vector< std::vector<cv::Point3f> >& objCornersVec,
+                                 const std::vector< std::vector<cv::Point2f> >& imgCornersVec,
+                                 cv::Size imgSize, CameraModel model, bool useGuess, int maxIter,
+                                 bool fixHighOrder, cv::Mat& K, cv::Mat& D );
+
+    /// Corners of a view on the coarse grid (every other row and column, borders included)
+    void subsampleCorners( const std::vector<cv::Point2f>& imgCorners, std::vector<cv::Point2f>& subImg,
+                           std::vector<cv::Point3f>& subObj );
+
+    ModelCandidate solveCandidate( CameraModel model,
+                                   const std::vector< std::vector<cv::Point2f> >& imgCornersVec,
+                                   int maxIter, int traceStep );
+
+    void backgroundFullSolve(); // Run by mSolveStage
+
+signals:
+    void newCameraParams(cv::Mat K, cv::Mat D, bool refined, double reprojErr );
+    void modelsCompared();
+
+public slots:
+    void addCorners(std::vector<cv::Point2f> &img_corners, cv::Mat thumbnail=cv::Mat() );
+
+private:
+    QMutex mMutex;
+
+    std::vector< std::vector<cv::Point2f> > mImgCornersVec;
+    std::vector< std::vector<cv::Point3f> > mObjCornersVec;
+
+    std::vector<cv::Point3f> mDefObjCorners;
+
+    //cv::Mat mIntrinsic;
+    //cv::Mat mDistCoeffs;
+
+    std::atomic<bool> mCoeffReady; // Read by undistort() without locking mMutex
+    bool mRefined;
+    CameraModel mModel;
+    //bool mFishEye;
+    //double mAlpha;
+
+    cv::Size mImgSize;
+    cv::Size mCbSize;
+    float mCbSquareSizeMm;
+
+    double mReprojErr;
+
+    int mRefineThresh;
+
+    // >>>>> Solver telemetry
+    int mSolverMaxIter;
+    int mSolverTraceStep;
+
+    QMutex mStatsMutex; // Not mMutex, so the GUI can read the stats while a solve is running
+    std::vector<SolveStats> mSolveHistory;
+    // <<<<< Solver telemetry
+
+    // >>>>> Model comparison
+    QMutex mCandidatesMutex;
+    std::vector<ModelCandidate> mCandidates;
+    CameraModel mRecommendedModel;
+
+    QThreadPool mTaskPool; // Background comparisons, waited by the destructor
+    // <<<<< Model comparison
+
+    // >>>>> Progressive calibration
+    bool mProgressive;
+    int mIntermediateViews;
+    int mFullViews;
+    int mTotalViews;            // Views received by addCorners, not reset by the refine threshold
+
+    PipelineStage<int>* mSolveStage; // Full solves, one running and at most one queued
+    // <<<<< Progressive calibration
+
+    CameraUndistort* mUndistort;
+    CornerDataset* mDataset;
+};
+
+#endif // QFISHEYEUNDISTORT_H
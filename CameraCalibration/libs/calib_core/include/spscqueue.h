@@ -0,0 +1,142 @@
+#ifndef SPSCQUEUE_H
+#define SPSCQUEUE_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+#define SPSC_CACHE_LINE 64
+
+/// Bounded lock-free queue for one producer thread and one consumer thread.
+/// The indices grow without wrapping the slots, so a full queue and an empty queue differ
+/// and all the slots are used. Pushes and pops never block and never allocate
+template<class T>
+class SpscQueue
+{
+public:
+    explicit SpscQueue( size_t capacity )
+        : mSlots( capacity>0 ? capacity : 1 )
+    {
+        mHead = 0;
+        mTail = 0;
+    }
+
+    /// Producer only. Returns false if the queue is full, item is left untouched
+    bool tryPush( T& item )
+    {
+        size_t head = mHead.load( std::memory_order_relaxed );
+
+        if( head - mTail.load( std::memory_order_acquire ) >= mSlots.size() )
+            return false;
+
+        std::swap( mSlots[head % mSlots.size()], item );
+        mHead.store( head+1, std::memory_order_release );
+
+        return true;
+    }
+
+    /// Consumer only. Returns false if the queue is empty
+    bool tryPop( T& item )
+    {
+        size_t tail = mTail.load( std::memory_order_relaxed );
+
+        if( mHead.load( std::memory_order_acquire ) == tail )
+            return false;
+
+        T& slot = mSlots[tail % mSlots.size()];
+        std::swap( item, slot );
+        slot = T();                 // The queue does not keep references to the popped data
+
+        mTail.store( tail+1, std::memory_order_release );
+
+        return true;
+    }
+
+    /// Items queued, exact only from the producer or the consumer thread
+    size_t size() const
+    {
+        // Tail first: it never passes the head read after it
+        size_t tail = mTail.load( std::memory_order_acquire );
+
+        return mHead.load( std::memory_order_acquire ) - tail;
+    }
+
+    bool empty() const { return size()==0; }
+    size_t capacity() const { return mSlots.size(); }
+
+private:
+    std::vector<T> mSlots;
+
+    // Padded to separate cache lines: the producer writes mHead, the consumer writes mTail.
+    // Padding instead of alignas, heap allocations are not over-aligned before C++17
+    char mPad0[SPSC_CACHE_LINE];
+    std::atomic<size_t> mHead;
+    char mPad1[SPSC_CACHE_LINE];
+    std::atomic<size_t> mTail;
+    char mPad2[SPSC_CACHE_LINE];
+};
+
+/// Single item exchange between one producer thread and one consumer thread: a new item
+/// replaces the one not taken yet, so the consumer always gets the latest. Lock-free triple
+/// buffer: the producer writes its back buffer, the consumer reads its front buffer and the
+/// middle one is swapped atomically, flagged while it holds an item not taken
+template<class T>
+class LatestSlot
+{
+public:
+    LatestSlot()
+    {
+        mMiddle = 1;
+        mBack = 0;
+        mFront = 2;
+    }
+
+    /// Producer only. Returns true if an item not taken yet was replaced (and released)
+    bool put( T& item )
+    {
+        std::swap( mBuffers[mBack], item );
+
+        int prev = mMiddle.exchange( mBack | LATEST_FRESH, std::memory_order_acq_rel );
+
+        mBack = prev & LATEST_INDEX;
+        mBuffers[mBack] = T();
+
+        return (prev & LATEST_FRESH) != 0;
+    }
+
+    /// Consumer only. Returns false if there is no new item
+    bool take( T& item )
+    {
+        // Only the consumer clears the flag: once seen it stays set until the exchange
+        if( !(mMiddle.load( std::memory_order_acquire ) & LATEST_FRESH) )
+            return false;
+
+        mFront = mMiddle.exchange( mFront, std::memory_order_acq_rel ) & LATEST_INDEX;
+
+        std::swap( item, mBuffers[mFront] );
+        mBuffers[mFront] = T();
+
+        return true;
+    }
+
+    bool empty() const
+    {
+        return !(mMiddle.load( std::memory_order_acquire ) & LATEST_FRESH);
+    }
+
+private:
+    enum { LATEST_INDEX = 3, LATEST_FRESH = 4 };
+
+    T mBuffers[3];
+
+    char mPad0[SPSC_CACHE_LINE];
+    std::atomic<int> mMiddle;   ///< Index of the middle buffer, LATEST_FRESH if not taken
+    char mPad1[SPSC_CACHE_LINE];
+    int mBack;                  ///< Producer only
+    char mPad2[SPSC_CACHE_LINE];
+    int mFront;                 ///< Consumer only
+    char mPad3[SPSC_CACHE_LINE];
+};
+
+#endif // SPSCQUEUE_H
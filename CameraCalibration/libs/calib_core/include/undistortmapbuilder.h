@@ -0,0 +1,48 @@
+#ifndef UNDISTORTMAPBUILDER_H
+#define UNDISTORTMAPBUILDER_H
+
+#include <opencv2/core/core.hpp>
+
+#include <atomic>
+
+/// Parallel replacement of cv::initUndistortRectifyMap and cv::fisheye::initUndistortRectifyMap
+/// producing CV_16SC2 + CV_16UC1 maps.
+///
+/// The distortion model is a template parameter of the row kernel, chosen once per map from
+/// fishEye and from the coefficients: polynomial (k4..k6 null), rational, thin prism (12
+/// coefficients) or FishEye (the first 4 coefficients). The pixels of a row are projected in
+/// vector lanes without branches and the rows are split in stripes on all the cores.
+///
+/// R can be empty (identity). Returns false on empty parameters, or if abort is set during
+/// the build: the stripes stop at the next row and the maps are incomplete.
+bool buildUndistortMaps( const cv::Mat& K, const cv::Mat& D, const cv::Mat& R, const cv::Mat& newK,
+                         cv::Size size, bool fishEye, cv::Mat& map1, cv::Mat& map2,
+                         const std::atomic<bool>* abort=NULL );
+
+// >>>>> Sparse grid maps
+// The distortion field is sampled every gridStep output pixels (power of two, 4 to 64) and
+// the remap interpolates it (fastRemapGrid): for a 4K frame the grid is a few hundred KB
+// instead of about 50 MB of dense maps.
+
+/// Nodes of the grid: one more column and row than needed to cover the image
+cv::Size undistortGridSize( cv::Size size, int gridStep );
+
+/// CV_32FC2 source coordinates, in pixels, of the output pixels (i*gridStep, j*gridStep)
+bool buildUndistortGrid( const cv::Mat& K, const cv::Mat& D, const cv::Mat& R, const cv::Mat& newK,
+                         cv::Size size, bool fishEye, int gridStep, cv::Mat& grid,
+                         const std::atomic<bool>* abort=NULL );
+
+/// Largest distance, in pixels, between the bilinear interpolation of the grid and the exact
+/// model, checked in the middle of every cell and cell side. The 1/32 pixel rounding of the
+/// fixed-point maps comes on top, as for the dense maps. -1 on invalid parameters
+double undistortGridError( const cv::Mat& K, const cv::Mat& D, const cv::Mat& R, const cv::Mat& newK,
+                           cv::Size size, bool fishEye, int gridStep, const cv::Mat& grid );
+
+/// Builds the coarsest grid within maxError pixels of the model and returns its step.
+/// 0 if even the finest grid is over the bound, or on abort
+int selectUndistortGrid( const cv::Mat& K, const cv::Mat& D, const cv::Mat& R, const cv::Mat& newK,
+                         cv::Size size, bool fishEye, double maxError, cv::Mat& grid,
+                         const std::atomic<bool>* abort=NULL );
+// <<<<< Sparse grid maps
+
+#endif // UNDISTORTMAPBUILDER_H
@@ -0,0 +1,54 @@
+#ifndef UNDISTORTMAPCACHE_H
+#define UNDISTORTMAPCACHE_H
+
+#include <opencv2/core/core.hpp>
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+
+struct UndistortMaps;
+
+/// On-disk cache of the final undistortion maps, one file per set of parameters.
+///
+/// A file is a fixed header followed by the raw CV_16SC2 and CV_16UC1 maps at page aligned
+/// offsets: loading it is a single mmap and the maps are cv::Mat pointing into the mapping,
+/// which stays alive as long as any of them or of their copies (PROT_READ: never write them). Files are written aside and renamed, the
+/// header holds the exact parameters and is checked on every load. The least recently used
+/// files are removed when the cache grows over its size limit.
+///
+/// Thread safe: one cache is shared by all the calibrators of a process.
+class UndistortMapCache
+{
+public:
+    /// The folder must exist
+    explicit UndistortMapCache( std::string dir, uint64_t maxBytes=512ull*1024*1024 );
+
+    /// Hash of the parameters the maps depend on
+    static uint64_t key( cv::Size imgSize, cv::Size outSize, cv::Rect roi, bool fishEye, const cv::Mat& intr,
+                         const cv::Mat& dist, double alpha );
+
+    /// Fills maps (sizes, view, model, alpha, newK, remap1, remap2) from the cache. False if
+    /// missing or not valid, invalid files are removed
+    bool load( cv::Size imgSize, cv::Size outSize, cv::Rect roi, bool fishEye, const cv::Mat& intr,
+               const cv::Mat& dist, double alpha, UndistortMaps& maps );
+
+    /// Nothing is written if the maps are already cached
+    bool store( const cv::Mat& intr, const cv::Mat& dist, const UndistortMaps& maps );
+
+    const std::string& getDir(){ return mDir; }
+
+protected:
+    std::string fileName( uint64_t key );
+
+    /// Removes the least recently used files over the size limit. mMutex must be locked
+    void evict();
+
+private:
+    std::mutex mMutex;
+
+    std::string mDir;
+    uint64_t mMaxBytes;
+};
+
+#endif // UNDISTORTMAPCACHE_H
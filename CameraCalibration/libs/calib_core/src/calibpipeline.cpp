@@ -0,0 +1,209 @@
+#include "calibpipeline.h"
+
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "qcameracalibrate.h"
+#include "cornerdataset.h"
+
+using namespace std;
+
+#define CONVERT_QUEUE_SIZE 1         // Keep-latest slot: a new frame replaces the one not converted yet
+#define DETECT_QUEUE_SIZE 1         // Per detector: a frame waits only for the detector it is queued to
+#define ACCUMULATE_QUEUE_SIZE 4     // Per detector
+#define UNDISTORT_QUEUE_SIZE 1       // Keep-latest slot
+
+CalibPipeline::Frame::Frame()
+{
+    undistort = false;
+    detect = false;
+    drawCorners = false;
+    generation = 0;
+}
+
+CalibPipeline::View::View()
+{
+    generation = 0;
+}
+
+CalibPipeline::Undistorted::Undistorted()
+{
+    undistorted = false;
+}
+
+CalibPipeline::CalibPipeline( int detectThreads )
+    : mUndistortedOut( "present" )
+    , mCbImageOut( "present chessboard" )
+    , mAccumulateStage( "accumulate", [this]( View& view, int worker ){ accumulate( view, worker ); },
+                        ACCUMULATE_QUEUE_SIZE, QueueBlock, 1, max( 1, detectThreads ) )
+    , mUndistortStage( "undistort", [this]( Frame& frame, int worker ){ undistort( frame, worker ); },
+                       UNDISTORT_QUEUE_SIZE, QueueKeepLatest )
+    , mDetectStage( "detect", [this]( Frame& frame, int worker ){ detect( frame, worker ); },
+                    DETECT_QUEUE_SIZE, QueueDropNewest, max( 1, detectThreads ) )
+    , mConvertStage( "convert", [this]( Frame& frame, int worker ){ convert( frame, worker ); },
+                     CONVERT_QUEUE_SIZE, QueueKeepLatest )
+{
+    // The stages only run on pushed items: nothing reads these before the constructor returns
+    mGeneration = 0;
+    mFoundCount = 0;
+
+    mCalib = NULL;
+    mBufferIdx = 0;
+}
+
+CalibPipeline::~CalibPipeline()
+{
+    // Producers first: a detector blocked on a full accumulate queue is released by its worker
+    mConvertStage.stop();
+    mDetectStage.stop();
+    mUndistortStage.stop();
+    mAccumulateStage.stop();
+}
+
+void CalibPipeline::setCalibration( QCameraCalibrate* calib )
+{
+    lock( mAccumulateMutex, mUndistortMutex );
+    lock_guard<mutex> accLock( mAccumulateMutex, adopt_lock );
+    lock_guard<mutex> undLock( mUndistortMutex, adopt_lock );
+
+    mCalib = calib;
+    mGeneration++;
+}
+
+void CalibPipeline::push( const cv::Mat& frame, bool undistort, bool detect, bool drawCorners, cv::Size cbSize )
+{
+    if( frame.empty() || (!undistort && !detect) )
+        return;
+
+    Frame item;
+    item.frame = frame;
+    item.cbSize = cbSize;
+    item.undistort = undistort;
+    item.detect = detect;
+    item.drawCorners = drawCorners;
+    item.generation = mGeneration;
+    item.entered = PipelineClock::now();
+
+    mConvertStage.push( item );
+}
+
+bool CalibPipeline::takeUndistorted( cv::Mat& image, bool& undistorted )
+{
+    Undistorted res;
+
+    if( !mUndistortedOut.take( res ) )
+        return false;
+
+    image = res.image;
+    undistorted = res.undistorted;
+
+    return true;
+}
+
+bool CalibPipeline::takeCbImage( cv::Mat& cbImage )
+{
+    return mCbImageOut.take( cbImage );
+}
+
+vector<StageStats> CalibPipeline::getStats()
+{
+    vector<StageStats> stats;
+    stats.push_back( mConvertStage.getStats() );
+    stats.push_back( mDetectStage.getStats() );
+    stats.push_back( mAccumulateStage.getStats() );
+    stats.push_back( mUndistortStage.getStats() );
+    stats.push_back( mUndistortedOut.getStats() );
+    stats.push_back( mCbImageOut.getStats() );
+
+    return stats;
+}
+
+void CalibPipeline::convert( Frame& frame, int )
+{
+    if( frame.detect )
+    {
+        if( frame.frame.channels()==1 )
+        {
+            frame.gray = frame.frame;
+        }
+        else
+        {
+            cv::cvtColor( frame.frame, frame.gray, CV_BGR2GRAY );
+        }
+
+        mDetectStage.push( frame );
+    }
+
+    if( frame.undistort )
+    {
+        frame.gray.release();
+        mUndistortStage.push( frame );
+    }
+}
+
+void CalibPipeline::detect( Frame& frame, int worker )
+{
+    vector<cv::Point2f> corners;
+
+    bool found = QCameraCalibrate::detectChessboard( frame.gray, frame.cbSize, corners );
+
+    if( found )
+    {
+        mFoundCount++;
+
+        View view;
+        view.corners = corners;
+        view.gray = frame.gray;
+        view.generation = frame.generation;
+
+        // Each detector is a producer of the accumulate stage
+        mAccumulateStage.push( view, worker );
+    }
+
+    if( frame.drawCorners )
+    {
+        // The frame is shared with the other views: the corners are drawn on a copy
+        cv::Mat cbImage = frame.frame.clone();
+
+        if( found )
+            cv::drawChessboardCorners( cbImage, frame.cbSize, cv::Mat(corners), found );
+
+        mCbImageOut.post( cbImage, frame.entered );
+    }
+}
+
+void CalibPipeline::accumulate( View& view, int )
+{
+    lock_guard<mutex> lock( mAccumulateMutex );
+
+    // Views detected for a previous calibration
+    if( !mCalib || view.generation!=mGeneration )
+        return;
+
+    cv::Mat thumbnail;
+    if( mCalib->isRecording() )
+    {
+        thumbnail = CornerDataset::makeThumbnail( view.gray );
+    }
+
+    mCalib->addCorners( view.corners, thumbnail );
+}
+
+void CalibPipeline::undistort( Frame& frame, int )
+{
+    mBufferIdx = (mBufferIdx+1)%3;
+    cv::Mat& buf = mBuffers[mBufferIdx];
+
+    Undistorted res;
+
+    {
+        lock_guard<mutex> lock( mUndistortMutex );
+
+        if( mCalib )
+            res.undistorted = mCalib->undistortDisplay( frame.frame, buf );
+    }
+
+    res.image = res.undistorted ? buf : frame.frame;
+
+    mUndistortedOut.post( res, frame.entered );
+}
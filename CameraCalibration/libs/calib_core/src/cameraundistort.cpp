@@ -0,0 +1,652 @@
+#include "cameraundistort.h"
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <algorithm>
+
+#include "undistortmapbuilder.h"
+#include "undistortmapcache.h"
+#include "pointundistorter.h"
+
+CameraUndistort::CameraUndistort(cv::Size imgSize, bool fishEye, cv::Mat intr, cv::Mat dist, double alpha)
+{
+    mImgSize = imgSize;
+
+    mUndistortCount = 0;
+    mUndistortAllocCount = 0;
+
+    mRemapEngine = RemapOpenCV;
+
+    mInterpolation[UndistortPreview] = cv::INTER_LINEAR;
+    mInterpolation[UndistortExport] = cv::INTER_LINEAR;
+
+    mGridMaxError = 0.0;
+
+    mRebuildDelayMsec = 0;
+    mBuildPending = false;
+    mStopBuilder = false;
+    mBuildStale = false;
+    mMapBuildCount = 0;
+    mMapDropCount = 0;
+    mMapCacheHitCount = 0;
+
+    mIntrinsic =  cv::Mat(3, 3, CV_64F, cv::Scalar::all(0.0f) );
+    mDistCoeffs = cv::Mat( 8, 1, CV_64F, cv::Scalar::all(0.0f) );
+
+    mIntrinsic.ptr<double>(0)[0] = 1000.0;
+    mIntrinsic.ptr<double>(1)[1] = 1000.0;
+    mIntrinsic.ptr<double>(2)[2] = 1.0;
+    mIntrinsic.ptr<double>(0)[2] = (double)mImgSize.width/2.0;
+    mIntrinsic.ptr<double>(1)[2] = (double)mImgSize.height/2.0;
+
+
+    setCameraParams( imgSize, fishEye, mIntrinsic, mDistCoeffs, alpha );
+}
+
+CameraUndistort::~CameraUndistort()
+{
+    {
+        std::lock_guard<std::mutex> lock( mParamMutex );
+
+        mStopBuilder = true;
+        mBuildStale = true;
+    }
+
+    mBuildCond.notify_one();
+
+    if( mBuilder.joinable() )
+        mBuilder.join();
+}
+
+void CameraUndistort::setMapCache( std::shared_ptr<UndistortMapCache> cache )
+{
+    std::lock_guard<std::mutex> lock( mParamMutex );
+
+    mMapCache = cache;
+}
+
+void CameraUndistort::setRebuildDelay( int msec )
+{
+    std::lock_guard<std::mutex> lock( mParamMutex );
+
+    mRebuildDelayMsec = msec<0?0:msec;
+}
+
+void CameraUndistort::getCameraParams( cv::Size& imgSize, bool& fishEye, cv::Mat& intr, cv::Mat& dist, double& alpha )
+{
+    std::lock_guard<std::mutex> lock( mParamMutex );
+
+    imgSize = mImgSize;
+    fishEye = mFishEye;
+    intr = mIntrinsic.clone();
+    dist = mDistCoeffs.clone();
+    alpha = mAlpha;
+}
+
+bool CameraUndistort::setNewAlpha( double alpha )
+{
+    std::lock_guard<std::mutex> lock( mParamMutex );
+
+    mAlpha = alpha;
+
+    return buildMaps();
+}
+
+bool CameraUndistort::setOutputView( cv::Size outSize, cv::Rect roi )
+{
+    std::lock_guard<std::mutex> lock( mParamMutex );
+
+    mOutSize = outSize;
+    mOutRoi = roi;
+
+    return buildMaps();
+}
+
+cv::Mat CameraUndistort::getOutputCameraMatrix()
+{
+    UndistortMapsPtr maps = mMaps.load();
+
+    if( !maps )
+        return cv::Mat();
+
+    return maps->outK.clone();
+}
+
+cv::Mat CameraUndistort::viewCameraMatrix( const cv::Mat& newK, cv::Rect roi, cv::Size outSize )
+{
+    double sx = static_cast<double>(roi.width)/outSize.width;
+    double sy = static_cast<double>(roi.height)/outSize.height;
+
+    // Output pixel q of the full image pixel p: q = (p - roi.tl + 0.5)/s - 0.5
+    cv::Mat A = cv::Mat::eye( 3, 3, CV_64F );
+    A.ptr<double>(0)[0] = 1.0/sx;
+    A.ptr<double>(0)[2] = (0.5-roi.x)/sx - 0.5;
+    A.ptr<double>(1)[1] = 1.0/sy;
+    A.ptr<double>(1)[2] = (0.5-roi.y)/sy - 0.5;
+
+    cv::Mat K64;
+    newK.convertTo( K64, CV_64F );
+
+    return A*K64;
+}
+
+bool CameraUndistort::setGridMaps( double maxError )
+{
+    std::lock_guard<std::mutex> lock( mParamMutex );
+
+    mGridMaxError = std::max( maxError, 0.0 );
+
+    return buildMaps();
+}
+
+bool CameraUndistort::setFisheye(bool fisheye)
+{
+    std::lock_guard<std::mutex> lock( mParamMutex );
+
+    mFishEye = fisheye;
+
+    return buildMaps();
+}
+
+bool CameraUndistort::setCameraParams(cv::Size imgSize, bool fishEye, cv::Mat intr, cv::Mat dist , double alpha)
+{
+    std::lock_guard<std::mutex> lock( mParamMutex );
+
+    mImgSize = imgSize;
+    mFishEye = fishEye;
+    mAlpha = alpha;
+
+    // Own copies: the caller can keep modifying its matrices
+    mIntrinsic = intr.clone();
+    mDistCoeffs = dist.clone();
+
+    return buildMaps();
+}
+
+bool CameraUndistort::buildMaps()
+{
+    if( mIntrinsic.empty() || mDistCoeffs.empty() )
+        return false;
+
+    // 12 coefficients are kept for the thin prism model
+    if( !mFishEye && mDistCoeffs.rows!=8 && mDistCoeffs.rows!=12 )
+    {
+        mDistCoeffs.resize(8, cv::Scalar::all(0.0));
+    }
+
+    if( mRebuildDelayMsec>0 )
+    {
+        // >>>>> Deferred: every edit moves the deadline and makes the running build stale
+        mBuildPending = true;
+        mBuildStale = true;
+        mBuildDeadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(mRebuildDelayMsec);
+
+        if( !mBuilder.joinable() )
+        {
+            mBuilder = std::thread( &CameraUndistort::builderLoop, this );
+        }
+
+        mBuildCond.notify_one();
+        // <<<<< Deferred: every edit moves the deadline and makes the running build stale
+
+        return true;
+    }
+
+    bool cacheHit = false;
+    UndistortMapsPtr maps = makeMaps( mImgSize, mFishEye, mIntrinsic, mDistCoeffs, mAlpha, mOutSize, mOutRoi, mGridMaxError, NULL,
+                                      mMapCache.get(), cacheHit );
+
+    // >>>>> Publication
+    mMaps.store( maps );
+    if( cacheHit )
+        mMapCacheHitCount++;
+    else
+        mMapBuildCount++;
+    // <<<<< Publication
+
+    return true;
+}
+
+UndistortMapsPtr CameraUndistort::makeMaps( cv::Size imgSize, bool fishEye, const cv::Mat& intr, const cv::Mat& dist,
+                                            double alpha, cv::Size outSize, cv::Rect roi, double gridMaxError,
+                                            const std::atomic<bool>* abort,
+                                            UndistortMapCache* cache, bool& cacheHit )
+{
+    // The new maps are built aside, the ones in use are not touched
+    std::shared_ptr<UndistortMaps> maps = std::make_shared<UndistortMaps>();
+
+    // >>>>> Output view
+    if( roi.width<1 || roi.height<1 )
+        roi = cv::Rect( 0, 0, imgSize.width, imgSize.height );
+
+    if( outSize.width<1 || outSize.height<1 )
+        outSize = roi.size();
+    // <<<<< Output view
+
+    // The cache holds dense maps only
+    if( gridMaxError<=0.0 )
+    {
+        cacheHit = cache && cache->load( imgSize, outSize, roi, fishEye, intr, dist, alpha, *maps );
+
+        if( cacheHit )
+        {
+            maps->outK = viewCameraMatrix( maps->newK, roi, outSize );
+            maps->points = std::make_shared<PointUndistorter>( intr, dist, fishEye, maps->outK, imgSize );
+            return maps;
+        }
+    }
+    else
+    {
+        cacheHit = false;
+    }
+
+    maps->imgSize = imgSize;
+    maps->fishEye = fishEye;
+    maps->alpha = alpha;
+    maps->outSize = outSize;
+    maps->roi = roi;
+    maps->gridStep = 0;
+
+    cv::Mat mapDist = dist;
+
+    if( fishEye )
+    {
+        // >>>>> FishEye model wants only 4 distorsion parameters
+        mapDist = cv::Mat( 4, 1, CV_64F, cv::Scalar::all(0.0f) );
+        mapDist.ptr<double>(0)[0] = dist.ptr<double>(0)[0];
+        mapDist.ptr<double>(1)[0] = dist.ptr<double>(1)[0];
+        mapDist.ptr<double>(2)[0] = dist.ptr<double>(2)[0];
+        mapDist.ptr<double>(3)[0] = dist.ptr<double>(3)[0];
+        // <<<<< FishEye model wants only 4 distorsion parameters
+
+        cv::fisheye::estimateNewCameraMatrixForUndistortRectify( intr, mapDist, imgSize,
+                                                                 cv::noArray(), maps->newK,
+                                                                 alpha );
+    }
+    else
+    {
+        maps->newK = cv::getOptimalNewCameraMatrix( intr, dist, imgSize, alpha );
+    }
+
+    maps->outK = viewCameraMatrix( maps->newK, roi, outSize );
+    maps->points = std::make_shared<PointUndistorter>( intr, dist, fishEye, maps->outK, imgSize );
+
+    // >>>>> Sparse grid maps
+    if( gridMaxError>0.0 )
+    {
+        maps->gridStep = selectUndistortGrid( intr, mapDist, cv::Mat(), maps->outK, outSize, fishEye,
+                                              gridMaxError, maps->grid, abort );
+
+        if( abort && *abort )
+            return UndistortMapsPtr();
+
+        if( maps->gridStep>0 )
+            return maps;
+    }
+    // <<<<< Sparse grid maps
+
+    if( !buildUndistortMaps( intr, mapDist, cv::Mat(), maps->outK, outSize, fishEye,
+                             maps->remap1, maps->remap2, abort ) )
+        return UndistortMapsPtr();
+
+    if( cache )
+    {
+        cache->store( intr, dist, *maps );
+    }
+
+    return maps;
+}
+
+void CameraUndistort::builderLoop()
+{
+    std::unique_lock<std::mutex> lock( mParamMutex );
+
+    while( !mStopBuilder )
+    {
+        if( !mBuildPending )
+        {
+            mBuildCond.wait( lock );
+            continue;
+        }
+
+        // Edits still arriving: wait for a pause
+        if( std::chrono::steady_clock::now() < mBuildDeadline )
+        {
+            mBuildCond.wait_until( lock, mBuildDeadline );
+            continue;
+        }
+
+        // >>>>> Snapshot of the parameters, the build runs unlocked
+        cv::Size imgSize = mImgSize;
+        cv::Size outSize = mOutSize;
+        cv::Rect roi = mOutRoi;
+        bool fishEye = mFishEye;
+        cv::Mat intr = mIntrinsic.clone();
+        cv::Mat dist = mDistCoeffs.clone();
+        double alpha = mAlpha;
+        double gridMaxError = mGridMaxError;
+        std::shared_ptr<UndistortMapCache> cache = mMapCache;
+
+        mBuildPending = false;
+        mBuildStale = false;
+        // <<<<< Snapshot of the parameters, the build runs unlocked
+
+        lock.unlock();
+
+        bool cacheHit = false;
+        UndistortMapsPtr maps = makeMaps( imgSize, fishEye, intr, dist, alpha, outSize, roi, gridMaxError, &mBuildStale,
+                                          cache.get(), cacheHit );
+
+        lock.lock();
+
+        // A stale build is dropped: the newer parameters are pending
+        if( maps && !mBuildStale )
+        {
+            mMaps.store( maps );
+            if( cacheHit )
+                mMapCacheHitCount++;
+            else
+                mMapBuildCount++;
+        }
+        else
+        {
+            mMapDropCount++;
+        }
+    }
+}
+
+UndistortMapsPtr CameraUndistort::getMaps()
+{
+    return mMaps.load();
+}
+
+bool CameraUndistort::saveCameraParams( std::string fileName )
+{
+    std::lock_guard<std::mutex> lock( mParamMutex );
+
+    cv::FileStorage fs( fileName, cv::FileStorage::WRITE );
+
+    if( !fs.isOpened() )
+    {
+        return false;
+    }
+
+    fs << "Width" << mImgSize.width;
+    fs << "Height" << mImgSize.height;
+    fs << "FishEye" << mFishEye;
+    fs << "Alpha" << mAlpha;
+    fs << "CameraMatrix" << mIntrinsic;
+    fs << "DistCoeffs" << mDistCoeffs;
+
+    return true;
+}
+
+bool CameraUndistort::loadCameraParams( std::string fileName )
+{
+    cv::FileStorage fs( fileName, cv::FileStorage::READ );
+
+    if( !fs.isOpened() )
+    {
+        return false;
+    }
+
+    int w,h;
+    bool fisheye;
+    cv::Mat intr,dist;
+    double alpha;
+
+    fs["Width"] >> w;
+    fs["Height"] >> h;
+    fs["FishEye"] >> fisheye;
+    fs["Alpha"] >> alpha;
+
+    fs["CameraMatrix"] >> intr;
+    fs["DistCoeffs"] >> dist;
+
+    if( w<1.0 || h<1.0 )
+    {
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock( mParamMutex );
+
+    mImgSize.width = w;
+    mImgSize.height = h;
+
+    mFishEye = fisheye;
+
+    mAlpha = alpha;
+
+    if( intr.cols!=3 || intr.rows != 3 )
+    {
+        return false;
+    }
+
+    if( dist.cols != 1 )
+    {
+        return false;
+    }
+
+    if( !mFishEye && (dist.rows != 4 && dist.rows != 5 && dist.rows != 8 && dist.rows != 12 ) )
+    {
+        return false;
+    }
+
+    if( mDistCoeffs.rows!=8)
+    {
+        mDistCoeffs.resize(8, cv::Scalar::all(0.0));
+    }
+
+    intr.copyTo( mIntrinsic );
+    dist.copyTo( mDistCoeffs );
+
+    // From the cache, if these parameters were already used
+    return buildMaps();
+}
+
+cv::Mat CameraUndistort::undistort(cv::Mat& raw )
+{
+    // The snapshot stays alive until the end of the call, even if new maps are published meanwhile
+    UndistortMapsPtr maps = mMaps.load();
+
+    if( !maps || maps->empty() )
+        return cv::Mat();
+
+    cv::Mat res;
+    remap( raw, res, *maps, mInterpolation[UndistortExport] ); // Apply undistorsion mappings
+
+    mUndistortCount++;
+    mUndistortAllocCount++;
+
+    return res;
+}
+
+bool CameraUndistort::undistort( const cv::Mat& frame, cv::Mat& dst )
+{
+    UndistortMapsPtr maps = mMaps.load();
+
+    if( !maps || maps->empty() )
+        return false;
+
+    prepareOutput( frame, dst, maps->outSize, frame.type() );
+
+    remap( frame, dst, *maps, mInterpolation[UndistortExport] );
+
+    mUndistortCount++;
+
+    return true;
+}
+
+bool CameraUndistort::undistortDisplay( const cv::Mat& frame, cv::Mat& dst )
+{
+    UndistortMapsPtr maps = mMaps.load();
+
+    if( !maps || maps->empty() )
+        return false;
+
+    int interpolation = mInterpolation[UndistortPreview];
+    int cn = frame.channels();
+
+    if( frame.depth()!=CV_8U || (cn!=1 && cn!=3 && cn!=4) )
+        return false;
+
+    prepareOutput( frame, dst, maps->outSize, CV_8UC4 );
+
+    if( interpolation==cv::INTER_LINEAR || interpolation==cv::INTER_NEAREST )
+    {
+        bool nearest = interpolation==cv::INTER_NEAREST;
+
+        bool done = maps->gridStep>0 ? fastRemapGridDisplay( frame, dst, maps->outSize, maps->grid, maps->gridStep, nearest )
+                                     : fastRemapDisplay( frame, dst, maps->remap1, maps->remap2, nearest );
+
+        if( !done )
+            return false;
+    }
+    else if( cn==4 )
+    {
+        // Format_RGB32 needs an opaque alpha
+        remap( frame, dst, *maps, interpolation );
+        cv::bitwise_or( dst, cv::Scalar( 0, 0, 0, 255 ), dst );
+    }
+    else
+    {
+        cv::Mat res;
+        remap( frame, res, *maps, interpolation );
+        cv::cvtColor( res, dst, cn==1 ? cv::COLOR_GRAY2BGRA : cv::COLOR_BGR2BGRA );
+    }
+
+    mUndistortCount++;
+
+    return true;
+}
+
+bool CameraUndistort::undistortI420( const cv::Mat& frame, cv::Mat& dst )
+{
+    UndistortMapsPtr maps = mMaps.load();
+
+    if( !maps || maps->empty() )
+        return false;
+
+    cv::Size outSize = maps->outSize;
+
+    cv::Mat srcPlanes[3];
+    if( !i420Planes( frame, maps->imgSize, srcPlanes ) || outSize.width%2!=0 || outSize.height%2!=0 )
+        return false;
+
+    std::call_once( maps->chromaOnce, [&maps]()
+    {
+        if( maps->gridStep>0 )
+        {
+            cv::Mat map1, map2;
+            expandRemapGrid( maps->grid, maps->gridStep, maps->outSize, map1, map2 );
+            chromaRemapMaps( map1, map2, maps->chroma1, maps->chroma2 );
+        }
+        else
+        {
+            chromaRemapMaps( maps->remap1, maps->remap2, maps->chroma1, maps->chroma2 );
+        }
+    } );
+
+    if( maps->chroma1.empty() )
+        return false;
+
+    prepareOutput( frame, dst, cv::Size(outSize.width, outSize.height*3/2), CV_8UC1 );
+
+    // The planes of dst have the size of the maps: the remaps write in place
+    cv::Mat dstPlanes[3];
+    i420Planes( dst, outSize, dstPlanes );
+
+    int interpolation = mInterpolation[UndistortExport];
+
+    remap( srcPlanes[0], dstPlanes[0], *maps, interpolation );
+
+    for( int p=1; p<3; p++ )
+    {
+        remapWith( srcPlanes[p], dstPlanes[p], maps->chroma1, maps->chroma2, interpolation );
+    }
+
+    mUndistortCount++;
+
+    return true;
+}
+
+void CameraUndistort::prepareOutput( const cv::Mat& frame, cv::Mat& dst, cv::Size size, int type )
+{
+    // A buffer still referenced elsewhere (e.g. queued to another thread) is replaced, not overwritten
+    bool shared = dst.u && dst.u->refcount > 1;
+
+    if( dst.size()!=size || dst.type()!=type || shared || dst.data==frame.data )
+    {
+        dst = cv::Mat( size, type );
+        mUndistortAllocCount++;
+    }
+}
+
+bool CameraUndistort::undistortPoints( const std::vector<cv::Point2f>& src, std::vector<cv::Point2f>& dst )
+{
+    UndistortMapsPtr maps = mMaps.load();
+
+    if( !maps || !maps->points || maps->points->empty() )
+        return false;
+
+    dst.resize( src.size() );
+    maps->points->undistort( src.data(), dst.data(), src.size() );
+
+    return true;
+}
+
+bool CameraUndistort::distortPoints( const std::vector<cv::Point2f>& src, std::vector<cv::Point2f>& dst )
+{
+    UndistortMapsPtr maps = mMaps.load();
+
+    if( !maps || !maps->points || maps->points->empty() )
+        return false;
+
+    dst.resize( src.size() );
+    maps->points->distort( src.data(), dst.data(), src.size() );
+
+    return true;
+}
+
+void CameraUndistort::remap( const cv::Mat& frame, cv::Mat& dst, const UndistortMaps& maps, int interpolation )
+{
+    if( maps.gridStep>0 )
+    {
+        bool fast = interpolation==cv::INTER_LINEAR || interpolation==cv::INTER_NEAREST;
+
+        if( fast && fastRemapGrid( frame, dst, maps.outSize, maps.grid, maps.gridStep,
+                                   interpolation==cv::INTER_NEAREST ) )
+            return;
+
+        // Formats or interpolations the fixed-point kernels do not support: dense maps for this frame only
+        cv::Mat map1, map2;
+        expandRemapGrid( maps.grid, maps.gridStep, maps.outSize, map1, map2 );
+        cv::remap( frame, dst, map1, map2, interpolation );
+        return;
+    }
+
+    remapWith( frame, dst, maps.remap1, maps.remap2, interpolation );
+}
+
+void CameraUndistort::remapWith( const cv::Mat& frame, cv::Mat& dst, const cv::Mat& map1, const cv::Mat& map2,
+                                 int interpolation )
+{
+    if( interpolation==cv::INTER_NEAREST && fastRemap( frame, dst, map1, map2, true ) )
+        return;
+
+    if( interpolation==cv::INTER_LINEAR && mRemapEngine==RemapFixedPoint && fastRemap( frame, dst, map1, map2 ) )
+        return;
+
+    cv::remap( frame, dst, map1, map2, interpolation );
+}
+
+bool CameraUndistort::setInterpolation( UndistortUse use, int interpolation )
+{
+    if( interpolation!=cv::INTER_NEAREST && interpolation!=cv::INTER_LINEAR &&
+            interpolation!=cv::INTER_CUBIC && interpolation!=cv::INTER_LANCZOS4 )
+        return false;
+
+    mInterpolation[use] = interpolation;
+
+    return true;
+}
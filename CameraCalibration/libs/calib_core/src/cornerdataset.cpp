@@ -0,0 +1,226 @@
+#include "cornerdataset.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <cstdint>
+#include <cstring>
+
+using namespace std;
+
+static const char DATASET_MAGIC[4] = { 'Q', 'C', 'C', 'D' };
+static const uint32_t DATASET_VERSION = 1;
+
+// >>>>> On disk structures
+struct DatasetHeader
+{
+    char magic[4];
+    uint32_t version;
+    int32_t cbCols;
+    int32_t cbRows;
+    float cbSizeMm;
+    int32_t imgWidth;
+    int32_t imgHeight;
+    uint32_t reserved;
+};
+
+struct DatasetRecord
+{
+    uint32_t cornerCount;
+    uint16_t thumbWidth;
+    uint16_t thumbHeight;
+};
+// <<<<< On disk structures
+
+CornerDataset::CornerDataset()
+{
+    mCbSizeMm = 0.0f;
+}
+
+CornerDataset::~CornerDataset()
+{
+    close();
+}
+
+bool CornerDataset::create( string fileName, cv::Size cbSize, float cbSizeMm, cv::Size imgSize )
+{
+    close();
+
+    mCbSize = cbSize;
+    mCbSizeMm = cbSizeMm;
+    mImgSize = imgSize;
+
+    mCornersVec.clear();
+    mThumbnails.clear();
+
+    mFile.open( fileName.c_str(), ios::out | ios::binary | ios::trunc );
+
+    if( !mFile.is_open() )
+        return false;
+
+    DatasetHeader header;
+    memset( &header, 0, sizeof(header) );
+    memcpy( header.magic, DATASET_MAGIC, sizeof(header.magic) );
+    header.version = DATASET_VERSION;
+    header.cbCols = cbSize.width;
+    header.cbRows = cbSize.height;
+    header.cbSizeMm = cbSizeMm;
+    header.imgWidth = imgSize.width;
+    header.imgHeight = imgSize.height;
+
+    mFile.write( reinterpret_cast<const char*>(&header), sizeof(header) );
+    mFile.flush();
+
+    if( !mFile.good() )
+    {
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+bool CornerDataset::append( const vector<cv::Point2f>& corners, const cv::Mat& thumbnail )
+{
+    if( !mFile.is_open() )
+        return false;
+
+    if( (int)corners.size() != mCbSize.area() )
+        return false;
+
+    cv::Mat thumb;
+    if( !thumbnail.empty() && thumbnail.type()==CV_8UC1 &&
+            thumbnail.cols<=UINT16_MAX && thumbnail.rows<=UINT16_MAX )
+    {
+        thumb = thumbnail.isContinuous() ? thumbnail : thumbnail.clone();
+    }
+
+    DatasetRecord record;
+    record.cornerCount = static_cast<uint32_t>(corners.size());
+    record.thumbWidth = static_cast<uint16_t>(thumb.cols);
+    record.thumbHeight = static_cast<uint16_t>(thumb.rows);
+
+    // cv::Point2f is two packed floats, so the vector can be written as it is
+    mFile.write( reinterpret_cast<const char*>(&record), sizeof(record) );
+    mFile.write( reinterpret_cast<const char*>(corners.data()), corners.size()*sizeof(cv::Point2f) );
+    if( !thumb.empty() )
+    {
+        mFile.write( reinterpret_cast<const char*>(thumb.data), thumb.total() );
+    }
+    mFile.flush();
+
+    return mFile.good();
+}
+
+void CornerDataset::close()
+{
+    if( mFile.is_open() )
+    {
+        mFile.close();
+    }
+}
+
+bool CornerDataset::load( string fileName, bool loadThumbnails )
+{
+    close();
+
+    // >>>>> The whole file is read with a single call and parsed in memory
+    ifstream file( fileName.c_str(), ios::in | ios::binary | ios::ate );
+
+    if( !file.is_open() )
+        return false;
+
+    size_t fileSize = static_cast<size_t>( file.tellg() );
+    vector<char> buffer( fileSize );
+
+    file.seekg( 0, ios::beg );
+    file.read( buffer.data(), fileSize );
+
+    if( !file.good() )
+        return false;
+    // <<<<< The whole file is read with a single call and parsed in memory
+
+    // >>>>> Header
+    if( fileSize < sizeof(DatasetHeader) )
+        return false;
+
+    DatasetHeader header;
+    memcpy( &header, buffer.data(), sizeof(header) );
+
+    if( memcmp( header.magic, DATASET_MAGIC, sizeof(header.magic) )!=0 )
+        return false;
+
+    if( header.version > DATASET_VERSION )
+        return false;
+
+    if( header.cbCols<2 || header.cbRows<2 || header.imgWidth<1 || header.imgHeight<1 )
+        return false;
+    // <<<<< Header
+
+    mCbSize = cv::Size( header.cbCols, header.cbRows );
+    mCbSizeMm = header.cbSizeMm;
+    mImgSize = cv::Size( header.imgWidth, header.imgHeight );
+
+    mCornersVec.clear();
+    mThumbnails.clear();
+
+    // >>>>> Records
+    size_t offset = sizeof(DatasetHeader);
+
+    while( offset + sizeof(DatasetRecord) <= fileSize )
+    {
+        DatasetRecord record;
+        memcpy( &record, buffer.data()+offset, sizeof(record) );
+
+        if( (int)record.cornerCount != mCbSize.area() )
+            break; // Corrupted record, the rest of the file cannot be trusted
+
+        size_t cornerBytes = record.cornerCount*sizeof(cv::Point2f);
+        size_t thumbBytes = static_cast<size_t>(record.thumbWidth)*record.thumbHeight;
+
+        if( offset + sizeof(record) + cornerBytes + thumbBytes > fileSize )
+            break; // Truncated by a crash while writing
+
+        offset += sizeof(record);
+
+        vector<cv::Point2f> corners( record.cornerCount );
+        memcpy( corners.data(), buffer.data()+offset, cornerBytes );
+        offset += cornerBytes;
+
+        cv::Mat thumb;
+        if( thumbBytes>0 && loadThumbnails )
+        {
+            thumb.create( record.thumbHeight, record.thumbWidth, CV_8UC1 );
+            memcpy( thumb.data, buffer.data()+offset, thumbBytes );
+        }
+        offset += thumbBytes;
+
+        mCornersVec.push_back( corners );
+        mThumbnails.push_back( thumb );
+    }
+    // <<<<< Records
+
+    return true;
+}
+
+cv::Mat CornerDataset::makeThumbnail( const cv::Mat& frame, int width )
+{
+    if( frame.empty() || width<1 )
+        return cv::Mat();
+
+    cv::Mat gray;
+    if( frame.channels()==1 )
+    {
+        gray = frame;
+    }
+    else
+    {
+        cv::cvtColor( frame, gray, CV_BGR2GRAY );
+    }
+
+    int height = cvRound( static_cast<double>(gray.rows)*width/gray.cols );
+
+    cv::Mat thumb;
+    cv::resize( gray, thumb, cv::Size(width, height), 0.0, 0.0, cv::INTER_AREA );
+
+    return thumb;
+}
@@ -0,0 +1,231 @@
+#ifndef DISTORTIONMODELS_H
+#define DISTORTIONMODELS_H
+
+// Lane math and distortion models shared by the map builder and the point transforms.
+// Internal to calib_core: GCC vector extensions, not part of the public headers
+
+#include <opencv2/core/core.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+#define MAP_LANES 2                             // Doubles in a SSE2/NEON register
+
+typedef double LaneVec __attribute__((vector_size(MAP_LANES*sizeof(double))));
+
+inline LaneVec laneSet( double v )
+{
+    LaneVec res;
+    for( int k=0; k<MAP_LANES; k++ )
+    {
+        res[k] = v;
+    }
+    return res;
+}
+
+inline LaneVec laneSqrt( LaneVec v )
+{
+    LaneVec res;
+    for( int k=0; k<MAP_LANES; k++ )
+    {
+        res[k] = std::sqrt( v[k] );
+    }
+    return res;
+}
+
+/// atan of non-negative values, Cephes rational approximation with branches turned into selects
+inline LaneVec laneAtan( LaneVec x )
+{
+    const double T3P8 = 2.41421356237309504880;     // tan(3*pi/8)
+    const double MOREBITS = 6.123233995736765886130e-17;
+
+    // >>>>> Range reduction, the branches become selects
+    LaneVec xr = (x > T3P8) ? -1.0/x : ((x > 0.66) ? (x-1.0)/(x+1.0) : x);
+    LaneVec y = (x > T3P8) ? laneSet(M_PI_2) : ((x > 0.66) ? laneSet(M_PI_4) : laneSet(0.0));
+    LaneVec extra = (x > T3P8) ? laneSet(MOREBITS) : ((x > 0.66) ? laneSet(0.5*MOREBITS) : laneSet(0.0));
+    // <<<<< Range reduction, the branches become selects
+
+    LaneVec z = xr*xr;
+    LaneVec p = (((-8.750608600031904122785e-1*z - 1.615753718733365076637e1)*z
+                  - 7.500855792314704667340e1)*z - 1.228866684490136173410e2)*z - 6.485021904942025371773e1;
+    LaneVec q = ((((z + 2.485846490142306297962e1)*z + 1.650270098316988542046e2)*z
+                  + 4.328810604912902668951e2)*z + 4.853903996359136964868e2)*z + 1.945506571482613964425e2;
+
+    return y + ((xr*(z*p/q) + xr) + extra);
+}
+
+// >>>>> Distortion models
+// Coefficients in the OpenCV order: k1 k2 p1 p2 k3 k4 k5 k6 s1 s2 s3 s4 (FishEye: k1 k2 k3 k4)
+
+/// k1 k2 k3 p1 p2
+struct PolynomialModel
+{
+    double k1, k2, k3, p1, p2;
+
+    explicit PolynomialModel( const double* d ) : k1(d[0]), k2(d[1]), k3(d[4]), p1(d[2]), p2(d[3]) {}
+
+    void project( LaneVec x, LaneVec y, LaneVec& xd, LaneVec& yd ) const
+    {
+        LaneVec x2 = x*x;
+        LaneVec y2 = y*y;
+        LaneVec r2 = x2 + y2;
+        LaneVec xy2 = 2.0*x*y;
+
+        LaneVec kr = 1.0 + ((k3*r2 + k2)*r2 + k1)*r2;
+
+        xd = x*kr + p1*xy2 + p2*(r2 + 2.0*x2);
+        yd = y*kr + p1*(r2 + 2.0*y2) + p2*xy2;
+    }
+};
+
+/// k1 k2 k3 p1 p2 and the k4 k5 k6 denominator
+struct RationalModel
+{
+    double k1, k2, k3, k4, k5, k6, p1, p2;
+
+    explicit RationalModel( const double* d )
+        : k1(d[0]), k2(d[1]), k3(d[4]), k4(d[5]), k5(d[6]), k6(d[7]), p1(d[2]), p2(d[3]) {}
+
+    void project( LaneVec x, LaneVec y, LaneVec& xd, LaneVec& yd ) const
+    {
+        LaneVec x2 = x*x;
+        LaneVec y2 = y*y;
+        LaneVec r2 = x2 + y2;
+        LaneVec xy2 = 2.0*x*y;
+
+        LaneVec kr = (1.0 + ((k3*r2 + k2)*r2 + k1)*r2)/(1.0 + ((k6*r2 + k5)*r2 + k4)*r2);
+
+        xd = x*kr + p1*xy2 + p2*(r2 + 2.0*x2);
+        yd = y*kr + p1*(r2 + 2.0*y2) + p2*xy2;
+    }
+};
+
+/// Rational model plus s1 s2 s3 s4
+struct ThinPrismModel
+{
+    RationalModel rational;
+    double s1, s2, s3, s4;
+
+    explicit ThinPrismModel( const double* d ) : rational(d), s1(d[8]), s2(d[9]), s3(d[10]), s4(d[11]) {}
+
+    void project( LaneVec x, LaneVec y, LaneVec& xd, LaneVec& yd ) const
+    {
+        rational.project( x, y, xd, yd );
+
+        LaneVec r2 = x*x + y*y;
+
+        xd += s1*r2 + s2*r2*r2;
+        yd += s3*r2 + s4*r2*r2;
+    }
+};
+
+/// Equidistant FishEye: k1 k2 k3 k4 on theta
+struct FisheyeModel
+{
+    double k1, k2, k3, k4;
+
+    explicit FisheyeModel( const double* d ) : k1(d[0]), k2(d[1]), k3(d[2]), k4(d[3]) {}
+
+    void project( LaneVec x, LaneVec y, LaneVec& xd, LaneVec& yd ) const
+    {
+        LaneVec r = laneSqrt( x*x + y*y );
+        LaneVec theta = laneAtan( r );
+
+        LaneVec t2 = theta*theta;
+        LaneVec t4 = t2*t2;
+        LaneVec t6 = t4*t2;
+        LaneVec t8 = t4*t4;
+
+        LaneVec thetaD = theta*(1.0 + k1*t2 + k2*t4 + k3*t6 + k4*t8);
+        LaneVec scale = (r == 0.0) ? laneSet(1.0) : thetaD/r;
+
+        xd = x*scale;
+        yd = y*scale;
+    }
+};
+// <<<<< Distortion models
+
+/// Source pixel coordinates of the output pixels (px, py)
+template<class Model>
+inline void projectPixels( const Model& model, const double* k, const double* ir, LaneVec px, LaneVec py,
+                           LaneVec& u, LaneVec& v )
+{
+    LaneVec iw = 1.0/(ir[6]*px + ir[7]*py + ir[8]);
+    LaneVec x = (ir[0]*px + ir[1]*py + ir[2])*iw;
+    LaneVec y = (ir[3]*px + ir[4]*py + ir[5])*iw;
+
+    LaneVec xd, yd;
+    model.project( x, y, xd, yd );
+
+    u = k[0]*xd + k[2];
+    v = k[4]*yd + k[5];
+}
+
+/// Calibration parameters as plain doubles
+struct MapParams
+{
+    double k[9];
+    double ir[9];       ///< Inverse of newK*R: pixel to ray
+    double d[12];       ///< The missing coefficients are null
+    bool fishEye;
+};
+
+inline bool makeParams( const cv::Mat& K, const cv::Mat& D, const cv::Mat& R, const cv::Mat& newK, bool fishEye,
+                        MapParams& p )
+{
+    if( K.empty() || D.empty() || newK.empty() )
+        return false;
+
+    cv::Mat K64, D64, R64, newK64;
+    K.convertTo( K64, CV_64F );
+    D.reshape(1, static_cast<int>(D.total())).convertTo( D64, CV_64F );
+    newK.colRange(0,3).convertTo( newK64, CV_64F );
+
+    if( R.empty() )
+        R64 = cv::Mat::eye( 3, 3, CV_64F );
+    else
+        R.convertTo( R64, CV_64F );
+
+    cv::Mat iR = (newK64*R64).inv( fishEye ? cv::DECOMP_SVD : cv::DECOMP_LU );
+
+    for( int i=0; i<9; i++ )
+    {
+        p.k[i] = K64.ptr<double>(i/3)[i%3];
+        p.ir[i] = iR.ptr<double>(i/3)[i%3];
+    }
+
+    std::fill( p.d, p.d+12, 0.0 );
+    for( int i=0; i<D64.rows && i<(fishEye?4:12); i++ )
+    {
+        p.d[i] = D64.ptr<double>(i)[0];
+    }
+
+    p.fishEye = fishEye;
+
+    return true;
+}
+
+/// Scoped: CameraModel (qcameracalibrate.h) uses the Model prefix for its own values
+enum class ModelType
+{
+    Polynomial,
+    Rational,
+    ThinPrism,
+    Fisheye
+};
+
+inline ModelType modelType( const MapParams& p )
+{
+    if( p.fishEye )
+        return ModelType::Fisheye;
+
+    if( p.d[8]!=0.0 || p.d[9]!=0.0 || p.d[10]!=0.0 || p.d[11]!=0.0 )
+        return ModelType::ThinPrism;
+
+    if( p.d[5]!=0.0 || p.d[6]!=0.0 || p.d[7]!=0.0 )
+        return ModelType::Rational;
+
+    return ModelType::Polynomial;
+}
+
+#endif // DISTORTIONMODELS_H
@@ -0,0 +1,1093 @@
+#include "fastremap.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <cstdint>
+#include <vector>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define FASTREMAP_X86
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#define FASTREMAP_NEON
+#endif
+
+using namespace std;
+
+#define TAB_BITS 5                              // cv::INTER_BITS
+#define TAB_SIZE (1<<TAB_BITS)                  // cv::INTER_TAB_SIZE
+#define TAB_MASK (TAB_SIZE*TAB_SIZE-1)
+#define COEF_BITS (2*TAB_BITS)                  // The 4 weights of a pixel sum to 1<<COEF_BITS
+#define COEF_ROUND (1<<(COEF_BITS-1))
+
+// >>>>> Cache blocking
+#define TILE_W 64
+#define TILE_H 8
+// <<<<< Cache blocking
+
+// >>>>> Sparse grid
+#define GRID_FRAC_BITS 10                       // Extra fractional bits of the interpolated coordinates
+#define GRID_ROUND (1<<(GRID_FRAC_BITS-1))
+#define GRID_MAX_COORD 16384.0f                 // Clamp of the grid coordinates, far outside any frame
+// <<<<< Sparse grid
+
+namespace
+{
+
+/// Bilinear weights (w00, w01, w10, w11) of each sub-pixel position of the maps
+struct BilinearTab
+{
+    alignas(16) short w[TAB_SIZE*TAB_SIZE][4];
+
+    BilinearTab()
+    {
+        for( int fy=0; fy<TAB_SIZE; fy++ )
+        {
+            for( int fx=0; fx<TAB_SIZE; fx++ )
+            {
+                short* t = w[fy*TAB_SIZE+fx];
+
+                t[0] = static_cast<short>( (TAB_SIZE-fx)*(TAB_SIZE-fy) );
+                t[1] = static_cast<short>( fx*(TAB_SIZE-fy) );
+                t[2] = static_cast<short>( (TAB_SIZE-fx)*fy );
+                t[3] = static_cast<short>( fx*fy );
+            }
+        }
+    }
+};
+
+const BilinearTab sTab;
+
+std::atomic<int> sKernelsIdx( -1 );   ///< In allKernels(), -1 for the best one
+
+typedef void (*RemapRowFunc)( const uchar* src, size_t step, int w, int h,
+                              const short* xy, const ushort* fxy, uchar* dst, int n );
+
+/// Stores the CN channels of a pixel as DCN bytes. DCN is CN, or 4 for the display buffers:
+/// B G R and an opaque alpha, the bytes of QImage::Format_RGB32 (gray is replicated)
+template<int CN, int DCN>
+inline void storePixel( const uchar* v, uchar* d )
+{
+    if( DCN==CN )
+    {
+        for( int c=0; c<CN; c++ )
+        {
+            d[c] = v[c];
+        }
+        return;
+    }
+
+    d[0] = v[0];
+    d[1] = v[CN>1 ? 1 : 0];
+    d[2] = v[CN>2 ? 2 : 0];
+    d[3] = 255;
+}
+
+/// Same as storePixel for the channels packed by the SIMD kernels, the unused bytes are ignored
+template<int CN, int DCN>
+inline void storePacked( uint32_t res, uchar* d )
+{
+    if( DCN>CN )
+        res |= 0xFF000000u;
+
+    memcpy( d, &res, DCN );
+}
+
+/// Reference pixel, also used for the pixels near the border by the SIMD kernels
+template<int CN, int DCN=CN>
+inline void remapPixel( const uchar* src, size_t step, int w, int h, int sx, int sy, ushort fxy, uchar* d )
+{
+    const short* wt = sTab.w[fxy & TAB_MASK];
+    uchar v[CN];
+
+    if( (unsigned)sx < (unsigned)(w-1) && (unsigned)sy < (unsigned)(h-1) )
+    {
+        const uchar* s0 = src + sy*step + sx*CN;
+        const uchar* s1 = s0 + step;
+
+        for( int c=0; c<CN; c++ )
+        {
+            v[c] = static_cast<uchar>( (s0[c]*wt[0] + s0[c+CN]*wt[1] + s1[c]*wt[2] + s1[c+CN]*wt[3]
+                                        + COEF_ROUND) >> COEF_BITS );
+        }
+        storePixel<CN,DCN>( v, d );
+        return;
+    }
+
+    if( sx >= w || sx+1 < 0 || sy >= h || sy+1 < 0 )
+    {
+        for( int c=0; c<CN; c++ )
+        {
+            v[c] = 0;
+        }
+        storePixel<CN,DCN>( v, d );
+        return;
+    }
+
+    // >>>>> Partially outside: the missing neighbours are black
+    bool x0In = sx >= 0;
+    bool x1In = sx+1 < w;
+    bool y0In = sy >= 0;
+    bool y1In = sy+1 < h;
+
+    const uchar* s0 = src + sy*step + sx*CN;
+    const uchar* s1 = s0 + step;
+
+    for( int c=0; c<CN; c++ )
+    {
+        int v00 = (y0In && x0In) ? s0[c] : 0;
+        int v01 = (y0In && x1In) ? s0[c+CN] : 0;
+        int v10 = (y1In && x0In) ? s1[c] : 0;
+        int v11 = (y1In && x1In) ? s1[c+CN] : 0;
+
+        v[c] = static_cast<uchar>( (v00*wt[0] + v01*wt[1] + v10*wt[2] + v11*wt[3] + COEF_ROUND) >> COEF_BITS );
+    }
+    storePixel<CN,DCN>( v, d );
+    // <<<<< Partially outside: the missing neighbours are black
+}
+
+template<int CN, int DCN=CN>
+void remapRowScalar( const uchar* src, size_t step, int w, int h,
+                     const short* xy, const ushort* fxy, uchar* dst, int n )
+{
+    for( int x=0; x<n; x++ )
+    {
+        remapPixel<CN,DCN>( src, step, w, h, xy[2*x], xy[2*x+1], fxy[x], dst+x*DCN );
+    }
+}
+
+/// Nearest neighbour: the fraction of the maps rounds to the closest source pixel, black outside
+/// the image. One load per pixel, the same code on every CPU
+template<int CN, int DCN=CN>
+void remapRowNearest( const uchar* src, size_t step, int w, int h,
+                      const short* xy, const ushort* fxy, uchar* dst, int n )
+{
+    const uchar black[CN] = {};
+
+    for( int x=0; x<n; x++ )
+    {
+        int sx = xy[2*x] + ((fxy[x] & (TAB_SIZE-1)) >= TAB_SIZE/2);
+        int sy = xy[2*x+1] + (((fxy[x] >> TAB_BITS) & (TAB_SIZE-1)) >= TAB_SIZE/2);
+
+        if( (unsigned)sx >= (unsigned)w || (unsigned)sy >= (unsigned)h )
+        {
+            storePixel<CN,DCN>( black, dst+x*DCN );
+            continue;
+        }
+
+        const uchar* s = src + sy*step + sx*CN;
+
+        // One 4 byte load and store when the load stays in the row
+        if( DCN==4 && CN>1 && (CN==4 || sx < w-1) )
+        {
+            uint32_t v;
+            memcpy( &v, s, 4 );
+            storePacked<CN,DCN>( v, dst+x*DCN );
+        }
+        else
+        {
+            storePixel<CN,DCN>( s, dst+x*DCN );
+        }
+    }
+}
+
+/// True if the 8 bytes loaded from the top-left neighbour, and from the one below it, stay in the image
+template<int CN>
+inline bool simdInside( int sx, int sy, int w, int h )
+{
+    return (unsigned)sx < (unsigned)(w-1) && (unsigned)sy < (unsigned)(h-1) && (CN==4 || sx < w-2);
+}
+
+#ifdef FASTREMAP_X86
+// >>>>> SSE4.1
+
+__attribute__((target("sse4.1")))
+void remapRowC1_SSE41( const uchar* src, size_t step, int w, int h,
+                       const short* xy, const ushort* fxy, uchar* dst, int n )
+{
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i round = _mm_set1_epi32( COEF_ROUND );
+
+    int x = 0;
+    for( ; x<=n-4; x+=4 )
+    {
+        // >>>>> Gather: p00 p01 p10 p11 of 4 pixels
+        uint32_t px[4];
+        bool inside = true;
+
+        for( int k=0; k<4 && inside; k++ )
+        {
+            int sx = xy[2*(x+k)];
+            int sy = xy[2*(x+k)+1];
+
+            inside = simdInside<4>( sx, sy, w, h );
+
+            if( inside )
+            {
+                const uchar* s0 = src + sy*step + sx;
+                px[k] = s0[0] | (s0[1]<<8) | (s0[step]<<16) | (static_cast<uint32_t>(s0[step+1])<<24);
+            }
+        }
+
+        if( !inside )
+        {
+            remapRowScalar<1>( src, step, w, h, xy+2*x, fxy+x, dst+x, 4 );
+            continue;
+        }
+        // <<<<< Gather: p00 p01 p10 p11 of 4 pixels
+
+        __m128i p = _mm_setr_epi32( px[0], px[1], px[2], px[3] );
+        __m128i p01 = _mm_unpacklo_epi8( p, zero );
+        __m128i p23 = _mm_unpackhi_epi8( p, zero );
+
+        __m128i w01 = _mm_unpacklo_epi64( _mm_loadl_epi64( reinterpret_cast<const __m128i*>(sTab.w[fxy[x] & TAB_MASK]) ),
+                                          _mm_loadl_epi64( reinterpret_cast<const __m128i*>(sTab.w[fxy[x+1] & TAB_MASK]) ) );
+        __m128i w23 = _mm_unpacklo_epi64( _mm_loadl_epi64( reinterpret_cast<const __m128i*>(sTab.w[fxy[x+2] & TAB_MASK]) ),
+                                          _mm_loadl_epi64( reinterpret_cast<const __m128i*>(sTab.w[fxy[x+3] & TAB_MASK]) ) );
+
+        // Top and bottom row of each pixel, then the 4 sums
+        __m128i s = _mm_hadd_epi32( _mm_madd_epi16( p01, w01 ), _mm_madd_epi16( p23, w23 ) );
+        s = _mm_srai_epi32( _mm_add_epi32( s, round ), COEF_BITS );
+        s = _mm_packus_epi16( _mm_packs_epi32( s, s ), zero );
+
+        uint32_t res = static_cast<uint32_t>( _mm_cvtsi128_si32( s ) );
+        memcpy( dst+x, &res, 4 );
+    }
+
+    remapRowScalar<1>( src, step, w, h, xy+2*x, fxy+x, dst+x, n-x );
+}
+
+template<int CN, int DCN=CN>
+__attribute__((target("sse4.1")))
+void remapRowCn_SSE41( const uchar* src, size_t step, int w, int h,
+                       const short* xy, const ushort* fxy, uchar* dst, int n )
+{
+    const __m128i round = _mm_set1_epi32( COEF_ROUND );
+
+    // Interleaves the channels of the two neighbours: a0 b0 a1 b1 ...
+    const __m128i shuf = (CN==4) ? _mm_setr_epi8( 0,4,1,5,2,6,3,7, -1,-1,-1,-1,-1,-1,-1,-1 )
+                                 : _mm_setr_epi8( 0,3,1,4,2,5,-1,-1, -1,-1,-1,-1,-1,-1,-1,-1 );
+
+    for( int x=0; x<n; x++ )
+    {
+        int sx = xy[2*x];
+        int sy = xy[2*x+1];
+
+        if( !simdInside<CN>( sx, sy, w, h ) )
+        {
+            remapPixel<CN,DCN>( src, step, w, h, sx, sy, fxy[x], dst+x*DCN );
+            continue;
+        }
+
+        const uchar* s0 = src + sy*step + sx*CN;
+        const short* wt = sTab.w[fxy[x] & TAB_MASK];
+
+        __m128i top = _mm_cvtepu8_epi16( _mm_shuffle_epi8( _mm_loadl_epi64( reinterpret_cast<const __m128i*>(s0) ), shuf ) );
+        __m128i bot = _mm_cvtepu8_epi16( _mm_shuffle_epi8( _mm_loadl_epi64( reinterpret_cast<const __m128i*>(s0+step) ), shuf ) );
+
+        __m128i wTop = _mm_set1_epi32( static_cast<ushort>(wt[0]) | (static_cast<uint32_t>(wt[1])<<16) );
+        __m128i wBot = _mm_set1_epi32( static_cast<ushort>(wt[2]) | (static_cast<uint32_t>(wt[3])<<16) );
+
+        __m128i s = _mm_add_epi32( _mm_madd_epi16( top, wTop ), _mm_madd_epi16( bot, wBot ) );
+        s = _mm_srai_epi32( _mm_add_epi32( s, round ), COEF_BITS );
+        s = _mm_packus_epi16( _mm_packs_epi32( s, s ), s );
+
+        storePacked<CN,DCN>( static_cast<uint32_t>( _mm_cvtsi128_si32( s ) ), dst+x*DCN );
+    }
+}
+// <<<<< SSE4.1
+
+// >>>>> AVX2
+
+__attribute__((target("avx2")))
+void remapRowC1_AVX2( const uchar* src, size_t step, int w, int h,
+                      const short* xy, const ushort* fxy, uchar* dst, int n )
+{
+    // The gathers read 4 bytes from the top-left neighbour and from the one below it
+    if( w<4 || h<2 )
+    {
+        remapRowScalar<1>( src, step, w, h, xy, fxy, dst, n );
+        return;
+    }
+
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i round = _mm256_set1_epi32( COEF_ROUND );
+    const __m256i lowByte = _mm256_set1_epi32( 0xFF );
+    const __m256i secondByte = _mm256_set1_epi32( 0xFF00 );
+    const __m256i fracMask = _mm256_set1_epi32( TAB_SIZE-1 );
+    const __m256i one = _mm256_set1_epi32( TAB_SIZE );
+    const __m256i maxX = _mm256_set1_epi32( w-4 );
+    const __m256i maxY = _mm256_set1_epi32( h-2 );
+    const __m256i stepV = _mm256_set1_epi32( static_cast<int>(step) );
+
+    const int* src0 = reinterpret_cast<const int*>( src );
+    const int* src1 = reinterpret_cast<const int*>( src+step );
+
+    int x = 0;
+    for( ; x<=n-8; x+=8 )
+    {
+        // >>>>> Coordinates, all the 8 pixels must be inside
+        __m256i sxy = _mm256_loadu_si256( reinterpret_cast<const __m256i*>(xy+2*x) );
+        __m256i sx = _mm256_srai_epi32( _mm256_slli_epi32( sxy, 16 ), 16 );
+        __m256i sy = _mm256_srai_epi32( sxy, 16 );
+
+        // Unsigned compare: negative coordinates are out too
+        __m256i in = _mm256_and_si256( _mm256_cmpeq_epi32( _mm256_min_epu32( sx, maxX ), sx ),
+                                       _mm256_cmpeq_epi32( _mm256_min_epu32( sy, maxY ), sy ) );
+
+        if( _mm256_movemask_epi8( in )!=-1 )
+        {
+            remapRowScalar<1>( src, step, w, h, xy+2*x, fxy+x, dst+x, 8 );
+            continue;
+        }
+        // <<<<< Coordinates, all the 8 pixels must be inside
+
+        // >>>>> Gather: p00 p01 and p10 p11 as 16 bit pairs
+        __m256i ofs = _mm256_add_epi32( _mm256_mullo_epi32( sy, stepV ), sx );
+
+        __m256i g0 = _mm256_i32gather_epi32( src0, ofs, 1 );
+        __m256i g1 = _mm256_i32gather_epi32( src1, ofs, 1 );
+
+        __m256i top = _mm256_or_si256( _mm256_and_si256( g0, lowByte ),
+                                       _mm256_slli_epi32( _mm256_and_si256( g0, secondByte ), 8 ) );
+        __m256i bot = _mm256_or_si256( _mm256_and_si256( g1, lowByte ),
+                                       _mm256_slli_epi32( _mm256_and_si256( g1, secondByte ), 8 ) );
+        // <<<<< Gather: p00 p01 and p10 p11 as 16 bit pairs
+
+        // >>>>> Separable weights: horizontal, then vertical
+        __m256i f = _mm256_cvtepu16_epi32( _mm_loadu_si128( reinterpret_cast<const __m128i*>(fxy+x) ) );
+        __m256i fx = _mm256_and_si256( f, fracMask );
+        __m256i fy = _mm256_and_si256( _mm256_srli_epi32( f, TAB_BITS ), fracMask );
+
+        __m256i wx = _mm256_or_si256( _mm256_sub_epi32( one, fx ), _mm256_slli_epi32( fx, 16 ) );
+        __m256i wy = _mm256_or_si256( _mm256_sub_epi32( one, fy ), _mm256_slli_epi32( fy, 16 ) );
+
+        __m256i rows = _mm256_or_si256( _mm256_madd_epi16( top, wx ),
+                                        _mm256_slli_epi32( _mm256_madd_epi16( bot, wx ), 16 ) );
+        __m256i s = _mm256_madd_epi16( rows, wy );
+        // <<<<< Separable weights: horizontal, then vertical
+
+        s = _mm256_srai_epi32( _mm256_add_epi32( s, round ), COEF_BITS );
+        s = _mm256_packus_epi16( _mm256_packs_epi32( s, s ), zero );
+
+        uint32_t res[2];
+        res[0] = static_cast<uint32_t>( _mm_cvtsi128_si32( _mm256_castsi256_si128( s ) ) );
+        res[1] = static_cast<uint32_t>( _mm_cvtsi128_si32( _mm256_extracti128_si256( s, 1 ) ) );
+        memcpy( dst+x, res, 8 );
+    }
+
+    remapRowScalar<1>( src, step, w, h, xy+2*x, fxy+x, dst+x, n-x );
+}
+
+template<int CN, int DCN=CN>
+__attribute__((target("avx2")))
+void remapRowCn_AVX2( const uchar* src, size_t step, int w, int h,
+                      const short* xy, const ushort* fxy, uchar* dst, int n )
+{
+    const __m256i round = _mm256_set1_epi32( COEF_ROUND );
+
+    // Interleaves the channels of the two neighbours of both pixels: a0 b0 a1 b1 ...
+    const __m128i shuf = (CN==4) ? _mm_setr_epi8( 0,4,1,5,2,6,3,7, 8,12,9,13,10,14,11,15 )
+                                 : _mm_setr_epi8( 0,3,1,4,2,5,-1,-1, 8,11,9,12,10,13,-1,-1 );
+
+    int x = 0;
+    for( ; x<=n-2; x+=2 )
+    {
+        int sx0 = xy[2*x];
+        int sy0 = xy[2*x+1];
+        int sx1 = xy[2*x+2];
+        int sy1 = xy[2*x+3];
+
+        if( !simdInside<CN>( sx0, sy0, w, h ) || !simdInside<CN>( sx1, sy1, w, h ) )
+        {
+            remapRowScalar<CN,DCN>( src, step, w, h, xy+2*x, fxy+x, dst+x*DCN, 2 );
+            continue;
+        }
+
+        const uchar* sa = src + sy0*step + sx0*CN;
+        const uchar* sb = src + sy1*step + sx1*CN;
+
+        // >>>>> Lane 0 first pixel, lane 1 second pixel
+        __m128i top = _mm_unpacklo_epi64( _mm_loadl_epi64( reinterpret_cast<const __m128i*>(sa) ),
+                                          _mm_loadl_epi64( reinterpret_cast<const __m128i*>(sb) ) );
+        __m128i bot = _mm_unpacklo_epi64( _mm_loadl_epi64( reinterpret_cast<const __m128i*>(sa+step) ),
+                                          _mm_loadl_epi64( reinterpret_cast<const __m128i*>(sb+step) ) );
+
+        __m256i top16 = _mm256_cvtepu8_epi16( _mm_shuffle_epi8( top, shuf ) );
+        __m256i bot16 = _mm256_cvtepu8_epi16( _mm_shuffle_epi8( bot, shuf ) );
+
+        const short* wa = sTab.w[fxy[x] & TAB_MASK];
+        const short* wb = sTab.w[fxy[x+1] & TAB_MASK];
+
+        int wTopA = static_cast<ushort>(wa[0]) | (wa[1]<<16);
+        int wBotA = static_cast<ushort>(wa[2]) | (wa[3]<<16);
+        int wTopB = static_cast<ushort>(wb[0]) | (wb[1]<<16);
+        int wBotB = static_cast<ushort>(wb[2]) | (wb[3]<<16);
+
+        __m256i wTop = _mm256_setr_epi32( wTopA, wTopA, wTopA, wTopA, wTopB, wTopB, wTopB, wTopB );
+        __m256i wBot = _mm256_setr_epi32( wBotA, wBotA, wBotA, wBotA, wBotB, wBotB, wBotB, wBotB );
+        // <<<<< Lane 0 first pixel, lane 1 second pixel
+
+        __m256i s = _mm256_add_epi32( _mm256_madd_epi16( top16, wTop ), _mm256_madd_epi16( bot16, wBot ) );
+        s = _mm256_srai_epi32( _mm256_add_epi32( s, round ), COEF_BITS );
+        s = _mm256_packus_epi16( _mm256_packs_epi32( s, s ), s );
+
+        storePacked<CN,DCN>( static_cast<uint32_t>( _mm_cvtsi128_si32( _mm256_castsi256_si128( s ) ) ), dst+x*DCN );
+        storePacked<CN,DCN>( static_cast<uint32_t>( _mm_cvtsi128_si32( _mm256_extracti128_si256( s, 1 ) ) ),
+                             dst+(x+1)*DCN );
+    }
+
+    remapRowScalar<CN,DCN>( src, step, w, h, xy+2*x, fxy+x, dst+x*DCN, n-x );
+}
+// <<<<< AVX2
+#endif // FASTREMAP_X86
+
+#ifdef FASTREMAP_NEON
+// >>>>> NEON
+
+void remapRowC1_NEON( const uchar* src, size_t step, int w, int h,
+                      const short* xy, const ushort* fxy, uchar* dst, int n )
+{
+    int x = 0;
+    for( ; x<=n-4; x+=4 )
+    {
+        // >>>>> Gather: neighbours and weights of 4 pixels, one vector each
+        uint16_t p[4][4];
+        uint16_t wt[4][4];
+        bool inside = true;
+
+        for( int k=0; k<4 && inside; k++ )
+        {
+            int sx = xy[2*(x+k)];
+            int sy = xy[2*(x+k)+1];
+
+            inside = simdInside<4>( sx, sy, w, h );
+
+            if( inside )
+            {
+                const uchar* s0 = src + sy*step + sx;
+                const short* t = sTab.w[fxy[x+k] & TAB_MASK];
+
+                p[0][k] = s0[0];
+                p[1][k] = s0[1];
+                p[2][k] = s0[step];
+                p[3][k] = s0[step+1];
+
+                for( int i=0; i<4; i++ )
+                {
+                    wt[i][k] = static_cast<uint16_t>(t[i]);
+                }
+            }
+        }
+
+        if( !inside )
+        {
+            remapRowScalar<1>( src, step, w, h, xy+2*x, fxy+x, dst+x, 4 );
+            continue;
+        }
+        // <<<<< Gather: neighbours and weights of 4 pixels, one vector each
+
+        uint32x4_t acc = vmull_u16( vld1_u16(p[0]), vld1_u16(wt[0]) );
+        acc = vmlal_u16( acc, vld1_u16(p[1]), vld1_u16(wt[1]) );
+        acc = vmlal_u16( acc, vld1_u16(p[2]), vld1_u16(wt[2]) );
+        acc = vmlal_u16( acc, vld1_u16(p[3]), vld1_u16(wt[3]) );
+
+        uint16x4_t res16 = vrshrn_n_u32( acc, COEF_BITS );
+        uint8x8_t res = vqmovn_u16( vcombine_u16( res16, res16 ) );
+
+        vst1_lane_u32( reinterpret_cast<uint32_t*>(dst+x), vreinterpret_u32_u8(res), 0 );
+    }
+
+    remapRowScalar<1>( src, step, w, h, xy+2*x, fxy+x, dst+x, n-x );
+}
+
+template<int CN, int DCN=CN>
+void remapRowCn_NEON( const uchar* src, size_t step, int w, int h,
+                      const short* xy, const ushort* fxy, uchar* dst, int n )
+{
+    for( int x=0; x<n; x++ )
+    {
+        int sx = xy[2*x];
+        int sy = xy[2*x+1];
+
+        if( !simdInside<CN>( sx, sy, w, h ) )
+        {
+            remapPixel<CN,DCN>( src, step, w, h, sx, sy, fxy[x], dst+x*DCN );
+            continue;
+        }
+
+        const uchar* s0 = src + sy*step + sx*CN;
+        const short* wt = sTab.w[fxy[x] & TAB_MASK];
+
+        uint8x8_t top = vld1_u8( s0 );
+        uint8x8_t bot = vld1_u8( s0+step );
+
+        // Channels of the left neighbour in the low lanes, then of the right one
+        uint16x4_t p00 = vget_low_u16( vmovl_u8( top ) );
+        uint16x4_t p01 = vget_low_u16( vmovl_u8( vext_u8( top, top, CN ) ) );
+        uint16x4_t p10 = vget_low_u16( vmovl_u8( bot ) );
+        uint16x4_t p11 = vget_low_u16( vmovl_u8( vext_u8( bot, bot, CN ) ) );
+
+        uint32x4_t acc = vmull_n_u16( p00, static_cast<uint16_t>(wt[0]) );
+        acc = vmlal_n_u16( acc, p01, static_cast<uint16_t>(wt[1]) );
+        acc = vmlal_n_u16( acc, p10, static_cast<uint16_t>(wt[2]) );
+        acc = vmlal_n_u16( acc, p11, static_cast<uint16_t>(wt[3]) );
+
+        uint16x4_t res16 = vrshrn_n_u32( acc, COEF_BITS );
+        uint8x8_t res = vqmovn_u16( vcombine_u16( res16, res16 ) );
+
+        storePacked<CN,DCN>( vget_lane_u32( vreinterpret_u32_u8( res ), 0 ), dst+x*DCN );
+    }
+}
+// <<<<< NEON
+#endif // FASTREMAP_NEON
+
+/// Gray to display buffer: the gray kernel writes the row in L1, then it is replicated to B G R
+template<RemapRowFunc ROW>
+void remapRowGrayDisplay( const uchar* src, size_t step, int w, int h,
+                          const short* xy, const ushort* fxy, uchar* dst, int n )
+{
+    uchar gray[TILE_W];
+
+    for( int x=0; x<n; x+=TILE_W )
+    {
+        int m = min( TILE_W, n-x );
+
+        ROW( src, step, w, h, xy+2*x, fxy+x, gray, m );
+
+        for( int k=0; k<m; k++ )
+        {
+            uint32_t res = gray[k]*0x010101u | 0xFF000000u;
+            memcpy( dst+4*(x+k), &res, 4 );
+        }
+    }
+}
+
+/// 4 channels to display buffer: Format_RGB32 needs an opaque alpha, the one of the source is
+/// overwritten in the row just written
+template<RemapRowFunc ROW>
+void remapRowOpaqueDisplay( const uchar* src, size_t step, int w, int h,
+                            const short* xy, const ushort* fxy, uchar* dst, int n )
+{
+    ROW( src, step, w, h, xy, fxy, dst, n );
+
+    for( int x=0; x<n; x++ )
+    {
+        dst[4*x+3] = 255;
+    }
+}
+
+/// Row kernels by number of channels of the source
+struct RemapKernels
+{
+    RemapRowFunc row[5];
+    RemapRowFunc display[5];    ///< Output in the display format, 4 bytes per pixel
+    RemapRowFunc nearest[5];
+    RemapRowFunc nearestDisplay[5];
+    const char* isa;
+
+    RemapRowFunc select( int cn, bool toDisplay, bool toNearest ) const
+    {
+        if( toNearest )
+            return toDisplay ? nearestDisplay[cn] : nearest[cn];
+
+        return toDisplay ? display[cn] : row[cn];
+    }
+};
+
+RemapKernels scalarKernels()
+{
+    RemapKernels k;
+    k.row[0] = NULL;
+    k.row[1] = remapRowScalar<1>;
+    k.row[2] = NULL;
+    k.row[3] = remapRowScalar<3>;
+    k.row[4] = remapRowScalar<4>;
+
+    k.display[0] = NULL;
+    k.display[1] = remapRowGrayDisplay< remapRowScalar<1> >;
+    k.display[2] = NULL;
+    k.display[3] = remapRowScalar<3,4>;
+    k.display[4] = remapRowOpaqueDisplay< remapRowScalar<4> >;
+
+    k.nearest[0] = NULL;
+    k.nearest[1] = remapRowNearest<1>;
+    k.nearest[2] = NULL;
+    k.nearest[3] = remapRowNearest<3>;
+    k.nearest[4] = remapRowNearest<4>;
+
+    k.nearestDisplay[0] = NULL;
+    k.nearestDisplay[1] = remapRowNearest<1,4>;
+    k.nearestDisplay[2] = NULL;
+    k.nearestDisplay[3] = remapRowNearest<3,4>;
+    k.nearestDisplay[4] = remapRowOpaqueDisplay< remapRowNearest<4> >;
+
+    k.isa = "Scalar";
+
+    return k;
+}
+
+#ifdef FASTREMAP_X86
+RemapKernels sse41Kernels()
+{
+    RemapKernels k = scalarKernels();
+    k.row[1] = remapRowC1_SSE41;
+    k.row[3] = remapRowCn_SSE41<3>;
+    k.row[4] = remapRowCn_SSE41<4>;
+    k.display[1] = remapRowGrayDisplay<remapRowC1_SSE41>;
+    k.display[3] = remapRowCn_SSE41<3,4>;
+    k.display[4] = remapRowOpaqueDisplay< remapRowCn_SSE41<4> >;
+    k.isa = "SSE4.1";
+
+    return k;
+}
+
+RemapKernels avx2Kernels()
+{
+    RemapKernels k = scalarKernels();
+    k.row[1] = remapRowC1_AVX2;
+    k.row[3] = remapRowCn_AVX2<3>;
+    k.row[4] = remapRowCn_AVX2<4>;
+    k.display[1] = remapRowGrayDisplay<remapRowC1_AVX2>;
+    k.display[3] = remapRowCn_AVX2<3,4>;
+    k.display[4] = remapRowOpaqueDisplay< remapRowCn_AVX2<4> >;
+    k.isa = "AVX2";
+
+    return k;
+}
+#endif // FASTREMAP_X86
+
+#ifdef FASTREMAP_NEON
+RemapKernels neonKernels()
+{
+    RemapKernels k = scalarKernels();
+    k.row[1] = remapRowC1_NEON;
+    k.row[3] = remapRowCn_NEON<3>;
+    k.row[4] = remapRowCn_NEON<4>;
+    k.display[1] = remapRowGrayDisplay<remapRowC1_NEON>;
+    k.display[3] = remapRowCn_NEON<3,4>;
+    k.display[4] = remapRowOpaqueDisplay< remapRowCn_NEON<4> >;
+    k.isa = "NEON";
+
+    return k;
+}
+#endif // FASTREMAP_NEON
+
+/// Kernels the CPU runs, scalar first and the best last
+vector<RemapKernels> supportedKernels()
+{
+    vector<RemapKernels> res;
+    res.push_back( scalarKernels() );
+
+#ifdef FASTREMAP_X86
+    __builtin_cpu_init();
+
+    if( __builtin_cpu_supports("sse4.1") )
+        res.push_back( sse41Kernels() );
+    if( __builtin_cpu_supports("avx2") )
+        res.push_back( avx2Kernels() );
+#elif defined(FASTREMAP_NEON)
+    res.push_back( neonKernels() );
+#endif
+
+    return res;
+}
+
+const vector<RemapKernels>& allKernels()
+{
+    static const vector<RemapKernels> sKernels = supportedKernels();
+
+    return sKernels;
+}
+
+const RemapKernels& kernels()
+{
+    const vector<RemapKernels>& all = allKernels();
+    int idx = sKernelsIdx;
+
+    return (idx>=0 && idx<static_cast<int>(all.size())) ? all[idx] : all.back();
+}
+
+/// Stripe of rows, processed in TILE_W x TILE_H tiles
+class FastRemapBody : public cv::ParallelLoopBody
+{
+public:
+    FastRemapBody( const cv::Mat& src, cv::Mat& dst, const cv::Mat& map1, const cv::Mat& map2, RemapRowFunc func )
+        : mSrc(src), mDst(dst), mMap1(map1), mMap2(map2), mFunc(func)
+    {
+    }
+
+    void operator()( const cv::Range& range ) const override
+    {
+        size_t esz = mDst.elemSize();
+
+        for( int y0=range.start; y0<range.end; y0+=TILE_H )
+        {
+            int y1 = min( y0+TILE_H, range.end );
+
+            for( int x0=0; x0<mDst.cols; x0+=TILE_W )
+            {
+                int n = min( TILE_W, mDst.cols-x0 );
+
+                for( int y=y0; y<y1; y++ )
+                {
+                    mFunc( mSrc.data, mSrc.step, mSrc.cols, mSrc.rows,
+                           mMap1.ptr<short>(y) + 2*x0, mMap2.ptr<ushort>(y) + x0,
+                           mDst.ptr<uchar>(y) + x0*esz, n );
+                }
+            }
+        }
+    }
+
+private:
+    const cv::Mat& mSrc;
+    cv::Mat& mDst;
+    const cv::Mat& mMap1;
+    const cv::Mat& mMap2;
+    RemapRowFunc mFunc;
+};
+
+int gridShift( int gridStep )
+{
+    int shift = 0;
+    while( (1<<shift) < gridStep )
+    {
+        shift++;
+    }
+
+    return shift;
+}
+
+bool validGrid( const cv::Mat& grid, int gridStep, cv::Size dstSize )
+{
+    if( gridStep<1 || (gridStep & (gridStep-1))!=0 || grid.type()!=CV_32FC2 )
+        return false;
+
+    return grid.cols >= (dstSize.width-1)/gridStep + 2 && grid.rows >= (dstSize.height-1)/gridStep + 2;
+}
+
+/// Maps of the n pixels from (x0, y), at most TILE_W, interpolated from the grid in fixed point
+void expandGridRow( const cv::Mat& grid, int shift, int y, int x0, int n, short* xy, ushort* fxy )
+{
+    const int gy = y >> shift;
+    const float ty = static_cast<float>( y - (gy<<shift) )/(1<<shift);
+    const float scale = static_cast<float>( TAB_SIZE << GRID_FRAC_BITS );
+
+    const float* g0 = grid.ptr<float>(gy);
+    const float* g1 = grid.ptr<float>(gy+1);
+
+    // >>>>> Grid columns of the segment, interpolated on y
+    int gx0 = x0 >> shift;
+    int gx1 = ((x0+n-1) >> shift) + 1;
+
+    int nodeU[TILE_W+2];
+    int nodeV[TILE_W+2];
+
+    for( int i=gx0; i<=gx1; i++ )
+    {
+        float u = g0[2*i] + (g1[2*i]-g0[2*i])*ty;
+        float v = g0[2*i+1] + (g1[2*i+1]-g0[2*i+1])*ty;
+
+        nodeU[i-gx0] = cvRound( min( max( u, -GRID_MAX_COORD ), GRID_MAX_COORD )*scale );
+        nodeV[i-gx0] = cvRound( min( max( v, -GRID_MAX_COORD ), GRID_MAX_COORD )*scale );
+    }
+    // <<<<< Grid columns of the segment, interpolated on y
+
+    // >>>>> Cells of the segment, interpolated on x by increments
+    for( int k=0, i=gx0; k<n; i++ )
+    {
+        int du = (nodeU[i-gx0+1] - nodeU[i-gx0]) >> shift;
+        int dv = (nodeV[i-gx0+1] - nodeV[i-gx0]) >> shift;
+
+        int t = x0 + k - (i<<shift);
+        int u = nodeU[i-gx0] + du*t;
+        int v = nodeV[i-gx0] + dv*t;
+
+        int end = min( n, ((i+1)<<shift) - x0 );
+
+#ifdef __SSE2__
+        // >>>>> 4 pixels at a time
+        if( k+4<=end )
+        {
+            const __m128i round = _mm_set1_epi32( GRID_ROUND );
+            const __m128i mask = _mm_set1_epi32( TAB_SIZE-1 );
+            const __m128i du4 = _mm_set1_epi32( 4*du );
+            const __m128i dv4 = _mm_set1_epi32( 4*dv );
+
+            __m128i vu = _mm_setr_epi32( u, u+du, u+2*du, u+3*du );
+            __m128i vv = _mm_setr_epi32( v, v+dv, v+2*dv, v+3*dv );
+
+            for( ; k+4<=end; k+=4 )
+            {
+                __m128i iu = _mm_srai_epi32( _mm_add_epi32( vu, round ), GRID_FRAC_BITS );
+                __m128i iv = _mm_srai_epi32( _mm_add_epi32( vv, round ), GRID_FRAC_BITS );
+
+                __m128i sx = _mm_srai_epi32( iu, TAB_BITS );
+                __m128i sy = _mm_srai_epi32( iv, TAB_BITS );
+                __m128i f = _mm_or_si128( _mm_slli_epi32( _mm_and_si128( iv, mask ), TAB_BITS ),
+                                          _mm_and_si128( iu, mask ) );
+
+                _mm_storeu_si128( reinterpret_cast<__m128i*>(xy+2*k),
+                                  _mm_packs_epi32( _mm_unpacklo_epi32( sx, sy ), _mm_unpackhi_epi32( sx, sy ) ) );
+                _mm_storel_epi64( reinterpret_cast<__m128i*>(fxy+k), _mm_packs_epi32( f, f ) );
+
+                vu = _mm_add_epi32( vu, du4 );
+                vv = _mm_add_epi32( vv, dv4 );
+            }
+
+            u = _mm_cvtsi128_si32( vu );
+            v = _mm_cvtsi128_si32( vv );
+        }
+        // <<<<< 4 pixels at a time
+#endif
+
+        for( ; k<end; k++, u+=du, v+=dv )
+        {
+            int iu = (u + GRID_ROUND) >> GRID_FRAC_BITS;
+            int iv = (v + GRID_ROUND) >> GRID_FRAC_BITS;
+
+            xy[2*k] = static_cast<short>( iu >> TAB_BITS );
+            xy[2*k+1] = static_cast<short>( iv >> TAB_BITS );
+            fxy[k] = static_cast<ushort>( (iv & (TAB_SIZE-1))*TAB_SIZE + (iu & (TAB_SIZE-1)) );
+        }
+    }
+    // <<<<< Cells of the segment, interpolated on x by increments
+}
+
+/// FastRemapBody with the maps of every tile row expanded from the grid into L1
+class FastRemapGridBody : public cv::ParallelLoopBody
+{
+public:
+    FastRemapGridBody( const cv::Mat& src, cv::Mat& dst, const cv::Mat& grid, int gridStep, RemapRowFunc func )
+        : mSrc(src), mDst(dst), mGrid(grid), mShift(gridShift(gridStep)), mFunc(func)
+    {
+    }
+
+    void operator()( const cv::Range& range ) const override
+    {
+        size_t esz = mDst.elemSize();
+
+        // Whole tile expanded before remapping it: the kernels do not load the maps right after
+        // they are stored with different widths (store forwarding stalls)
+        alignas(32) short xy[TILE_H][2*TILE_W];
+        alignas(32) ushort fxy[TILE_H][TILE_W];
+
+        for( int y0=range.start; y0<range.end; y0+=TILE_H )
+        {
+            int y1 = min( y0+TILE_H, range.end );
+
+            for( int x0=0; x0<mDst.cols; x0+=TILE_W )
+            {
+                int n = min( TILE_W, mDst.cols-x0 );
+
+                for( int y=y0; y<y1; y++ )
+                {
+                    expandGridRow( mGrid, mShift, y, x0, n, xy[y-y0], fxy[y-y0] );
+                }
+
+                for( int y=y0; y<y1; y++ )
+                {
+                    mFunc( mSrc.data, mSrc.step, mSrc.cols, mSrc.rows, xy[y-y0], fxy[y-y0],
+                           mDst.ptr<uchar>(y) + x0*esz, n );
+                }
+            }
+        }
+    }
+
+private:
+    const cv::Mat& mSrc;
+    cv::Mat& mDst;
+    const cv::Mat& mGrid;
+    int mShift;
+    RemapRowFunc mFunc;
+};
+
+bool remapDense( const cv::Mat& src, cv::Mat& dst, const cv::Mat& map1, const cv::Mat& map2, bool display, bool nearest )
+{
+    int cn = src.channels();
+
+    if( src.depth()!=CV_8U || (cn!=1 && cn!=3 && cn!=4) )
+        return false;
+
+    if( map1.type()!=CV_16SC2 || map2.type()!=CV_16UC1 || map1.size()!=map2.size() )
+        return false;
+
+    if( src.empty() || src.data==dst.data )
+        return false;
+
+    dst.create( map1.size(), display ? CV_8UC4 : src.type() );
+
+    RemapRowFunc func = kernels().select( cn, display, nearest );
+
+    cv::parallel_for_( cv::Range(0, dst.rows), FastRemapBody( src, dst, map1, map2, func ),
+                       (dst.rows+TILE_H-1)/TILE_H );
+
+    return true;
+}
+
+bool remapGrid( const cv::Mat& src, cv::Mat& dst, cv::Size dstSize, const cv::Mat& grid, int gridStep, bool display,
+                bool nearest )
+{
+    int cn = src.channels();
+
+    if( src.depth()!=CV_8U || (cn!=1 && cn!=3 && cn!=4) )
+        return false;
+
+    if( !validGrid( grid, gridStep, dstSize ) || src.empty() || src.data==dst.data )
+        return false;
+
+    dst.create( dstSize, display ? CV_8UC4 : src.type() );
+
+    RemapRowFunc func = kernels().select( cn, display, nearest );
+
+    cv::parallel_for_( cv::Range(0, dst.rows), FastRemapGridBody( src, dst, grid, gridStep, func ),
+                       (dst.rows+TILE_H-1)/TILE_H );
+
+    return true;
+}
+
+} // namespace
+
+bool fastRemap( const cv::Mat& src, cv::Mat& dst, const cv::Mat& map1, const cv::Mat& map2, bool nearest )
+{
+    return remapDense( src, dst, map1, map2, false, nearest );
+}
+
+bool fastRemapDisplay( const cv::Mat& src, cv::Mat& dst, const cv::Mat& map1, const cv::Mat& map2, bool nearest )
+{
+    return remapDense( src, dst, map1, map2, true, nearest );
+}
+
+const char* fastRemapIsa()
+{
+    return kernels().isa;
+}
+
+void fastRemapForceScalar( bool force )
+{
+    sKernelsIdx = force ? 0 : -1;
+}
+
+bool fastRemapUseIsa( const char* isa )
+{
+    if( !isa )
+    {
+        sKernelsIdx = -1;
+        return true;
+    }
+
+    const vector<RemapKernels>& all = allKernels();
+
+    for( size_t i=0; i<all.size(); i++ )
+    {
+        if( strcmp( all[i].isa, isa )==0 )
+        {
+            sKernelsIdx = static_cast<int>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool fastRemapGrid( const cv::Mat& src, cv::Mat& dst, cv::Size dstSize, const cv::Mat& grid, int gridStep,
+                    bool nearest )
+{
+    return remapGrid( src, dst, dstSize, grid, gridStep, false, nearest );
+}
+
+bool fastRemapGridDisplay( const cv::Mat& src, cv::Mat& dst, cv::Size dstSize, const cv::Mat& grid, int gridStep,
+                           bool nearest )
+{
+    return remapGrid( src, dst, dstSize, grid, gridStep, true, nearest );
+}
+
+bool i420Planes( const cv::Mat& img, cv::Size lumaSize, cv::Mat planes[3] )
+{
+    int w = lumaSize.width;
+    int h = lumaSize.height;
+
+    if( w<2 || h<2 || w%2!=0 || h%2!=0 )
+        return false;
+
+    if( img.type()!=CV_8UC1 || img.cols!=w || img.rows!=h*3/2 || !img.isContinuous() )
+        return false;
+
+    uchar* data = const_cast<uchar*>( img.data );
+
+    planes[0] = cv::Mat( h, w, CV_8UC1, data );
+    planes[1] = cv::Mat( h/2, w/2, CV_8UC1, data + w*h );
+    planes[2] = cv::Mat( h/2, w/2, CV_8UC1, data + w*h + (w/2)*(h/2) );
+
+    return true;
+}
+
+bool chromaRemapMaps( const cv::Mat& map1, const cv::Mat& map2, cv::Mat& chroma1, cv::Mat& chroma2 )
+{
+    if( map1.type()!=CV_16SC2 || map2.type()!=CV_16UC1 || map1.size()!=map2.size() ||
+            map1.cols%2!=0 || map1.rows%2!=0 )
+        return false;
+
+    chroma1.create( map1.rows/2, map1.cols/2, CV_16SC2 );
+    chroma2.create( map1.rows/2, map1.cols/2, CV_16UC1 );
+
+    for( int y=0; y<chroma1.rows; y++ )
+    {
+        const short* xy0 = map1.ptr<short>(2*y);
+        const short* xy1 = map1.ptr<short>(2*y+1);
+        const ushort* f0 = map2.ptr<ushort>(2*y);
+        const ushort* f1 = map2.ptr<ushort>(2*y+1);
+
+        short* cxy = chroma1.ptr<short>(y);
+        ushort* cf = chroma2.ptr<ushort>(y);
+
+        for( int x=0; x<chroma1.cols; x++ )
+        {
+            // >>>>> Sum of the 4 luma coordinates, in 1/TAB_SIZE pixels
+            int u = 0;
+            int v = 0;
+
+            for( int k=2*x; k<2*x+2; k++ )
+            {
+                u += xy0[2*k]*TAB_SIZE + (f0[k] & (TAB_SIZE-1)) + xy1[2*k]*TAB_SIZE + (f1[k] & (TAB_SIZE-1));
+                v += xy0[2*k+1]*TAB_SIZE + (f0[k] >> TAB_BITS) + xy1[2*k+1]*TAB_SIZE + (f1[k] >> TAB_BITS);
+            }
+            // <<<<< Sum of the 4 luma coordinates, in 1/TAB_SIZE pixels
+
+            // Luma to chroma: (c-0.5)/2 of the mean, rounded
+            int cu = (u - 2*TAB_SIZE + 4) >> 3;
+            int cv = (v - 2*TAB_SIZE + 4) >> 3;
+
+            cxy[2*x] = static_cast<short>( cu >> TAB_BITS );
+            cxy[2*x+1] = static_cast<short>( cv >> TAB_BITS );
+            cf[x] = static_cast<ushort>( (cv & (TAB_SIZE-1))*TAB_SIZE + (cu & (TAB_SIZE-1)) );
+        }
+    }
+
+    return true;
+}
+
+bool expandRemapGrid( const cv::Mat& grid, int gridStep, cv::Size dstSize, cv::Mat& map1, cv::Mat& map2 )
+{
+    if( !validGrid( grid, gridStep, dstSize ) )
+        return false;
+
+    map1.create( dstSize, CV_16SC2 );
+    map2.create( dstSize, CV_16UC1 );
+
+    int shift = gridShift( gridStep );
+
+    for( int y=0; y<dstSize.height; y++ )
+    {
+        for( int x0=0; x0<dstSize.width; x0+=TILE_W )
+        {
+            expandGridRow( grid, shift, y, x0, min( TILE_W, dstSize.width-x0 ),
+                           map1.ptr<short>(y) + 2*x0, map2.ptr<ushort>(y) + x0 );
+        }
+    }
+
+    return true;
+}
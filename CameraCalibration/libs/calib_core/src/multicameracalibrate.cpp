@@ -0,0 +1,351 @@
+#include "multicameracalibrate.h"
+
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <future>
+
+#include "qcameracalibrate.h"
+#include "undistortmapbuilder.h"
+
+using namespace std;
+
+MultiCameraCalibrate::MultiCameraCalibrate( int cameraCount, cv::Size cbSize, float cbSizeMm, bool fishEye )
+{
+    mCbSize = cbSize;
+    mCbSizeMm = cbSizeMm;
+    mFishEye = fishEye;
+
+    mSyncTolMsec = 5.0;
+
+    mCameras.resize( cameraCount<1?1:cameraCount );
+
+    for( size_t c=0; c<mCameras.size(); c++ )
+    {
+        mCameras[c].intrinsicsSet = false;
+        mCameras[c].reprojErr = NAN;
+    }
+}
+
+void MultiCameraCalibrate::setImageSize( int camera, cv::Size imgSize )
+{
+    mCameras[camera].imgSize = imgSize;
+}
+
+void MultiCameraCalibrate::addView( int camera, double timestampMs, const vector<cv::Point2f>& corners )
+{
+    View view;
+    view.timestampMs = timestampMs;
+    view.corners = corners;
+
+    mCameras[camera].views.push_back( view );
+}
+
+void MultiCameraCalibrate::setIntrinsics( int camera, cv::Mat K, cv::Mat D )
+{
+    Camera& cam = mCameras[camera];
+
+    cam.K = K.clone();
+    cam.D = cv::Mat( 8, 1, CV_64F, cv::Scalar::all(0.0) );
+    for( int i=0; i<D.rows && i<8; i++ )
+    {
+        cam.D.ptr<double>(i)[0] = D.ptr<double>(i)[0];
+    }
+
+    cam.intrinsicsSet = true;
+}
+
+void MultiCameraCalibrate::getIntrinsics( int camera, cv::Mat& K, cv::Mat& D, double& reprojErr )
+{
+    K = mCameras[camera].K;
+    D = mCameras[camera].D;
+    reprojErr = mCameras[camera].reprojErr;
+}
+
+bool MultiCameraCalibrate::calibrate( double alpha )
+{
+    mPairs.clear();
+
+    // >>>>> Intrinsics, one task per camera
+    vector< future<bool> > intrTasks;
+    for( int c=0; c<getCameraCount(); c++ )
+    {
+        intrTasks.push_back( async( launch::async, &MultiCameraCalibrate::calibrateIntrinsics, this, c ) );
+    }
+
+    bool ok = true;
+    for( size_t i=0; i<intrTasks.size(); i++ )
+    {
+        if( !intrTasks[i].get() )
+        {
+            mErrorString = "Camera " + to_string(i) + ": calibration failed, at least 5 chessboards are required";
+            ok = false;
+        }
+    }
+
+    if( !ok )
+        return false;
+    // <<<<< Intrinsics, one task per camera
+
+    // >>>>> Extrinsics, one task for each camera paired with camera 0
+    mPairs.resize( mCameras.size()-1 );
+
+    vector< future<bool> > pairTasks;
+    vector<string> pairErrors( mPairs.size() );
+    for( int c=1; c<getCameraCount(); c++ )
+    {
+        pairTasks.push_back( async( launch::async, &MultiCameraCalibrate::calibratePair, this,
+                                    c, alpha, ref(mPairs[c-1]), ref(pairErrors[c-1]) ) );
+    }
+
+    for( size_t i=0; i<pairTasks.size(); i++ )
+    {
+        if( !pairTasks[i].get() )
+        {
+            if( pairErrors[i].empty() )
+                pairErrors[i] = "at least 5 chessboards synchronized with camera 0 and the same image size are required";
+
+            mErrorString = "Camera " + to_string(i+1) + ": " + pairErrors[i];
+            ok = false;
+        }
+    }
+    // <<<<< Extrinsics, one task for each camera paired with camera 0
+
+    return ok;
+}
+
+bool MultiCameraCalibrate::calibrateIntrinsics( int camera )
+{
+    Camera& cam = mCameras[camera];
+
+    if( cam.intrinsicsSet )
+        return true;
+
+    if( cam.views.size() < 5 )
+        return false;
+
+    vector< vector<cv::Point2f> > imgCornersVec;
+    for( size_t i=0; i<cam.views.size(); i++ )
+    {
+        imgCornersVec.push_back( cam.views[i].corners );
+    }
+
+    vector< vector<cv::Point3f> > objCornersVec( imgCornersVec.size(),
+                                                 QCameraCalibrate::chessboardCorners3D( mCbSize, mCbSizeMm ) );
+
+    cam.K = cv::Mat( 3, 3, CV_64F, cv::Scalar::all(0.0) );
+    cam.K.ptr<double>(0)[0] = 1000.0;
+    cam.K.ptr<double>(1)[1] = 1000.0;
+    cam.K.ptr<double>(2)[2] = 1.0;
+    cam.K.ptr<double>(0)[2] = cam.imgSize.width/2.0;
+    cam.K.ptr<double>(1)[2] = cam.imgSize.height/2.0;
+
+    cam.D = cv::Mat( 8, 1, CV_64F, cv::Scalar::all(0.0) );
+
+    cam.reprojErr = QCameraCalibrate::calibrate( objCornersVec, imgCornersVec, cam.imgSize,
+                                                 mFishEye?ModelFisheye:ModelRational, false, cam.K, cam.D );
+
+    return !std::isnan( cam.reprojErr );
+}
+
+void MultiCameraCalibrate::syncViews( int camera, vector< pair<size_t,size_t> >& pairs )
+{
+    const vector<View>& viewsA = mCameras[0].views;
+    const vector<View>& viewsB = mCameras[camera].views;
+
+    pairs.clear();
+
+    // >>>>> Views of the second camera sorted by timestamp
+    vector<size_t> orderB( viewsB.size() );
+    for( size_t i=0; i<orderB.size(); i++ )
+    {
+        orderB[i] = i;
+    }
+
+    sort( orderB.begin(), orderB.end(), [&viewsB]( size_t a, size_t b ) {
+        return viewsB[a].timestampMs < viewsB[b].timestampMs;
+    } );
+    // <<<<< Views of the second camera sorted by timestamp
+
+    vector<bool> used( viewsB.size(), false );
+
+    for( size_t a=0; a<viewsA.size(); a++ )
+    {
+        double ts = viewsA[a].timestampMs;
+
+        // First candidate inside the tolerance window
+        vector<size_t>::iterator it = lower_bound( orderB.begin(), orderB.end(), ts-mSyncTolMsec,
+                                                   [&viewsB]( size_t b, double value ) {
+            return viewsB[b].timestampMs < value;
+        } );
+
+        size_t best = viewsB.size();
+        double bestDist = mSyncTolMsec;
+
+        for( ; it!=orderB.end() && viewsB[*it].timestampMs <= ts+mSyncTolMsec; ++it )
+        {
+            double dist = fabs( viewsB[*it].timestampMs - ts );
+
+            if( !used[*it] && dist <= bestDist )
+            {
+                best = *it;
+                bestDist = dist;
+            }
+        }
+
+        if( best < viewsB.size() )
+        {
+            used[best] = true;
+            pairs.push_back( make_pair( a, best ) );
+        }
+    }
+}
+
+bool MultiCameraCalibrate::calibratePair( int camera, double alpha, CameraPairCalib& pair, string& error )
+{
+    const Camera& camA = mCameras[0];
+    const Camera& camB = mCameras[camera];
+
+    pair.camera = camera;
+    pair.pairCount = 0;
+    pair.reprojErr = NAN;
+
+    if( camA.imgSize != camB.imgSize )
+        return false;
+
+    vector< std::pair<size_t,size_t> > sync;
+    syncViews( camera, sync );
+
+    pair.pairCount = sync.size();
+
+    if( sync.size() < 5 )
+        return false;
+
+    // >>>>> Synchronized observations
+    vector< vector<cv::Point2f> > imgCornersA;
+    vector< vector<cv::Point2f> > imgCornersB;
+
+    for( size_t i=0; i<sync.size(); i++ )
+    {
+        imgCornersA.push_back( camA.views[sync[i].first].corners );
+        imgCornersB.push_back( camB.views[sync[i].second].corners );
+    }
+
+    vector< vector<cv::Point3f> > objCornersVec( sync.size(),
+                                                 QCameraCalibrate::chessboardCorners3D( mCbSize, mCbSizeMm ) );
+    // <<<<< Synchronized observations
+
+    // Degenerate views make the solvers throw
+    try
+    {
+        cv::Size imgSize = camA.imgSize;
+
+        // The solvers take the intrinsics as input/output arrays: they are fixed, but copies are safer
+        cv::Mat KA = camA.K.clone();
+        cv::Mat KB = camB.K.clone();
+
+        if( mFishEye )
+        {
+            // >>>>> FishEye model wants only 4 distorsion parameters
+            cv::Mat DA = camA.D.rowRange(0,4).clone();
+            cv::Mat DB = camB.D.rowRange(0,4).clone();
+            // <<<<< FishEye model wants only 4 distorsion parameters
+
+            pair.reprojErr = cv::fisheye::stereoCalibrate( objCornersVec, imgCornersA, imgCornersB,
+                                                           KA, DA, KB, DB, imgSize,
+                                                           pair.R, pair.T, cv::fisheye::CALIB_FIX_INTRINSIC );
+
+            // >>>>> Essential and fundamental matrices are not returned by the FishEye solver
+            pair.R.convertTo( pair.R, CV_64F );
+            pair.T.convertTo( pair.T, CV_64F );
+
+            const double* t = pair.T.ptr<double>(0);
+            cv::Mat Tx = (cv::Mat_<double>(3,3) <<    0.0, -t[2],  t[1],
+                                                      t[2],   0.0, -t[0],
+                                                     -t[1],  t[0],   0.0 );
+
+            pair.E = Tx*pair.R;
+            pair.F = KB.inv().t()*pair.E*KA.inv();
+            // <<<<< Essential and fundamental matrices are not returned by the FishEye solver
+
+            cv::fisheye::stereoRectify( KA, DA, KB, DB, imgSize, pair.R, pair.T,
+                                        pair.R1, pair.R2, pair.P1, pair.P2, pair.Q,
+                                        cv::CALIB_ZERO_DISPARITY, imgSize, alpha );
+
+            buildUndistortMaps( KA, DA, pair.R1, pair.P1, imgSize, true, pair.map1First, pair.map2First );
+            buildUndistortMaps( KB, DB, pair.R2, pair.P2, imgSize, true, pair.map1Second, pair.map2Second );
+        }
+        else
+        {
+            cv::Mat DA = camA.D.clone();
+            cv::Mat DB = camB.D.clone();
+
+            pair.reprojErr = cv::stereoCalibrate( objCornersVec, imgCornersA, imgCornersB,
+                                                  KA, DA, KB, DB, imgSize,
+                                                  pair.R, pair.T, pair.E, pair.F,
+                                                  cv::CALIB_FIX_INTRINSIC );
+
+            cv::stereoRectify( KA, DA, KB, DB, imgSize, pair.R, pair.T,
+                               pair.R1, pair.R2, pair.P1, pair.P2, pair.Q,
+                               cv::CALIB_ZERO_DISPARITY, alpha );
+
+            buildUndistortMaps( KA, DA, pair.R1, pair.P1, imgSize, false, pair.map1First, pair.map2First );
+            buildUndistortMaps( KB, DB, pair.R2, pair.P2, imgSize, false, pair.map1Second, pair.map2Second );
+        }
+    }
+    catch( cv::Exception& ex )
+    {
+        error = string("stereo calibration failed: ") + ex.what();
+        pair.reprojErr = NAN;
+        return false;
+    }
+
+    return true;
+}
+
+bool MultiCameraCalibrate::saveCameraParams( string fileName )
+{
+    cv::FileStorage fs( fileName, cv::FileStorage::WRITE );
+
+    if( !fs.isOpened() )
+    {
+        return false;
+    }
+
+    fs << "CameraCount" << getCameraCount();
+    fs << "FishEye" << mFishEye;
+
+    for( size_t c=0; c<mCameras.size(); c++ )
+    {
+        fs << "Camera" + to_string(c) << "{";
+        fs << "Width" << mCameras[c].imgSize.width;
+        fs << "Height" << mCameras[c].imgSize.height;
+        fs << "CameraMatrix" << mCameras[c].K;
+        fs << "DistCoeffs" << mCameras[c].D;
+        fs << "ReprojErr" << mCameras[c].reprojErr;
+        fs << "}";
+    }
+
+    for( size_t p=0; p<mPairs.size(); p++ )
+    {
+        const CameraPairCalib& pair = mPairs[p];
+
+        fs << "Pair0_" + to_string(pair.camera) << "{";
+        fs << "PairCount" << static_cast<int>(pair.pairCount);
+        fs << "ReprojErr" << pair.reprojErr;
+        fs << "R" << pair.R;
+        fs << "T" << pair.T;
+        fs << "E" << pair.E;
+        fs << "F" << pair.F;
+        fs << "R1" << pair.R1;
+        fs << "R2" << pair.R2;
+        fs << "P1" << pair.P1;
+        fs << "P2" << pair.P2;
+        fs << "Q" << pair.Q;
+        fs << "}";
+    }
+
+    return true;
+}
@@ -0,0 +1,93 @@
+#include "pipelinestage.h"
+
+using namespace std;
+
+static uint64_t elapsedUsec( PipelineClock::time_point from, PipelineClock::time_point to )
+{
+    return static_cast<uint64_t>( chrono::duration_cast<chrono::microseconds>( to-from ).count() );
+}
+
+StageStats::StageStats()
+{
+    workers = 0;
+    processed = 0;
+    dropped = 0;
+    queueDepth = 0;
+    queueCapacity = 0;
+    fps = 0.0;
+    latencyMsec = 0.0;
+    busyMsec = 0.0;
+}
+
+PipelineStageBase::PipelineStageBase( const string& name, QueuePolicy policy )
+    : mName( name )
+    , mPolicy( policy )
+{
+    mProcessed = 0;
+    mDropped = 0;
+    mLatencyUsec = 0;
+    mBusyUsec = 0;
+
+    mLastStatsTime = PipelineClock::now();
+    mLastProcessed = 0;
+    mLastDropped = 0;
+    mLastLatencyUsec = 0;
+    mLastBusyUsec = 0;
+}
+
+PipelineStageBase::~PipelineStageBase()
+{
+}
+
+StageStats PipelineStageBase::getStats()
+{
+    StageStats stats;
+    stats.name = mName;
+    stats.workers = getWorkerCount();
+    stats.queueDepth = getQueueDepth();
+    stats.queueCapacity = getQueueCapacity();
+
+    // Latency and busy time first: the items they count are all in the processed count read after
+    uint64_t latencyUsec = mLatencyUsec;
+    uint64_t busyUsec = mBusyUsec;
+    uint64_t processed = mProcessed;
+    uint64_t dropped = mDropped;
+
+    lock_guard<mutex> lock( mStatsMutex );
+
+    PipelineClock::time_point now = PipelineClock::now();
+    double periodSec = elapsedUsec( mLastStatsTime, now )/1e6;
+
+    stats.processed = processed - mLastProcessed;
+    stats.dropped = dropped - mLastDropped;
+
+    if( periodSec>0.0 )
+        stats.fps = stats.processed/periodSec;
+
+    if( stats.processed>0 )
+    {
+        stats.latencyMsec = (latencyUsec - mLastLatencyUsec)/(1000.0*stats.processed);
+        stats.busyMsec = (busyUsec - mLastBusyUsec)/(1000.0*stats.processed);
+    }
+
+    mLastStatsTime = now;
+    mLastProcessed = processed;
+    mLastDropped = dropped;
+    mLastLatencyUsec = latencyUsec;
+    mLastBusyUsec = busyUsec;
+
+    return stats;
+}
+
+void PipelineStageBase::countProcessed( PipelineClock::time_point pushed, PipelineClock::time_point start,
+                                        PipelineClock::time_point end )
+{
+    mLatencyUsec += elapsedUsec( pushed, end );
+    mBusyUsec += elapsedUsec( start, end );
+    mProcessed++;
+}
+
+void PipelineStageBase::countDropped( uint64_t count )
+{
+    mDropped += count;
+}
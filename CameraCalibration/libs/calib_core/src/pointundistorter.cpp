@@ -0,0 +1,308 @@
+#include "pointundistorter.h"
+#include "distortionmodels.h"
+
+#include <algorithm>
+#include <cmath>
+
+using namespace std;
+
+#define POINT_LUT_SIZE 1024
+#define POINT_LUT_SAMPLES 4096          // Samples of the radial distortion inverted into the table
+#define POINT_LUT_MAX_ANGLE 1.5         // Rays up to 86 degrees from the axis
+#define POINT_NEWTON_STEPS 3
+#define POINT_NEWTON_DELTA 1e-6         // Numerical derivatives of the model
+
+#define POINT_CHUNK 1024
+#define POINT_PARALLEL_MIN 4096
+
+namespace
+{
+
+/// Chunks of POINT_CHUNK points for one distortion model
+template<class Model>
+class PointBody : public cv::ParallelLoopBody
+{
+public:
+    PointBody( const Model& model, const MapParams& p, const double* newK, const vector<double>& lut, double lutStep,
+               bool inverse, const cv::Point2f* src, cv::Point2f* dst, size_t count )
+        : mModel(model), mP(p), mNewK(newK), mLut(lut), mLutStep(lutStep), mInverse(inverse),
+          mSrc(src), mDst(dst), mCount(count)
+    {
+    }
+
+    void operator()( const cv::Range& range ) const override
+    {
+        size_t begin = static_cast<size_t>(range.start)*POINT_CHUNK;
+        size_t end = min( static_cast<size_t>(range.end)*POINT_CHUNK, mCount );
+
+        for( size_t n=begin; n<end; n+=MAP_LANES )
+        {
+            // The lanes past the end repeat the last point
+            LaneVec x, y;
+            for( int k=0; k<MAP_LANES; k++ )
+            {
+                size_t idx = min( n+k, end-1 );
+                x[k] = mSrc[idx].x;
+                y[k] = mSrc[idx].y;
+            }
+
+            LaneVec u, v;
+            if( mInverse )
+                undistortLanes( x, y, u, v );
+            else
+                projectPixels( mModel, mP.k, mP.ir, x, y, u, v );
+
+            for( int k=0; k<MAP_LANES && n+k<end; k++ )
+            {
+                mDst[n+k].x = static_cast<float>( u[k] );
+                mDst[n+k].y = static_cast<float>( v[k] );
+            }
+        }
+    }
+
+private:
+    void undistortLanes( LaneVec u, LaneVec v, LaneVec& resU, LaneVec& resV ) const
+    {
+        const double* k = mP.k;
+
+        LaneVec yd = (v - k[5])/k[4];
+        LaneVec xd = (u - k[2])/k[0];
+
+        // >>>>> First guess: inverse of the radial distortion
+        LaneVec rd = laneSqrt( xd*xd + yd*yd );
+        LaneVec r;
+
+        int last = static_cast<int>(mLut.size()) - 1;
+
+        for( int n=0; n<MAP_LANES; n++ )
+        {
+            // Clamped before the cast: NaN (stays NaN through xd, yd) and huge radii
+            double t = rd[n]/mLutStep;
+            t = (t >= 0.0) ? min( t, static_cast<double>(last) ) : 0.0;
+
+            int i = min( static_cast<int>(t), last-1 );
+            double f = min( t-i, 1.0 );
+
+            r[n] = mLut[i] + f*(mLut[i+1]-mLut[i]);
+        }
+
+        LaneVec scale = (rd > 0.0) ? r/rd : laneSet( mLut[1]/mLutStep );
+
+        LaneVec x = xd*scale;
+        LaneVec y = yd*scale;
+        // <<<<< First guess: inverse of the radial distortion
+
+        // >>>>> Newton steps, same count for every point
+        const double h = POINT_NEWTON_DELTA;
+
+        for( int step=0; step<POINT_NEWTON_STEPS; step++ )
+        {
+            LaneVec px, py, ax, ay, bx, by;
+            mModel.project( x, y, px, py );
+            mModel.project( x+h, y, ax, ay );
+            mModel.project( x, y+h, bx, by );
+
+            LaneVec j00 = (ax-px)/h;
+            LaneVec j01 = (bx-px)/h;
+            LaneVec j10 = (ay-py)/h;
+            LaneVec j11 = (by-py)/h;
+
+            LaneVec ex = px - xd;
+            LaneVec ey = py - yd;
+
+            LaneVec iDet = 1.0/(j00*j11 - j01*j10);
+
+            x -= (j11*ex - j01*ey)*iDet;
+            y -= (j00*ey - j10*ex)*iDet;
+        }
+        // <<<<< Newton steps, same count for every point
+
+        LaneVec iw = 1.0/(mNewK[6]*x + mNewK[7]*y + mNewK[8]);
+        resU = (mNewK[0]*x + mNewK[1]*y + mNewK[2])*iw;
+        resV = (mNewK[3]*x + mNewK[4]*y + mNewK[5])*iw;
+    }
+
+    Model mModel;
+    const MapParams& mP;
+    const double* mNewK;
+    const vector<double>& mLut;
+    double mLutStep;
+    bool mInverse;
+
+    const cv::Point2f* mSrc;
+    cv::Point2f* mDst;
+    size_t mCount;
+};
+
+template<class Model>
+void transformWith( const Model& model, const MapParams& p, const double* newK, const vector<double>& lut,
+                    double lutStep, bool inverse, const cv::Point2f* src, cv::Point2f* dst, size_t count )
+{
+    int chunks = static_cast<int>( (count+POINT_CHUNK-1)/POINT_CHUNK );
+
+    PointBody<Model> body( model, p, newK, lut, lutStep, inverse, src, dst, count );
+
+    if( count<POINT_PARALLEL_MIN )
+        body( cv::Range(0, chunks) );
+    else
+        cv::parallel_for_( cv::Range(0, chunks), body );
+}
+
+/// Undistorted radius of the distorted radius i*step, up to maxRd or to the end of the range
+/// where the radial distortion is increasing. Returns the step
+template<class Model>
+double radialLut( const Model& model, double maxRd, vector<double>& lut )
+{
+    // >>>>> Samples of the distorted radius, uniform on the angle of the ray
+    vector<double> r, rd;
+    r.reserve( POINT_LUT_SAMPLES );
+    rd.reserve( POINT_LUT_SAMPLES );
+
+    r.push_back( 0.0 );
+    rd.push_back( 0.0 );
+
+    for( int i=1; i<POINT_LUT_SAMPLES; i++ )
+    {
+        double ri = tan( (POINT_LUT_MAX_ANGLE*i)/(POINT_LUT_SAMPLES-1) );
+
+        LaneVec xd, yd;
+        model.project( laneSet(ri), laneSet(0.0), xd, yd );
+
+        // Past the maximum the distortion folds the image, there is no inverse
+        if( !(xd[0] > rd.back()) )
+            break;
+
+        r.push_back( ri );
+        rd.push_back( xd[0] );
+
+        if( xd[0] >= maxRd )
+            break;
+    }
+    // <<<<< Samples of the distorted radius, uniform on the angle of the ray
+
+    lut.resize( POINT_LUT_SIZE );
+
+    if( rd.size()<2 )
+    {
+        // No usable range: the Newton steps start from the distorted point
+        for( int i=0; i<POINT_LUT_SIZE; i++ )
+        {
+            lut[i] = i;
+        }
+        return 1.0;
+    }
+
+    double step = rd.back()/(POINT_LUT_SIZE-1);
+
+    size_t s = 1;
+    for( int i=0; i<POINT_LUT_SIZE; i++ )
+    {
+        double target = min( i*step, rd.back() );
+
+        while( s<rd.size()-1 && rd[s]<target )
+        {
+            s++;
+        }
+
+        double f = (target-rd[s-1])/(rd[s]-rd[s-1]);
+        lut[i] = r[s-1] + f*(r[s]-r[s-1]);
+    }
+
+    return step;
+}
+
+} // namespace
+
+PointUndistorter::PointUndistorter( const cv::Mat& K, const cv::Mat& D, bool fishEye, const cv::Mat& newK,
+                                    cv::Size imgSize )
+    : mParams( new MapParams() )
+{
+    mLutStep = 1.0;
+    mValid = makeParams( K, D, cv::Mat(), newK, fishEye, *mParams );
+
+    if( !mValid )
+        return;
+
+    cv::Mat newK64;
+    newK.colRange(0,3).convertTo( newK64, CV_64F );
+
+    for( int i=0; i<9; i++ )
+    {
+        mNewK[i] = newK64.ptr<double>(i/3)[i%3];
+    }
+
+    // The table inverts the radial terms only
+    double radial[12];
+    copy( mParams->d, mParams->d+12, radial );
+
+    if( !fishEye )
+    {
+        radial[2] = radial[3] = 0.0;
+        fill( radial+8, radial+12, 0.0 );
+    }
+
+    // Farthest corner of the image, distorted normalized coordinates
+    const double* k = mParams->k;
+    double maxRd = 0.0;
+
+    for( int c=0; c<4; c++ )
+    {
+        double xd = ((c&1 ? imgSize.width : 0) - k[2])/k[0];
+        double yd = ((c&2 ? imgSize.height : 0) - k[5])/k[4];
+
+        maxRd = max( maxRd, sqrt( xd*xd + yd*yd ) );
+    }
+
+    if( fishEye )
+        mLutStep = radialLut( FisheyeModel(radial), maxRd, mRadialLut );
+    else
+        mLutStep = radialLut( RationalModel(radial), maxRd, mRadialLut );
+}
+
+PointUndistorter::~PointUndistorter()
+{
+}
+
+void PointUndistorter::undistort( const cv::Point2f* src, cv::Point2f* dst, size_t count ) const
+{
+    if( !mValid || count==0 )
+        return;
+
+    switch( modelType(*mParams) )
+    {
+    case ModelType::Fisheye:
+        transformWith( FisheyeModel(mParams->d), *mParams, mNewK, mRadialLut, mLutStep, true, src, dst, count );
+        break;
+    case ModelType::ThinPrism:
+        transformWith( ThinPrismModel(mParams->d), *mParams, mNewK, mRadialLut, mLutStep, true, src, dst, count );
+        break;
+    case ModelType::Rational:
+        transformWith( RationalModel(mParams->d), *mParams, mNewK, mRadialLut, mLutStep, true, src, dst, count );
+        break;
+    case ModelType::Polynomial:
+        transformWith( PolynomialModel(mParams->d), *mParams, mNewK, mRadialLut, mLutStep, true, src, dst, count );
+        break;
+    }
+}
+
+void PointUndistorter::distort( const cv::Point2f* src, cv::Point2f* dst, size_t count ) const
+{
+    if( !mValid || count==0 )
+        return;
+
+    switch( modelType(*mParams) )
+    {
+    case ModelType::Fisheye:
+        transformWith( FisheyeModel(mParams->d), *mParams, mNewK, mRadialLut, mLutStep, false, src, dst, count );
+        break;
+    case ModelType::ThinPrism:
+        transformWith( ThinPrismModel(mParams->d), *mParams, mNewK, mRadialLut, mLutStep, false, src, dst, count );
+        break;
+    case ModelType::Rational:
+        transformWith( RationalModel(mParams->d), *mParams, mNewK, mRadialLut, mLutStep, false, src, dst, count );
+        break;
+    case ModelType::Polynomial:
+        transformWith( PolynomialModel(mParams->d), *mParams, mNewK, mRadialLut, mLutStep, false, src, dst, count );
+        break;
+    }
+}
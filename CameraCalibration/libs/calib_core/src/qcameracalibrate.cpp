@@ -0,0 +1,1093 @@
+#include "qcameracalibrate.h"
+
+#include <QtGlobal>
+#include <QDebug>
+#include <QElapsedTimer>
+#include <QRunnable>
+
+#include <opencv2/calib3d/calib3d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include <iostream>
+#include <cmath>
+#include <ctime>
+#include <cfloat>
+#include <future>
+
+#include "cameraundistort.h"
+#include "cornerdataset.h"
+#include "pipelinestage.h"
+
+using namespace std;
+
+#define SOLVE_HISTORY_SIZE 100
+#define SOLVE_CONVERGED_EPS 1e-6 // Relative RMS difference of a probe solve from the final solve
+#define HELD_OUT_EVERY 5 // One view out of HELD_OUT_EVERY is excluded from the training solve
+
+/// Runs QCameraCalibrate::compareModels on the thread pool of the calibrator
+class ModelCompareTask : public QRunnable
+{
+public:
+    explicit ModelCompareTask( QCameraCalibrate* calib ) : mCalib(calib) {}
+
+    void run() override
+    {
+        mCalib->compareModels();
+    }
+
+private:
+    QCameraCalibrate* mCalib;
+};
+
+/// Copy of the coefficients with the given number of rows, zero padded
+static cv::Mat resizeCoeffs( const cv::Mat& D, int rows )
+{
+    cv::Mat res = cv::Mat( rows, 1, CV_64F, cv::Scalar::all(0.0) );
+
+    for( int i=0; i<rows && i<D.rows; i++ )
+    {
+        res.ptr<double>(i)[0] = D.ptr<double>(i)[0];
+    }
+
+    return res;
+}
+
+static double threadCpuMsec()
+{
+#ifdef Q_OS_UNIX
+    timespec ts;
+    clock_gettime( CLOCK_THREAD_CPUTIME_ID, &ts );
+
+    return ts.tv_sec*1000.0 + ts.tv_nsec/1e6;
+#else
+    return 1000.0*clock()/CLOCKS_PER_SEC;
+#endif
+}
+
+SolveStats::SolveStats()
+{
+    wallMsec = 0.0;
+    cpuMsec = 0.0;
+    iterations = -1;
+    maxIterations = 0;
+    views = 0;
+    corners = 0;
+    model = ModelRational;
+    stage = StageFull;
+    useGuess = false;
+    termination = TermFailed;
+    reprojErr = NAN;
+}
+
+QCameraCalibrate::QCameraCalibrate(cv::Size imgSize, cv::Size cbSize, float cbSquareSizeMm, bool fishEye, int refineThreshm, QObject *parent)
+    : QObject(parent)
+    , mUndistort(NULL)
+    , mDataset(NULL)
+{
+    mImgSize = imgSize;
+    mCbSize = cbSize;
+    mCbSquareSizeMm = cbSquareSizeMm;
+    //mAlpha = 0.0;
+
+    mRefineThresh = refineThreshm;
+
+    mSolverMaxIter = 0;
+    mSolverTraceStep = 0;
+
+    //mFishEye = fishEye;
+
+    mRefined = false;
+    mModel = fishEye?ModelFisheye:ModelRational;
+    mRecommendedModel = mModel;
+
+    mReprojErr = NAN;
+
+    mTaskPool.setMaxThreadCount( 1 );
+
+    mProgressive = false;
+    mIntermediateViews = 8;
+    mFullViews = 16;
+    mTotalViews = 0;
+
+    // A single slot: a queued solve takes its snapshot when it starts, so it covers the views
+    // added after it was requested and the requests meanwhile are dropped
+    mSolveStage = new PipelineStage<int>( "solve", [this]( int&, int ){ backgroundFullSolve(); },
+                                          1, QueueDropNewest );
+
+    mCoeffReady = false;
+
+    create3DChessboardCorners( mCbSize, mCbSquareSizeMm );
+
+    mUndistort = new CameraUndistort( mImgSize, fishEye );
+}
+
+QCameraCalibrate::~QCameraCalibrate()
+{
+    delete mSolveStage;
+
+    mTaskPool.clear();
+    mTaskPool.waitForDone();
+
+    if(mUndistort)
+        delete mUndistort;
+
+    if(mDataset)
+        delete mDataset;
+}
+
+void QCameraCalibrate::setNewAlpha( double alpha )
+{
+    if( mUndistort )
+    {
+        mUndistort->setNewAlpha(alpha);
+    }
+}
+
+void QCameraCalibrate::setFisheye( bool fisheye )
+{
+    setModel( fisheye?ModelFisheye:ModelRational );
+}
+
+void QCameraCalibrate::setModel( CameraModel model )
+{
+    mMutex.lock();
+    mModel = model;
+    mMutex.unlock();
+
+    if( mUndistort )
+    {
+        mUndistort->setFisheye( model==ModelFisheye );
+    }
+}
+
+CameraModel QCameraCalibrate::getModel()
+{
+    mMutex.lock();
+    CameraModel model = mModel;
+    mMutex.unlock();
+
+    return model;
+}
+
+void QCameraCalibrate::getCameraParams( cv::Size& imgSize, cv::Mat &K, cv::Mat &D, double &alpha, bool &fisheye)
+{
+    if( !mUndistort )
+        return;
+
+    mUndistort->getCameraParams( imgSize, fisheye, K, D, alpha );
+}
+
+bool QCameraCalibrate::setCameraParams(cv::Size imgSize, cv::Mat &K, cv::Mat &D, double alpha, bool fishEye )
+{
+    if( !mUndistort )
+        return false;
+
+    mImgSize = imgSize;
+
+    mMutex.lock();
+    if( fishEye )
+    {
+        mModel = ModelFisheye;
+    }
+    else if( mModel==ModelFisheye )
+    {
+        mModel = ModelRational;
+    }
+    mMutex.unlock();
+
+    if( mUndistort->setCameraParams( mImgSize, fishEye, K, D, alpha ) )
+    {
+        mRefined=true;      // Initial guess is set, so we want to refine the calibration values
+        mCoeffReady=true;
+
+        return true;
+    }
+
+    mRefined = false;
+    mCoeffReady = false;
+
+    return false;
+}
+
+void QCameraCalibrate::addCorners( vector<cv::Point2f>& img_corners, cv::Mat thumbnail )
+{
+    mMutex.lock();
+
+    if( mDataset )
+    {
+        mDataset->append( img_corners, thumbnail );
+    }
+
+    if( (int)mObjCornersVec.size() >= mRefineThresh )
+    {
+        mObjCornersVec.clear();
+        mImgCornersVec.clear();
+
+        mRefined = true;
+    }
+
+    mObjCornersVec.push_back( mDefObjCorners );
+    mImgCornersVec.push_back( img_corners );
+
+    mTotalViews++;
+
+    if( mObjCornersVec.size() >= 5)
+    {
+        SolveStage stage = progressiveStage();
+
+        if( stage==StageFull && mProgressive )
+        {
+            scheduleFullSolve();
+        }
+        else if( stage==StageFull )
+        {
+            solve( mRefined );
+        }
+        else
+        {
+            // Each stage starts from the parameters of the previous one
+            solve( mRefined || mCoeffReady, stage );
+        }
+    }
+
+    mMutex.unlock();
+}
+
+bool QCameraCalibrate::calibrateBatch( const vector< vector<cv::Point2f> >& imgCornersVec )
+{
+    if( imgCornersVec.size() < 5 )
+        return false;
+
+    mMutex.lock();
+
+    mImgCornersVec = imgCornersVec;
+    mObjCornersVec.assign( mImgCornersVec.size(), mDefObjCorners );
+
+    solve( mRefined );
+
+    mMutex.unlock();
+
+    return true;
+}
+
+bool QCameraCalibrate::recalibrate()
+{
+    mMutex.lock();
+
+    if( mImgCornersVec.size() < 5 )
+    {
+        mMutex.unlock();
+        return false;
+    }
+
+    solve( false );
+
+    mMutex.unlock();
+
+    return true;
+}
+
+void QCameraCalibrate::solve( bool useGuess, SolveStage stage )
+{
+    cv::Size imgSize;
+    bool fisheye;
+    cv::Mat K,D;
+    double alpha;
+
+    mUndistort->getCameraParams( imgSize, fisheye, K, D, alpha );
+
+    SolveStats stats;
+
+    if( stage==StageFull )
+    {
+        calibrate( mObjCornersVec, mImgCornersVec, mImgSize, mModel, useGuess, K, D,
+                   &stats, mSolverMaxIter, mSolverTraceStep );
+    }
+    else
+    {
+        // >>>>> Coarse grid
+        vector< vector<cv::Point2f> > imgCornersVec( mImgCornersVec.size() );
+        vector< vector<cv::Point3f> > objCornersVec( mImgCornersVec.size() );
+
+        for( size_t i=0; i<mImgCornersVec.size(); i++ )
+        {
+            subsampleCorners( mImgCornersVec[i], imgCornersVec[i], objCornersVec[i] );
+        }
+        // <<<<< Coarse grid
+
+        calibrate( objCornersVec, imgCornersVec, mImgSize, mModel, useGuess, K, D,
+                   &stats, mSolverMaxIter, mSolverTraceStep, stage==StageCoarse );
+    }
+
+    stats.stage = stage;
+
+    publishSolve( stats, K, D, alpha );
+}
+
+void QCameraCalibrate::publishSolve( const SolveStats& stats, cv::Mat K, cv::Mat D, double alpha )
+{
+    mReprojErr = stats.reprojErr;
+
+    // >>>>> Stats are stored before the signal, so its receivers can read them
+    mStatsMutex.lock();
+    mSolveHistory.push_back( stats );
+    if( mSolveHistory.size() > SOLVE_HISTORY_SIZE )
+    {
+        mSolveHistory.erase( mSolveHistory.begin() );
+    }
+    mStatsMutex.unlock();
+    // <<<<< Stats are stored before the signal, so its receivers can read them
+
+    if( stats.termination == SolveStats::TermFailed )
+    {
+        emit newCameraParams( cv::Mat(), cv::Mat(), mRefined, mReprojErr );
+        return;
+    }
+
+    mUndistort->setCameraParams( mImgSize, mModel==ModelFisheye, K, D, alpha );
+
+    emit newCameraParams( K, D, mRefined, mReprojErr );
+
+    mCoeffReady = true;
+}
+
+void QCameraCalibrate::setProgressive( bool enable, int intermediateViews, int fullViews )
+{
+    mMutex.lock();
+    mProgressive = enable;
+    mIntermediateViews = intermediateViews;
+    mFullViews = fullViews<intermediateViews?intermediateViews:fullViews;
+    mMutex.unlock();
+}
+
+SolveStage QCameraCalibrate::getSolveStage()
+{
+    return getLastSolveStats().stage;
+}
+
+const char* QCameraCalibrate::stageName( SolveStage stage )
+{
+    switch( stage )
+    {
+    case StageCoarse:
+        return "Coarse";
+    case StageIntermediate:
+        return "Intermediate";
+    default:
+        return "Full";
+    }
+}
+
+SolveStage QCameraCalibrate::progressiveStage()
+{
+    if( !mProgressive || mTotalViews >= mFullViews )
+        return StageFull;
+
+    if( mTotalViews >= mIntermediateViews )
+        return StageIntermediate;
+
+    return StageCoarse;
+}
+
+void QCameraCalibrate::scheduleFullSolve()
+{
+    // Requests are serialized by mMutex: the solve stage has a single producer
+    mSolveStage->push( 0 );
+}
+
+void QCameraCalibrate::backgroundFullSolve()
+{
+    mMutex.lock();
+
+    // >>>>> Snapshot
+    vector< vector<cv::Point2f> > imgCornersVec = mImgCornersVec;
+    vector< vector<cv::Point3f> > objCornersVec = mObjCornersVec;
+    CameraModel model = mModel;
+    bool useGuess = mRefined || mCoeffReady;
+    int maxIter = mSolverMaxIter;
+    int traceStep = mSolverTraceStep;
+
+    cv::Size imgSize;
+    bool fisheye;
+    cv::Mat K,D;
+    double alpha;
+    mUndistort->getCameraParams( imgSize, fisheye, K, D, alpha );
+    // <<<<< Snapshot
+
+    // addCorners keeps collecting views while the solver runs
+    mMutex.unlock();
+
+    SolveStats stats;
+    calibrate( objCornersVec, imgCornersVec, mImgSize, model, useGuess, K, D,
+               &stats, maxIter, traceStep );
+    stats.stage = StageFull;
+
+    mMutex.lock();
+
+    // Alpha may have been changed meanwhile, the model must not
+    if( model==mModel )
+    {
+        cv::Mat currK, currD;
+        mUndistort->getCameraParams( imgSize, fisheye, currK, currD, alpha );
+
+        publishSolve( stats, K, D, alpha );
+    }
+
+    mMutex.unlock();
+}
+
+StageStats QCameraCalibrate::getSolveStats()
+{
+    return mSolveStage->getStats();
+}
+
+void QCameraCalibrate::setSolverCriteria( int maxIter, int traceStep )
+{
+    mMutex.lock();
+    mSolverMaxIter = maxIter<0?0:maxIter;
+    mSolverTraceStep = traceStep<0?0:traceStep;
+    mMutex.unlock();
+}
+
+SolveStats QCameraCalibrate::getLastSolveStats()
+{
+    mStatsMutex.lock();
+    SolveStats stats = mSolveHistory.empty() ? SolveStats() : mSolveHistory.back();
+    mStatsMutex.unlock();
+
+    return stats;
+}
+
+vector<SolveStats> QCameraCalibrate::getSolveHistory()
+{
+    mStatsMutex.lock();
+    vector<SolveStats> history = mSolveHistory;
+    mStatsMutex.unlock();
+
+    return history;
+}
+
+bool QCameraCalibrate::startRecording( string fileName )
+{
+    mMutex.lock();
+
+    if( mDataset )
+    {
+        delete mDataset;
+    }
+
+    mDataset = new CornerDataset();
+
+    bool ok = mDataset->create( fileName, mCbSize, mCbSquareSizeMm, mImgSize );
+
+    for( size_t i=0; ok && i<mImgCornersVec.size(); i++ )
+    {
+        ok = mDataset->append( mImgCornersVec[i] );
+    }
+
+    if( !ok )
+    {
+        delete mDataset;
+        mDataset = NULL;
+    }
+
+    mMutex.unlock();
+
+    return ok;
+}
+
+void QCameraCalibrate::stopRecording()
+{
+    mMutex.lock();
+
+    if( mDataset )
+    {
+        delete mDataset;
+        mDataset = NULL;
+    }
+
+    mMutex.unlock();
+}
+
+bool QCameraCalibrate::isRecording()
+{
+    mMutex.lock();
+    bool recording = (mDataset!=NULL);
+    mMutex.unlock();
+
+    return recording;
+}
+
+bool QCameraCalibrate::loadSession( string fileName )
+{
+    CornerDataset dataset;
+
+    if( !dataset.load( fileName, false ) )
+        return false;
+
+    if( dataset.getCbSize() != mCbSize || dataset.getImgSize() != mImgSize )
+        return false;
+
+    // The views are solved with the squares of the current chessboard: another size would scale the extrinsics
+    if( dataset.getCbSizeMm() != mCbSquareSizeMm )
+        return false;
+
+    if( dataset.getCornersVec().size() < 5 )
+        return false;
+
+    mMutex.lock();
+
+    mImgCornersVec = dataset.getCornersVec();
+    mObjCornersVec.assign( mImgCornersVec.size(), mDefObjCorners );
+
+    solve( false );
+
+    mMutex.unlock();
+
+    return true;
+}
+
+bool QCameraCalibrate::compareModels()
+{
+    mMutex.lock();
+    vector< vector<cv::Point2f> > imgCornersVec = mImgCornersVec;
+    int maxIter = mSolverMaxIter;
+    int traceStep = mSolverTraceStep;
+    mMutex.unlock();
+
+    // Too few views: no candidate, the listeners are still told the comparison ended
+    if( imgCornersVec.size() < 5 )
+    {
+        mCandidatesMutex.lock();
+        mCandidates.clear();
+        mCandidatesMutex.unlock();
+
+        emit modelsCompared();
+
+        return false;
+    }
+
+    // >>>>> One task per model, all on the same views
+    vector< future<ModelCandidate> > tasks;
+    for( int m=0; m<ModelCount; m++ )
+    {
+        tasks.push_back( async( launch::async, &QCameraCalibrate::solveCandidate, this,
+                                static_cast<CameraModel>(m), cref(imgCornersVec), maxIter, traceStep ) );
+    }
+
+    vector<ModelCandidate> candidates;
+    for( size_t i=0; i<tasks.size(); i++ )
+    {
+        candidates.push_back( tasks[i].get() );
+    }
+    // <<<<< One task per model, all on the same views
+
+    // >>>>> Recommendation
+    bool found = false;
+    CameraModel best = ModelRational;
+    double bestErr = 0.0;
+
+    for( size_t i=0; i<candidates.size(); i++ )
+    {
+        if( !candidates[i].valid )
+            continue;
+
+        // With too few views there is no held-out set: the training error is the only reference
+        double err = std::isnan(candidates[i].heldOutErr) ? candidates[i].reprojErr : candidates[i].heldOutErr;
+
+        if( !found || err < bestErr )
+        {
+            best = candidates[i].model;
+            bestErr = err;
+            found = true;
+        }
+    }
+    // <<<<< Recommendation
+
+    mCandidatesMutex.lock();
+    mCandidates = candidates;
+    mRecommendedModel = best;
+    mCandidatesMutex.unlock();
+
+    emit modelsCompared();
+
+    return found;
+}
+
+void QCameraCalibrate::compareModelsAsync()
+{
+    mTaskPool.start( new ModelCompareTask(this) );
+}
+
+ModelCandidate QCameraCalibrate::solveCandidate( CameraModel model, const vector< vector<cv::Point2f> >& imgCornersVec,
+                                                 int maxIter, int traceStep )
+{
+    ModelCandidate cand;
+    cand.model = model;
+    cand.valid = false;
+    cand.reprojErr = NAN;
+    cand.heldOutErr = NAN;
+
+    cand.K = cv::Mat( 3, 3, CV_64F, cv::Scalar::all(0.0) );
+    cand.K.ptr<double>(0)[0] = 1000.0;
+    cand.K.ptr<double>(1)[1] = 1000.0;
+    cand.K.ptr<double>(2)[2] = 1.0;
+    cand.K.ptr<double>(0)[2] = mImgSize.width/2.0;
+    cand.K.ptr<double>(1)[2] = mImgSize.height/2.0;
+
+    cand.D = cv::Mat( 8, 1, CV_64F, cv::Scalar::all(0.0) );
+
+    bool useGuess = false;
+
+    // >>>>> Training solve and held-out error
+    if( imgCornersVec.size() > HELD_OUT_EVERY )
+    {
+        vector< vector<cv::Point2f> > trainImg, testImg;
+
+        for( size_t i=0; i<imgCornersVec.size(); i++ )
+        {
+            if( i%HELD_OUT_EVERY == HELD_OUT_EVERY-1 )
+            {
+                testImg.push_back( imgCornersVec[i] );
+            }
+            else
+            {
+                trainImg.push_back( imgCornersVec[i] );
+            }
+        }
+
+        vector< vector<cv::Point3f> > trainObj( trainImg.size(), mDefObjCorners );
+        vector< vector<cv::Point3f> > testObj( testImg.size(), mDefObjCorners );
+
+        cv::Mat K = cand.K.clone();
+        cv::Mat D = cand.D.clone();
+
+        // Fold solves are not traced: nobody reads their trajectory
+        double err = calibrate( trainObj, trainImg, mImgSize, model, false, K, D, NULL, maxIter, 0 );
+
+        if( !std::isnan(err) )
+        {
+            try
+            {
+                cand.heldOutErr = viewsReprojErr( testObj, testImg, model, K, D );
+            }
+            catch( cv::Exception& ex )
+            {
+                qDebug() << "Held-out error failed:" << ex.what();
+            }
+
+            // The final solve starts from the training result
+            cand.K = K;
+            cand.D = D;
+            useGuess = true;
+        }
+    }
+    // <<<<< Training solve and held-out error
+
+    vector< vector<cv::Point3f> > objCornersVec( imgCornersVec.size(), mDefObjCorners );
+
+    cand.reprojErr = calibrate( objCornersVec, imgCornersVec, mImgSize, model, useGuess, cand.K, cand.D,
+                                &cand.stats, maxIter, traceStep );
+
+    cand.valid = !std::isnan( cand.reprojErr );
+
+    return cand;
+}
+
+vector<ModelCandidate> QCameraCalibrate::getModelCandidates()
+{
+    mCandidatesMutex.lock();
+    vector<ModelCandidate> candidates = mCandidates;
+    mCandidatesMutex.unlock();
+
+    return candidates;
+}
+
+CameraModel QCameraCalibrate::getRecommendedModel()
+{
+    mCandidatesMutex.lock();
+    CameraModel model = mRecommendedModel;
+    mCandidatesMutex.unlock();
+
+    return model;
+}
+
+bool QCameraCalibrate::applyModel( CameraModel model )
+{
+    ModelCandidate cand;
+    bool found = false;
+
+    mCandidatesMutex.lock();
+    for( size_t i=0; i<mCandidates.size(); i++ )
+    {
+        if( mCandidates[i].model==model && mCandidates[i].valid )
+        {
+            cand = mCandidates[i];
+            found = true;
+        }
+    }
+    mCandidatesMutex.unlock();
+
+    if( !found || !mUndistort )
+        return false;
+
+    mMutex.lock();
+
+    cv::Size imgSize;
+    bool fisheye;
+    cv::Mat K,D;
+    double alpha;
+
+    mUndistort->getCameraParams( imgSize, fisheye, K, D, alpha );
+
+    mModel = model;
+    mReprojErr = cand.reprojErr;
+
+    mUndistort->setCameraParams( mImgSize, model==ModelFisheye, cand.K, cand.D, alpha );
+    mCoeffReady = true;
+
+    emit newCameraParams( cand.K.clone(), cand.D.clone(), mRefined, mReprojErr );
+
+    mMutex.unlock();
+
+    return true;
+}
+
+const char* QCameraCalibrate::modelName( CameraModel model )
+{
+    switch( model )
+    {
+    case ModelPinhole5:
+        return "Pinhole (5)";
+    case ModelRational:
+        return "Rational (8)";
+    case ModelThinPrism:
+        return "Thin prism (12)";
+    case ModelFisheye:
+        return "FishEye (4)";
+    default:
+        return "Unknown";
+    }
+}
+
+double QCameraCalibrate::calibrate( const vector< vector<cv::Point3f> >& objCornersVec,
+                                    const vector< vector<cv::Point2f> >& imgCornersVec,
+                                    cv::Size imgSize, CameraModel model, bool useGuess, cv::Mat& K, cv::Mat& D,
+                                    SolveStats* stats, int maxIter, int traceStep, bool fixHighOrder )
+{
+    QElapsedTimer wallTimer;
+    wallTimer.start();
+    double cpuStart = threadCpuMsec();
+
+    if( maxIter <= 0 )
+    {
+        maxIter = (model==ModelFisheye)?100:30; // OpenCV defaults
+    }
+
+    vector<double> trajectory;
+    SolveStats::Termination termination = SolveStats::TermNotTraced;
+    int iterations = -1;
+    double reprojErr = NAN;
+
+    try
+    {
+        cv::Mat startK = K.clone();
+        cv::Mat startD = D.clone();
+
+        // A single uninterrupted solve: restarting it would reset the LM damping and the
+        // extrinsics, so the telemetry would change the result
+        reprojErr = calibrateStep( objCornersVec, imgCornersVec, imgSize, model, useGuess, maxIter,
+                                   fixHighOrder, K, D );
+
+        // >>>>> Error trajectory: probe solves from the same start, capped every traceStep iterations
+        // The solver is deterministic, so a probe follows the path of the full solve up to its cap.
+        // Their results are discarded
+        if( traceStep>0 && traceStep<maxIter )
+        {
+            termination = SolveStats::TermMaxIter;
+            iterations = maxIter;
+
+            for( int probeIter=traceStep; probeIter<maxIter; probeIter+=traceStep )
+            {
+                cv::Mat probeK = startK.clone();
+                cv::Mat probeD = startD.clone();
+
+                double err = calibrateStep( objCornersVec, imgCornersVec, imgSize, model, useGuess, probeIter,
+                                            fixHighOrder, probeK, probeD );
+                trajectory.push_back( err );
+
+                if( fabs(err-reprojErr) <= SOLVE_CONVERGED_EPS*reprojErr )
+                {
+                    // Converged within this step, its iterations included
+                    termination = SolveStats::TermConverged;
+                    iterations = probeIter;
+                    break;
+                }
+            }
+
+            if( termination!=SolveStats::TermConverged )
+                trajectory.push_back( reprojErr );
+        }
+        // <<<<< Error trajectory: probe solves from the same start, capped every traceStep iterations
+    }
+    catch( cv::Exception& ex )
+    {
+        qDebug() << "Calibration failed:" << ex.what();
+
+        termination = SolveStats::TermFailed;
+        reprojErr = NAN;
+    }
+
+    if( stats )
+    {
+        stats->wallMsec = wallTimer.nsecsElapsed()/1e6;
+        stats->cpuMsec = threadCpuMsec()-cpuStart;
+        stats->iterations = iterations;
+        stats->maxIterations = maxIter;
+        stats->views = imgCornersVec.size();
+        stats->corners = 0;
+        for( size_t i=0; i<imgCornersVec.size(); i++ )
+        {
+            stats->corners += imgCornersVec[i].size();
+        }
+        stats->model = model;
+        stats->useGuess = useGuess;
+        stats->termination = termination;
+        stats->reprojErr = reprojErr;
+        stats->errTrajectory = trajectory;
+    }
+
+    return reprojErr;
+}
+
+double QCameraCalibrate::calibrateStep( const vector< vector<cv::Point3f> >& objCornersVec,
+                                        const vector< vector<cv::Point2f> >& imgCornersVec,
+                                        cv::Size imgSize, CameraModel model, bool useGuess, int maxIter,
+                                        bool fixHighOrder, cv::Mat& K, cv::Mat& D )
+{
+    vector<cv::Mat> rvecs;
+    vector<cv::Mat> tvecs;
+
+    double reprojErr;
+
+    cv::TermCriteria criteria( cv::TermCriteria::COUNT+cv::TermCriteria::EPS, maxIter, DBL_EPSILON );
+
+    if( model==ModelFisheye )
+    {
+        // >>>>> Calibration flags
+        int calibFlags = cv::fisheye::CALIB_FIX_SKEW;
+        if( useGuess )
+        {
+            calibFlags |= cv::fisheye::CALIB_USE_INTRINSIC_GUESS;
+        }
+        if( fixHighOrder )
+        {
+            calibFlags |= cv::fisheye::CALIB_FIX_K3 | cv::fisheye::CALIB_FIX_K4;
+        }
+        // <<<<< Calibration flags
+
+        // FishEye model wants only 4 distorsion parameters
+        cv::Mat feDist = resizeCoeffs( D, 4 );
+
+        reprojErr = cv::fisheye::calibrate( objCornersVec, imgCornersVec, imgSize,
+                                            K, feDist, rvecs, tvecs, calibFlags, criteria );
+
+        D = resizeCoeffs( feDist, 8 );
+    }
+    else
+    {
+        // >>>>> Calibration flags
+        int calibFlags = 0;
+        int coeffCount = 5;
+
+        if( model==ModelRational )
+        {
+            calibFlags = CV_CALIB_RATIONAL_MODEL; // Using Camera model with 8 distorsion parameters
+            coeffCount = 8;
+        }
+        else if( model==ModelThinPrism )
+        {
+            calibFlags = CV_CALIB_RATIONAL_MODEL | CV_CALIB_THIN_PRISM_MODEL;
+            coeffCount = 12;
+        }
+
+        if( useGuess )
+        {
+            calibFlags |= CV_CALIB_USE_INTRINSIC_GUESS;
+        }
+        if( fixHighOrder )
+        {
+            // Only k1, k2, p1 and p2 are estimated
+            calibFlags |= CV_CALIB_FIX_K3 | CV_CALIB_FIX_K4 | CV_CALIB_FIX_K5 | CV_CALIB_FIX_K6;
+
+            if( model==ModelThinPrism )
+            {
+                calibFlags |= CV_CALIB_FIX_S1_S2_S3_S4;
+            }
+        }
+        // <<<<< Calibration flags
+
+        cv::Mat dist = resizeCoeffs( D, coeffCount );
+
+        reprojErr = cv::calibrateCamera( objCornersVec, imgCornersVec, imgSize,
+                                         K, dist, rvecs, tvecs, calibFlags, criteria );
+
+        D = resizeCoeffs( dist, coeffCount<8?8:coeffCount );
+    }
+
+    return reprojErr;
+}
+
+double QCameraCalibrate::viewsReprojErr( const vector< vector<cv::Point3f> >& objCornersVec,
+                                         const vector< vector<cv::Point2f> >& imgCornersVec,
+                                         CameraModel model, const cv::Mat& K, const cv::Mat& D )
+{
+    double sqErr = 0.0;
+    size_t count = 0;
+
+    for( size_t v=0; v<imgCornersVec.size(); v++ )
+    {
+        cv::Mat rvec, tvec;
+        vector<cv::Point2f> projCorners;
+
+        if( model==ModelFisheye )
+        {
+            // The pose is estimated on the undistorted normalized corners
+            cv::Mat feDist = resizeCoeffs( D, 4 );
+
+            vector<cv::Point2f> normCorners;
+            cv::fisheye::undistortPoints( imgCornersVec[v], normCorners, K, feDist );
+
+            cv::solvePnP( objCornersVec[v], normCorners, cv::Mat::eye(3, 3, CV_64F), cv::Mat(), rvec, tvec );
+            cv::fisheye::projectPoints( objCornersVec[v], projCorners, rvec, tvec, K, feDist );
+        }
+        else
+        {
+            cv::solvePnP( objCornersVec[v], imgCornersVec[v], K, D, rvec, tvec );
+            cv::projectPoints( objCornersVec[v], rvec, tvec, K, D, projCorners );
+        }
+
+        for( size_t i=0; i<projCorners.size(); i++ )
+        {
+            cv::Point2f diff = projCorners[i]-imgCornersVec[v][i];
+            sqErr += diff.dot(diff);
+        }
+
+        count += projCorners.size();
+    }
+
+    if( count==0 )
+        return NAN;
+
+    return sqrt( sqErr/count );
+}
+
+bool QCameraCalibrate::detectChessboard( const cv::Mat& frame, cv::Size cbSize, vector<cv::Point2f>& corners )
+{
+    cv::Mat gray;
+
+    if( frame.channels() == 1 )
+    {
+        gray = frame;
+    }
+    else
+    {
+        cv::cvtColor( frame, gray,  CV_BGR2GRAY );
+    }
+
+    corners.clear();
+
+    //CALIB_CB_FAST_CHECK saves a lot of time on images
+    //that do not contain any chessboard corners
+    bool found = cv::findChessboardCorners( gray, cbSize, corners,
+                                            cv::CALIB_CB_ADAPTIVE_THRESH + cv::CALIB_CB_NORMALIZE_IMAGE
+                                            + cv::CALIB_CB_FAST_CHECK);
+
+    if( !found )
+        return false;
+
+    cv::cornerSubPix( gray, corners, cv::Size(11, 11), cv::Size(-1, -1),
+                      cv::TermCriteria(CV_TERMCRIT_EPS + CV_TERMCRIT_ITER, 30, 0.1));
+
+    return true;
+}
+
+bool QCameraCalibrate::saveCameraParams( string fileName )
+{
+    if( !mUndistort )
+        return false;
+
+    return mUndistort->saveCameraParams( fileName );
+}
+
+cv::Mat QCameraCalibrate::undistort(cv::Mat& raw)
+{
+    if( !mCoeffReady || !mUndistort )
+        return cv::Mat();
+
+    return mUndistort->undistort( raw );
+}
+
+bool QCameraCalibrate::undistort( const cv::Mat& raw, cv::Mat& dst )
+{
+    if( !mCoeffReady || !mUndistort )
+        return false;
+
+    return mUndistort->undistort( raw, dst );
+}
+
+bool QCameraCalibrate::undistortDisplay( const cv::Mat& raw, cv::Mat& dst )
+{
+    if( !mCoeffReady || !mUndistort )
+        return false;
+
+    return mUndistort->undistortDisplay( raw, dst );
+}
+
+void QCameraCalibrate::subsampleCorners( const vector<cv::Point2f>& imgCorners, vector<cv::Point2f>& subImg,
+                                         vector<cv::Point3f>& subObj )
+{
+    subImg.clear();
+    subObj.clear();
+
+    for( int r=0; r<mCbSize.height; r++ )
+    {
+        if( r%2!=0 && r!=mCbSize.height-1 )
+            continue;
+
+        for( int c=0; c<mCbSize.width; c++ )
+        {
+            if( c%2!=0 && c!=mCbSize.width-1 )
+                continue;
+
+            int idx = r*mCbSize.width+c;
+
+            subImg.push_back( imgCorners[idx] );
+            subObj.push_back( mDefObjCorners[idx] );
+        }
+    }
+}
+
+void QCameraCalibrate::create3DChessboardCorners( cv::Size boardSize, double squareSize )
+{
+    mDefObjCorners = chessboardCorners3D( boardSize, squareSize );
+}
+
+vector<cv::Point3f> QCameraCalibrate::chessboardCorners3D( cv::Size boardSize, double squareSize )
+{
+    // This function creates the 3D points of your chessboard in its own coordinate system
+    double width = (boardSize.width-1)*squareSize;
+    double height = (boardSize.height-1)*squareSize;
+
+    vector<cv::Point3f> corners;
+
+    for( int i = 0; i < boardSize.height; i++ )
+    {
+        for( int j = 0; j < boardSize.width; j++ )
+        {
+            corners.push_back(cv::Point3d(double(j*squareSize)-width, double(i*squareSize)-height, 0.0));
+        }
+    }
+
+    return corners;
+}
@@ -0,0 +1,415 @@
+#include "undistortmapbuilder.h"
+#include "distortionmodels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+using namespace std;
+
+#define MAP_TAB_BITS 5                          // cv::INTER_BITS
+#define MAP_TAB_SIZE (1<<MAP_TAB_BITS)          // cv::INTER_TAB_SIZE
+
+#define MAP_STRIPE_ROWS 16
+
+// >>>>> Sparse grid
+#define MAP_GRID_MIN_STEP 4
+#define MAP_GRID_MAX_STEP 64
+// <<<<< Sparse grid
+
+namespace
+{
+
+/// Stripe of map rows for one distortion model
+template<class Model>
+class MapBuildBody : public cv::ParallelLoopBody
+{
+public:
+    MapBuildBody( const Model& model, const double* k, const double* ir, cv::Mat& map1, cv::Mat& map2,
+                  const std::atomic<bool>* abort )
+        : mModel(model), mMap1(map1), mMap2(map2), mAbort(abort)
+    {
+        copy( k, k+9, mK );
+        copy( ir, ir+9, mIR );
+    }
+
+    void operator()( const cv::Range& range ) const override
+    {
+        const double fx = mK[0];
+        const double fy = mK[4];
+        const double cx = mK[2];
+        const double cy = mK[5];
+
+        LaneVec laneIdx;
+        for( int k=0; k<MAP_LANES; k++ )
+        {
+            laneIdx[k] = k;
+        }
+
+        for( int y=range.start; y<range.end; y++ )
+        {
+            if( mAbort && *mAbort )
+                return;
+
+            short* m1 = mMap1.ptr<short>(y);
+            ushort* m2 = mMap2.ptr<ushort>(y);
+
+            // Ray of the first pixel of the row
+            double x0 = y*mIR[1] + mIR[2];
+            double y0 = y*mIR[4] + mIR[5];
+            double w0 = y*mIR[7] + mIR[8];
+
+            for( int x=0; x<mMap1.cols; x+=MAP_LANES )
+            {
+                LaneVec j = x + laneIdx;
+
+                LaneVec iw = 1.0/(w0 + j*mIR[6]);
+                LaneVec px = (x0 + j*mIR[0])*iw;
+                LaneVec py = (y0 + j*mIR[3])*iw;
+
+                LaneVec xd, yd;
+                mModel.project( px, py, xd, yd );
+
+                LaneVec u = (fx*xd + cx)*MAP_TAB_SIZE;
+                LaneVec v = (fy*yd + cy)*MAP_TAB_SIZE;
+
+                // >>>>> Fixed point, as cv::initUndistortRectifyMap
+                int n = min( MAP_LANES, mMap1.cols-x );
+
+                for( int k=0; k<n; k++ )
+                {
+                    int iu = cv::saturate_cast<int>( u[k] );
+                    int iv = cv::saturate_cast<int>( v[k] );
+
+                    m1[2*(x+k)] = cv::saturate_cast<short>( iu >> MAP_TAB_BITS );
+                    m1[2*(x+k)+1] = cv::saturate_cast<short>( iv >> MAP_TAB_BITS );
+                    m2[x+k] = static_cast<ushort>( (iv & (MAP_TAB_SIZE-1))*MAP_TAB_SIZE + (iu & (MAP_TAB_SIZE-1)) );
+                }
+                // <<<<< Fixed point, as cv::initUndistortRectifyMap
+            }
+        }
+    }
+
+private:
+    Model mModel;
+    double mK[9];
+    double mIR[9];  ///< Inverse of newK*R: pixel to ray
+
+    cv::Mat& mMap1;
+    cv::Mat& mMap2;
+
+    const std::atomic<bool>* mAbort;
+};
+
+/// Rows of the grid for one distortion model
+template<class Model>
+class GridBuildBody : public cv::ParallelLoopBody
+{
+public:
+    GridBuildBody( const Model& model, const double* k, const double* ir, int step, cv::Mat& grid,
+                   const std::atomic<bool>* abort )
+        : mModel(model), mStep(step), mGrid(grid), mAbort(abort)
+    {
+        copy( k, k+9, mK );
+        copy( ir, ir+9, mIR );
+    }
+
+    void operator()( const cv::Range& range ) const override
+    {
+        LaneVec laneIdx;
+        for( int k=0; k<MAP_LANES; k++ )
+        {
+            laneIdx[k] = k;
+        }
+
+        for( int j=range.start; j<range.end; j++ )
+        {
+            if( mAbort && *mAbort )
+                return;
+
+            float* g = mGrid.ptr<float>(j);
+            LaneVec py = laneSet( static_cast<double>(j*mStep) );
+
+            for( int i=0; i<mGrid.cols; i+=MAP_LANES )
+            {
+                LaneVec px = (i + laneIdx)*static_cast<double>(mStep);
+
+                LaneVec u, v;
+                projectPixels( mModel, mK, mIR, px, py, u, v );
+
+                int n = min( MAP_LANES, mGrid.cols-i );
+
+                for( int k=0; k<n; k++ )
+                {
+                    g[2*(i+k)] = static_cast<float>( u[k] );
+                    g[2*(i+k)+1] = static_cast<float>( v[k] );
+                }
+            }
+        }
+    }
+
+private:
+    Model mModel;
+    double mK[9];
+    double mIR[9];
+    int mStep;
+
+    cv::Mat& mGrid;
+
+    const std::atomic<bool>* mAbort;
+};
+
+/// Largest distance between the interpolated grid and the model on every row of cells. The
+/// bilinear error of a smooth field peaks in the middle of the cells and of their sides: only
+/// these points are checked, on the part of the cell inside the image
+template<class Model>
+class GridErrorBody : public cv::ParallelLoopBody
+{
+public:
+    GridErrorBody( const Model& model, const double* k, const double* ir, int step, cv::Size size,
+                   const cv::Mat& grid, vector<double>& rowErrors )
+        : mModel(model), mStep(step), mSize(size), mGrid(grid), mRowErrors(rowErrors)
+    {
+        copy( k, k+9, mK );
+        copy( ir, ir+9, mIR );
+    }
+
+    void operator()( const cv::Range& range ) const override
+    {
+        vector<double> px, py, gu, gv;
+
+        for( int j=range.start; j<range.end; j++ )
+        {
+            mRowErrors[j] = 0.0;
+
+            double ya = j*mStep;
+            double yb = min( ya+mStep, mSize.height-1.0 );
+
+            if( ya > mSize.height-1 )
+                continue;
+
+            const float* g0 = mGrid.ptr<float>(j);
+            const float* g1 = mGrid.ptr<float>(j+1);
+
+            // >>>>> Checked points of the row of cells, with their interpolated value
+            px.clear();
+            py.clear();
+            gu.clear();
+            gv.clear();
+
+            for( int i=0; i*mStep <= mSize.width-1; i++ )
+            {
+                double xa = i*mStep;
+                double xb = min( xa+mStep, mSize.width-1.0 );
+                double xm = 0.5*(xa+xb);
+                double ym = 0.5*(ya+yb);
+
+                double ptX[5] = { xm, xa, xm, xb, xm };
+                double ptY[5] = { ym, ym, ya, ym, yb };
+
+                // Right and bottom sides only where the image clips the cell, else they belong to the next one
+                int count = 3;
+                if( xb < xa+mStep )
+                {
+                    count = 4;
+                }
+                if( yb < ya+mStep )
+                {
+                    ptX[count] = xm;
+                    ptY[count] = yb;
+                    count++;
+                }
+
+                for( int n=0; n<count; n++ )
+                {
+                    double tx = (ptX[n]-xa)/mStep;
+                    double ty = (ptY[n]-ya)/mStep;
+
+                    px.push_back( ptX[n] );
+                    py.push_back( ptY[n] );
+                    gu.push_back( (1.0-ty)*((1.0-tx)*g0[2*i] + tx*g0[2*i+2]) + ty*((1.0-tx)*g1[2*i] + tx*g1[2*i+2]) );
+                    gv.push_back( (1.0-ty)*((1.0-tx)*g0[2*i+1] + tx*g0[2*i+3]) + ty*((1.0-tx)*g1[2*i+1] + tx*g1[2*i+3]) );
+                }
+            }
+            // <<<<< Checked points of the row of cells, with their interpolated value
+
+            double maxErr2 = 0.0;
+
+            for( size_t n=0; n<px.size(); n+=MAP_LANES )
+            {
+                LaneVec x, y;
+                for( int k=0; k<MAP_LANES; k++ )
+                {
+                    size_t idx = min( n+k, px.size()-1 );
+                    x[k] = px[idx];
+                    y[k] = py[idx];
+                }
+
+                LaneVec u, v;
+                projectPixels( mModel, mK, mIR, x, y, u, v );
+
+                for( int k=0; k<MAP_LANES && n+k<px.size(); k++ )
+                {
+                    double du = u[k]-gu[n+k];
+                    double dv = v[k]-gv[n+k];
+
+                    maxErr2 = max( maxErr2, du*du + dv*dv );
+                }
+            }
+
+            mRowErrors[j] = sqrt( maxErr2 );
+        }
+    }
+
+private:
+    Model mModel;
+    double mK[9];
+    double mIR[9];
+    int mStep;
+    cv::Size mSize;
+
+    const cv::Mat& mGrid;
+    vector<double>& mRowErrors;
+};
+
+template<class Model>
+void buildWith( const Model& model, const MapParams& p, cv::Mat& map1, cv::Mat& map2,
+                const std::atomic<bool>* abort )
+{
+    cv::parallel_for_( cv::Range(0, map1.rows), MapBuildBody<Model>( model, p.k, p.ir, map1, map2, abort ),
+                       (map1.rows+MAP_STRIPE_ROWS-1)/MAP_STRIPE_ROWS );
+}
+
+template<class Model>
+void buildGridWith( const Model& model, const MapParams& p, int step, cv::Mat& grid, const std::atomic<bool>* abort )
+{
+    cv::parallel_for_( cv::Range(0, grid.rows), GridBuildBody<Model>( model, p.k, p.ir, step, grid, abort ) );
+}
+
+template<class Model>
+double gridErrorWith( const Model& model, const MapParams& p, int step, cv::Size size, const cv::Mat& grid )
+{
+    vector<double> rowErrors( grid.rows-1, 0.0 );
+
+    cv::parallel_for_( cv::Range(0, grid.rows-1), GridErrorBody<Model>( model, p.k, p.ir, step, size, grid, rowErrors ) );
+
+    return *max_element( rowErrors.begin(), rowErrors.end() );
+}
+
+bool validGridStep( int step )
+{
+    return step>=MAP_GRID_MIN_STEP && step<=MAP_GRID_MAX_STEP && (step & (step-1))==0;
+}
+
+} // namespace
+
+bool buildUndistortMaps( const cv::Mat& K, const cv::Mat& D, const cv::Mat& R, const cv::Mat& newK,
+                         cv::Size size, bool fishEye, cv::Mat& map1, cv::Mat& map2,
+                         const std::atomic<bool>* abort )
+{
+    MapParams p;
+
+    if( size.width<1 || size.height<1 || !makeParams( K, D, R, newK, fishEye, p ) )
+        return false;
+
+    map1.create( size, CV_16SC2 );
+    map2.create( size, CV_16UC1 );
+
+    switch( modelType(p) )
+    {
+    case ModelType::Fisheye:
+        buildWith( FisheyeModel(p.d), p, map1, map2, abort );
+        break;
+    case ModelType::ThinPrism:
+        buildWith( ThinPrismModel(p.d), p, map1, map2, abort );
+        break;
+    case ModelType::Rational:
+        buildWith( RationalModel(p.d), p, map1, map2, abort );
+        break;
+    case ModelType::Polynomial:
+        buildWith( PolynomialModel(p.d), p, map1, map2, abort );
+        break;
+    }
+
+    return !(abort && *abort);
+}
+
+cv::Size undistortGridSize( cv::Size size, int gridStep )
+{
+    return cv::Size( (size.width-1)/gridStep + 2, (size.height-1)/gridStep + 2 );
+}
+
+bool buildUndistortGrid( const cv::Mat& K, const cv::Mat& D, const cv::Mat& R, const cv::Mat& newK,
+                         cv::Size size, bool fishEye, int gridStep, cv::Mat& grid,
+                         const std::atomic<bool>* abort )
+{
+    MapParams p;
+
+    if( size.width<1 || size.height<1 || !validGridStep(gridStep) || !makeParams( K, D, R, newK, fishEye, p ) )
+        return false;
+
+    grid.create( undistortGridSize( size, gridStep ), CV_32FC2 );
+
+    switch( modelType(p) )
+    {
+    case ModelType::Fisheye:
+        buildGridWith( FisheyeModel(p.d), p, gridStep, grid, abort );
+        break;
+    case ModelType::ThinPrism:
+        buildGridWith( ThinPrismModel(p.d), p, gridStep, grid, abort );
+        break;
+    case ModelType::Rational:
+        buildGridWith( RationalModel(p.d), p, gridStep, grid, abort );
+        break;
+    case ModelType::Polynomial:
+        buildGridWith( PolynomialModel(p.d), p, gridStep, grid, abort );
+        break;
+    }
+
+    return !(abort && *abort);
+}
+
+double undistortGridError( const cv::Mat& K, const cv::Mat& D, const cv::Mat& R, const cv::Mat& newK,
+                           cv::Size size, bool fishEye, int gridStep, const cv::Mat& grid )
+{
+    MapParams p;
+
+    if( !validGridStep(gridStep) || grid.type()!=CV_32FC2 || grid.size()!=undistortGridSize( size, gridStep ) ||
+            !makeParams( K, D, R, newK, fishEye, p ) )
+        return -1.0;
+
+    switch( modelType(p) )
+    {
+    case ModelType::Fisheye:
+        return gridErrorWith( FisheyeModel(p.d), p, gridStep, size, grid );
+    case ModelType::ThinPrism:
+        return gridErrorWith( ThinPrismModel(p.d), p, gridStep, size, grid );
+    case ModelType::Rational:
+        return gridErrorWith( RationalModel(p.d), p, gridStep, size, grid );
+    case ModelType::Polynomial:
+        return gridErrorWith( PolynomialModel(p.d), p, gridStep, size, grid );
+    }
+
+    return -1.0;
+}
+
+int selectUndistortGrid( const cv::Mat& K, const cv::Mat& D, const cv::Mat& R, const cv::Mat& newK,
+                         cv::Size size, bool fishEye, double maxError, cv::Mat& grid,
+                         const std::atomic<bool>* abort )
+{
+    // From the coarsest grid: the cost of the coarse attempts is a fraction of the finest one
+    for( int step=MAP_GRID_MAX_STEP; step>=MAP_GRID_MIN_STEP; step/=2 )
+    {
+        if( !buildUndistortGrid( K, D, R, newK, size, fishEye, step, grid, abort ) )
+            break;
+
+        double error = undistortGridError( K, D, R, newK, size, fishEye, step, grid );
+
+        if( error>=0.0 && error<=maxError )
+            return step;
+    }
+
+    grid.release();
+
+    return 0;
+}
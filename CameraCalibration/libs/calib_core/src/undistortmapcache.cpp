@@ -0,0 +1,440 @@
+#include "undistortmapcache.h"
+#include "cameraundistort.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+using namespace std;
+
+#define MAP_CACHE_VERSION 2         // 2: output view
+#define MAP_CACHE_ALIGN 4096        // Page size: the maps are mapped at aligned addresses
+#define MAP_CACHE_EXT ".maps"
+
+namespace
+{
+
+const char sMagic[8] = { 'C','C','M','A','P','S','\0','\0' };
+
+/// Parameters the maps depend on, stored in the header and compared byte by byte on load
+struct MapCacheParams
+{
+    int32_t width;
+    int32_t height;
+    int32_t outWidth;
+    int32_t outHeight;
+    int32_t roi[4];
+    int32_t fishEye;
+    int32_t distCount;
+    double alpha;
+    double K[9];
+    double D[12];
+};
+
+struct MapCacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t headerSize;
+    uint64_t key;
+
+    MapCacheParams params;
+    double newK[9];
+
+    int32_t map1Type;
+    int32_t map2Type;
+    uint64_t map1Offset;
+    uint64_t map1Step;
+    uint64_t map2Offset;
+    uint64_t map2Step;
+    uint64_t fileSize;
+};
+
+MapCacheParams makeParams( cv::Size imgSize, cv::Size outSize, cv::Rect roi, bool fishEye, const cv::Mat& intr,
+                           const cv::Mat& dist, double alpha )
+{
+    MapCacheParams params;
+    memset( &params, 0, sizeof(params) );
+
+    params.width = imgSize.width;
+    params.height = imgSize.height;
+    params.outWidth = outSize.width;
+    params.outHeight = outSize.height;
+    params.roi[0] = roi.x;
+    params.roi[1] = roi.y;
+    params.roi[2] = roi.width;
+    params.roi[3] = roi.height;
+    params.fishEye = fishEye?1:0;
+    params.alpha = alpha;
+
+    cv::Mat K64, D64;
+    intr.convertTo( K64, CV_64F );
+    dist.reshape( 1, static_cast<int>(dist.total()) ).convertTo( D64, CV_64F );
+
+    for( int i=0; i<9 && K64.rows==3 && K64.cols==3; i++ )
+    {
+        params.K[i] = K64.ptr<double>(i/3)[i%3];
+    }
+
+    params.distCount = min( D64.rows, 12 );
+    for( int i=0; i<params.distCount; i++ )
+    {
+        params.D[i] = D64.ptr<double>(i)[0];
+    }
+
+    return params;
+}
+
+/// FNV-1a
+uint64_t hashParams( const MapCacheParams& params )
+{
+    uint64_t hash = 14695981039346656037ull;
+
+    uint32_t version = MAP_CACHE_VERSION;
+    const unsigned char* bytes = reinterpret_cast<const unsigned char*>( &version );
+    for( size_t i=0; i<sizeof(version); i++ )
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+
+    bytes = reinterpret_cast<const unsigned char*>( &params );
+    for( size_t i=0; i<sizeof(params); i++ )
+    {
+        hash = (hash ^ bytes[i]) * 1099511628211ull;
+    }
+
+    return hash;
+}
+
+/// cv::Mat over a part of a file mapping. Every Mat (and its copies) holds a reference to the
+/// mapping in its UMatData, so the file stays mapped until the last one is released
+class MappedFileAllocator : public cv::MatAllocator
+{
+public:
+    cv::UMatData* allocate( int, const int*, int, void*, size_t*, int, cv::UMatUsageFlags ) const override
+    {
+        return NULL;
+    }
+
+    bool allocate( cv::UMatData*, int, cv::UMatUsageFlags ) const override
+    {
+        return false;
+    }
+
+    void deallocate( cv::UMatData* u ) const override
+    {
+        if( !u )
+            return;
+
+        delete static_cast< shared_ptr<const void>* >( u->userdata );
+        delete u;
+    }
+};
+
+const MappedFileAllocator& mappedFileAllocator()
+{
+    static const MappedFileAllocator sAllocator;
+    return sAllocator;
+}
+
+cv::Mat mappedMat( cv::Size size, int type, uchar* data, size_t step, const shared_ptr<const void>& mapping )
+{
+    cv::Mat m( size.height, size.width, type, data, step );
+
+    cv::UMatData* u = new cv::UMatData( &mappedFileAllocator() );
+    u->data = u->origdata = data;
+    u->size = step*size.height;
+    u->userdata = new shared_ptr<const void>( mapping );
+    u->refcount = 1;
+
+    m.u = u;
+
+    return m;
+}
+
+uint64_t alignUp( uint64_t value )
+{
+    return (value + MAP_CACHE_ALIGN-1)/MAP_CACHE_ALIGN*MAP_CACHE_ALIGN;
+}
+
+bool validHeader( const MapCacheHeader& hdr, uint64_t key, const MapCacheParams& params, uint64_t fileSize )
+{
+    if( memcmp( hdr.magic, sMagic, sizeof(sMagic) )!=0 || hdr.version!=MAP_CACHE_VERSION ||
+            hdr.headerSize!=sizeof(MapCacheHeader) || hdr.key!=key || hdr.fileSize!=fileSize )
+        return false;
+
+    if( memcmp( &hdr.params, &params, sizeof(params) )!=0 )
+        return false;
+
+    if( hdr.map1Type!=CV_16SC2 || hdr.map2Type!=CV_16UC1 )
+        return false;
+
+    // >>>>> Layout
+    uint64_t w = static_cast<uint64_t>(params.outWidth);
+    uint64_t h = static_cast<uint64_t>(params.outHeight);
+
+    if( hdr.map1Offset%MAP_CACHE_ALIGN!=0 || hdr.map2Offset%MAP_CACHE_ALIGN!=0 )
+        return false;
+
+    if( hdr.map1Step < w*2*sizeof(short) || hdr.map2Step < w*sizeof(ushort) )
+        return false;
+
+    if( hdr.map1Offset < sizeof(MapCacheHeader) || hdr.map1Offset + hdr.map1Step*h > hdr.map2Offset ||
+            hdr.map2Offset + hdr.map2Step*h > fileSize )
+        return false;
+    // <<<<< Layout
+
+    return true;
+}
+
+bool writeRows( FILE* f, const cv::Mat& mat )
+{
+    size_t rowBytes = mat.cols*mat.elemSize();
+
+    for( int y=0; y<mat.rows; y++ )
+    {
+        if( fwrite( mat.ptr(y), 1, rowBytes, f )!=rowBytes )
+            return false;
+    }
+
+    return true;
+}
+
+bool writePadding( FILE* f, uint64_t offset )
+{
+    static const char zeros[MAP_CACHE_ALIGN] = { 0 };
+
+    long pos = ftell( f );
+    if( pos<0 || static_cast<uint64_t>(pos) > offset )
+        return false;
+
+    size_t count = static_cast<size_t>( offset - static_cast<uint64_t>(pos) );
+
+    return fwrite( zeros, 1, count, f )==count;
+}
+
+} // namespace
+
+UndistortMapCache::UndistortMapCache( string dir, uint64_t maxBytes )
+{
+    mDir = dir;
+    mMaxBytes = maxBytes;
+}
+
+uint64_t UndistortMapCache::key( cv::Size imgSize, cv::Size outSize, cv::Rect roi, bool fishEye, const cv::Mat& intr,
+                                 const cv::Mat& dist, double alpha )
+{
+    return hashParams( makeParams( imgSize, outSize, roi, fishEye, intr, dist, alpha ) );
+}
+
+string UndistortMapCache::fileName( uint64_t key )
+{
+    char name[32];
+    snprintf( name, sizeof(name), "%016llx", static_cast<unsigned long long>(key) );
+
+    return mDir + "/" + name + MAP_CACHE_EXT;
+}
+
+bool UndistortMapCache::load( cv::Size imgSize, cv::Size outSize, cv::Rect roi, bool fishEye, const cv::Mat& intr,
+                              const cv::Mat& dist, double alpha, UndistortMaps& maps )
+{
+    MapCacheParams params = makeParams( imgSize, outSize, roi, fishEye, intr, dist, alpha );
+    uint64_t k = hashParams( params );
+    string name = fileName( k );
+
+    int fd = open( name.c_str(), O_RDONLY );
+    if( fd<0 )
+        return false;
+
+    struct stat st;
+    if( fstat( fd, &st )!=0 || st.st_size < static_cast<off_t>(sizeof(MapCacheHeader)) )
+    {
+        close( fd );
+        unlink( name.c_str() );
+        return false;
+    }
+
+    size_t len = static_cast<size_t>( st.st_size );
+
+    void* addr = mmap( NULL, len, PROT_READ, MAP_SHARED, fd, 0 );
+    close( fd );
+
+    if( addr==MAP_FAILED )
+        return false;
+
+    const MapCacheHeader* hdr = static_cast<const MapCacheHeader*>( addr );
+
+    if( !validHeader( *hdr, k, params, len ) )
+    {
+        munmap( addr, len );
+        unlink( name.c_str() );
+        return false;
+    }
+
+    // The first frame needs the whole maps
+    madvise( addr, len, MADV_WILLNEED );
+
+    // >>>>> Maps pointing into the mapping, unmapped with the last cv::Mat referencing it
+    shared_ptr<const void> mapping( addr, [len]( const void* p ) {
+        munmap( const_cast<void*>(p), len );
+    } );
+
+    uchar* base = static_cast<uchar*>( addr );
+
+    maps.imgSize = imgSize;
+    maps.fishEye = fishEye;
+    maps.alpha = alpha;
+    maps.outSize = outSize;
+    maps.roi = roi;
+    maps.gridStep = 0;
+    maps.newK = cv::Mat( 3, 3, CV_64F, const_cast<double*>(hdr->newK) ).clone();
+    maps.remap1 = mappedMat( outSize, CV_16SC2, base+hdr->map1Offset, hdr->map1Step, mapping );
+    maps.remap2 = mappedMat( outSize, CV_16UC1, base+hdr->map2Offset, hdr->map2Step, mapping );
+    // <<<<< Maps pointing into the mapping, unmapped with the last cv::Mat referencing it
+
+    // Eviction removes the least recently used files: a hit counts as a use
+    utimes( name.c_str(), NULL );
+
+    return true;
+}
+
+bool UndistortMapCache::store( const cv::Mat& intr, const cv::Mat& dist, const UndistortMaps& maps )
+{
+    if( maps.gridStep!=0 || maps.remap1.type()!=CV_16SC2 || maps.remap2.type()!=CV_16UC1 || maps.remap1.size()!=maps.outSize ||
+            maps.remap2.size()!=maps.outSize || maps.newK.empty() )
+        return false;
+
+    MapCacheParams params = makeParams( maps.imgSize, maps.outSize, maps.roi, maps.fishEye, intr, dist, maps.alpha );
+    uint64_t k = hashParams( params );
+    string name = fileName( k );
+
+    std::lock_guard<std::mutex> lock( mMutex );
+
+    if( access( name.c_str(), F_OK )==0 )
+        return true;
+
+    // >>>>> Header
+    MapCacheHeader hdr;
+    memset( &hdr, 0, sizeof(hdr) );
+
+    memcpy( hdr.magic, sMagic, sizeof(sMagic) );
+    hdr.version = MAP_CACHE_VERSION;
+    hdr.headerSize = sizeof(MapCacheHeader);
+    hdr.key = k;
+    hdr.params = params;
+
+    cv::Mat newK64;
+    maps.newK.convertTo( newK64, CV_64F );
+    for( int i=0; i<9; i++ )
+    {
+        hdr.newK[i] = newK64.ptr<double>(i/3)[i%3];
+    }
+
+    uint64_t rows = static_cast<uint64_t>(maps.outSize.height);
+
+    hdr.map1Type = CV_16SC2;
+    hdr.map2Type = CV_16UC1;
+    hdr.map1Offset = alignUp( sizeof(MapCacheHeader) );
+    hdr.map1Step = maps.remap1.cols*maps.remap1.elemSize();
+    hdr.map2Offset = alignUp( hdr.map1Offset + hdr.map1Step*rows );
+    hdr.map2Step = maps.remap2.cols*maps.remap2.elemSize();
+    hdr.fileSize = hdr.map2Offset + hdr.map2Step*rows;
+    // <<<<< Header
+
+    // >>>>> Written aside, readers only see complete files
+    string tmpName = name + ".XXXXXX";
+    vector<char> tmpBuf( tmpName.begin(), tmpName.end() );
+    tmpBuf.push_back( '\0' );
+
+    int fd = mkstemp( tmpBuf.data() );
+    if( fd<0 )
+        return false;
+
+    FILE* f = fdopen( fd, "wb" );
+    if( !f )
+    {
+        close( fd );
+        unlink( tmpBuf.data() );
+        return false;
+    }
+
+    bool ok = fwrite( &hdr, sizeof(hdr), 1, f )==1 &&
+              writePadding( f, hdr.map1Offset ) && writeRows( f, maps.remap1 ) &&
+              writePadding( f, hdr.map2Offset ) && writeRows( f, maps.remap2 );
+
+    ok = (fclose( f )==0) && ok;
+
+    if( !ok || rename( tmpBuf.data(), name.c_str() )!=0 )
+    {
+        unlink( tmpBuf.data() );
+        return false;
+    }
+    // <<<<< Written aside, readers only see complete files
+
+    evict();
+
+    return true;
+}
+
+void UndistortMapCache::evict()
+{
+    struct CacheFile
+    {
+        string path;
+        time_t mtime;
+        uint64_t size;
+    };
+
+    DIR* dir = opendir( mDir.c_str() );
+    if( !dir )
+        return;
+
+    vector<CacheFile> files;
+    uint64_t total = 0;
+
+    const size_t extLen = strlen( MAP_CACHE_EXT );
+
+    while( struct dirent* entry = readdir( dir ) )
+    {
+        string entryName = entry->d_name;
+
+        if( entryName.size()<=extLen || entryName.compare( entryName.size()-extLen, extLen, MAP_CACHE_EXT )!=0 )
+            continue;
+
+        CacheFile file;
+        file.path = mDir + "/" + entryName;
+
+        struct stat st;
+        if( stat( file.path.c_str(), &st )!=0 )
+            continue;
+
+        file.mtime = st.st_mtime;
+        file.size = static_cast<uint64_t>(st.st_size);
+
+        files.push_back( file );
+        total += file.size;
+    }
+
+    closedir( dir );
+
+    sort( files.begin(), files.end(), []( const CacheFile& a, const CacheFile& b ) {
+        return a.mtime < b.mtime;
+    } );
+
+    // The most recent file is always kept, even if alone it is over the limit
+    for( size_t i=0; i+1<files.size() && total>mMaxBytes; i++ )
+    {
+        if( unlink( files[i].path.c_str() )==0 )
+        {
+            total -= files[i].size;
+        }
+    }
+}
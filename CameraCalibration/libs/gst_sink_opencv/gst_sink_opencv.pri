@@ -10,10 +10,12 @@ INCLUDEPATH += $$INC
 
 HEADERS += \
             $$INC/gst_sink_opencv.hpp \
+            $$INC/framemailbox.h \
             $$INC/camerathread.h
 
 SOURCES += \
             $$SRC/gst_sink_opencv.cpp \
+            $$SRC/framemailbox.cpp \
             $$SRC/camerathread.cpp
 
 #-------------------------------------------------
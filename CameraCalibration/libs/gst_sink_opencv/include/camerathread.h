@@ -7,19 +7,24 @@
 
 #include <opencv2/core/core.hpp>
 #include "gst_sink_opencv.hpp"
+#include "framemailbox.h"
 
 class CameraThread : public QThread
 {
     Q_OBJECT
 
 public:
-    CameraThread( double fps );
+    /// SinkI420: the frames of the mailbox stay in the I420 layout of the decoder (CameraUndistort::undistortI420)
+    CameraThread( double fps, SinkFormat format=SinkBGR );
     ~CameraThread();
 
     double getBufPerc();
 
+    /// Frames go through a single slot instead of queued signals: the GUI takes the latest one
+    /// at its own pace, the frames it misses are dropped (getMailbox()->getDropCount())
+    FrameMailbox* getMailbox(){ return &mMailbox; }
+
 signals:
-    void newImage( cv::Mat frame );
     void cameraDisconnected();
     void cameraConnected();
 
@@ -30,6 +35,10 @@ private:
     GstSinkOpenCV* mImageSink;
 
     double mFps;
+
+    SinkFormat mFormat;
+
+    FrameMailbox mMailbox;
 };
 
 #endif // CAMERATHREAD_H
@@ -0,0 +1,35 @@
+#ifndef FRAMEMAILBOX_H
+#define FRAMEMAILBOX_H
+
+#include <opencv2/core/core.hpp>
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+
+/// Single frame slot between a producer thread and a consumer. post() replaces the frame not
+/// taken yet, so the consumer always gets the latest one and the latency stays bounded to one
+/// frame, however slow the consumer is. Replaced frames are counted as drops.
+class FrameMailbox
+{
+public:
+    FrameMailbox();
+
+    /// Stores a reference to frame: the producer must not write it afterwards
+    void post( const cv::Mat& frame );
+
+    /// Latest frame posted since the last call. Returns false if there is none
+    bool take( cv::Mat& frame );
+
+    uint64_t getPostCount(){ return mPostCount; }
+    uint64_t getDropCount(){ return mDropCount; }   ///< Frames replaced before being taken
+
+private:
+    std::mutex mMutex;
+    cv::Mat mFrame;     ///< Empty when taken
+
+    std::atomic<uint64_t> mPostCount;
+    std::atomic<uint64_t> mDropCount;
+};
+
+#endif // FRAMEMAILBOX_H
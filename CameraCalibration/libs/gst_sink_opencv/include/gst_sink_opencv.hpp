@@ -8,19 +8,33 @@
 
 #define FRAME_BUF_SIZE 5
 
+/// Format of the frames returned by getLastFrame
+enum SinkFormat
+{
+    SinkBGR = 0,    ///< CV_8UC3
+    SinkI420        ///< CV_8UC1, height*3/2 rows: Y then U and V planes (cv::COLOR_YUV2BGR_I420 layout)
+};
+
 class GstSinkOpenCV
 {
 public:
-    static GstSinkOpenCV* Create(std::string input_pipeline, size_t bufSize = FRAME_BUF_SIZE, int timeout_sec=15, bool debug=false );
+    /// SinkI420 keeps the frames of a YUV source in YUV, without the conversion to BGR. The frame
+    /// sizes must be even
+    static GstSinkOpenCV* Create(std::string input_pipeline, size_t bufSize = FRAME_BUF_SIZE, int timeout_sec=15, bool debug=false,
+                                 SinkFormat format=SinkBGR );
     ~GstSinkOpenCV();
 
     cv::Mat getLastFrame();
     double getBufPerc();
 
 private:
-    GstSinkOpenCV(std::string input_pipeline, int bufSize, bool debug );
+    GstSinkOpenCV(std::string input_pipeline, int bufSize, bool debug, SinkFormat format );
     bool init(int timeout_sec);
 
+    /// Frame of mWidth x mHeight pixels from a buffer with the default GStreamer strides.
+    /// Empty if the buffer is too small
+    cv::Mat copyFrame( const GstMapInfo& map );
+
     static GstFlowReturn on_new_sample_from_sink(GstElement* elt, GstSinkOpenCV* sinkData );
 
 protected:
@@ -38,6 +52,8 @@ private:
     int mHeight;
     int mChannels;
 
+    SinkFormat mFormat;
+
     bool mDebug;
 
     std::mutex mFrameMutex;
@@ -5,13 +5,14 @@
 
 using namespace std;
 
-CameraThread::CameraThread( double fps)
+CameraThread::CameraThread( double fps, SinkFormat format )
     : QThread(NULL)
     , mImageSink(NULL)
 {
     qRegisterMetaType<cv::Mat>( "cv::Mat" );
 
     mFps = fps;
+    mFormat = format;
 }
 
 CameraThread::~CameraThread()
@@ -40,7 +41,7 @@ void CameraThread::run()
                            "rtph264depay ! h264parse ! avdec_h264";
 #endif
 
-    mImageSink = GstSinkOpenCV::Create( pipeline, 10, 5 );
+    mImageSink = GstSinkOpenCV::Create( pipeline, 10, 5, false, mFormat );
 
     if(!mImageSink)
     {
@@ -63,7 +64,7 @@ void CameraThread::run()
 
         if( !frame.empty() && !frame.rows==0 && !frame.cols==0 )
         {
-            emit newImage( frame );
+            mMailbox.post( frame );
             msleep( 1000.0/mFps );
         }
         else
@@ -0,0 +1,38 @@
+#include "framemailbox.h"
+
+FrameMailbox::FrameMailbox()
+{
+    mPostCount = 0;
+    mDropCount = 0;
+}
+
+void FrameMailbox::post( const cv::Mat& frame )
+{
+    cv::Mat replaced;
+
+    {
+        std::lock_guard<std::mutex> lock( mMutex );
+
+        if( !mFrame.empty() )
+            mDropCount++;
+
+        // The replaced frame is released out of the lock
+        replaced = mFrame;
+        mFrame = frame;
+    }
+
+    mPostCount++;
+}
+
+bool FrameMailbox::take( cv::Mat& frame )
+{
+    std::lock_guard<std::mutex> lock( mMutex );
+
+    if( mFrame.empty() )
+        return false;
+
+    frame = mFrame;
+    mFrame.release();
+
+    return true;
+}
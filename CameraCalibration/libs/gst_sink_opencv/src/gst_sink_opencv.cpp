@@ -9,7 +9,7 @@
 
 using namespace std;
 
-GstSinkOpenCV::GstSinkOpenCV( std::string input_pipeline, int bufSize, bool debug )
+GstSinkOpenCV::GstSinkOpenCV( std::string input_pipeline, int bufSize, bool debug, SinkFormat format )
 {
     mFrameBufferSize = bufSize;
 
@@ -18,6 +18,8 @@ GstSinkOpenCV::GstSinkOpenCV( std::string input_pipeline, int bufSize, bool debu
     mSink = NULL;
 
     mDebug = debug;
+
+    mFormat = format;
 }
 
 GstSinkOpenCV::~GstSinkOpenCV()
@@ -38,9 +40,9 @@ GstSinkOpenCV::~GstSinkOpenCV()
 
 }
 
-GstSinkOpenCV* GstSinkOpenCV::Create(string input_pipeline, size_t bufSize, int timeout_sec, bool debug )
+GstSinkOpenCV* GstSinkOpenCV::Create(string input_pipeline, size_t bufSize, int timeout_sec, bool debug, SinkFormat format )
 {
-    GstSinkOpenCV* gstSinkOpencv = new GstSinkOpenCV( input_pipeline, bufSize, debug );
+    GstSinkOpenCV* gstSinkOpencv = new GstSinkOpenCV( input_pipeline, bufSize, debug, format );
 
     if( !gstSinkOpencv->init( timeout_sec ) )
     {
@@ -56,8 +58,9 @@ bool GstSinkOpenCV::init( int timeout_sec )
     GError *error = NULL;
     GstStateChangeReturn ret;
 
-    mPipelineStr += " ! videoconvert ! " \
-                    "appsink name=sink caps=\"video/x-raw,format=BGR\"";
+    // videoconvert is a passthrough when the source already delivers the requested format
+    mPipelineStr += " ! videoconvert ! appsink name=sink caps=\"video/x-raw,format=";
+    mPipelineStr += (mFormat==SinkI420) ? "I420\"" : "BGR\"";
 
     cout << endl << "Input pipeline:" << endl << mPipelineStr << endl << endl;
 
@@ -148,14 +151,20 @@ bool GstSinkOpenCV::init( int timeout_sec )
         {
             mWidth = width;
             mHeight = height;
-            mChannels = map.size / (mWidth*mHeight);
+            mChannels = (mFormat==SinkI420) ? 1 : 3;
 
-            if( mFrameBuffer.size()<mFrameBufferSize )
+            if( mFormat==SinkI420 && (mWidth%2!=0 || mHeight%2!=0) )
             {
-                cv::Mat frame( mHeight, mWidth, CV_8UC3 );
+                g_print ("Only even frame sizes are supported in I420! \n");
+                gst_buffer_unmap (buffer, &map);
+                gst_sample_unref (sample);
+                return false;
+            }
 
-                memcpy( frame.data, map.data, map.size );
+            cv::Mat frame = copyFrame( map );
 
+            if( !frame.empty() && mFrameBuffer.size()<mFrameBufferSize )
+            {
                 mFrameMutex.lock();
                 mFrameBuffer.push( frame );
                 mFrameMutex.unlock();
@@ -239,11 +248,12 @@ GstFlowReturn GstSinkOpenCV::on_new_sample_from_sink( GstElement* elt, GstSinkOp
 
                 sinkData->mWidth = width;
                 sinkData->mHeight = height;
-                sinkData->mChannels = map.size / (sinkData->mWidth*sinkData->mHeight);
 
-                if( sinkData->mChannels!=3 )
+                if( sinkData->mFormat==SinkI420 && (width%2!=0 || height%2!=0) )
                 {
-                    g_print ("Only BGR image are supported! \n");
+                    g_print ("Only even frame sizes are supported in I420! \n");
+                    gst_buffer_unmap (buffer, &map);
+                    gst_sample_unref (sample);
                     return GST_FLOW_CUSTOM_ERROR;
                 }
             }
@@ -253,11 +263,10 @@ GstFlowReturn GstSinkOpenCV::on_new_sample_from_sink( GstElement* elt, GstSinkOp
             sinkData->mFrameMutex.lock();
             if( sinkData->mFrameBuffer.size()<sinkData->mFrameBufferSize )
             {
-                cv::Mat frame( sinkData->mHeight, sinkData->mWidth, CV_8UC3 );
+                cv::Mat frame = sinkData->copyFrame( map );
 
-                memcpy( frame.data, map.data, map.size );
-
-                sinkData->mFrameBuffer.push( frame );
+                if( !frame.empty() )
+                    sinkData->mFrameBuffer.push( frame );
 
                 //std::chrono::steady_clock::time_point end= std::chrono::steady_clock::now();
                 //std::cout << "Time difference = " << std::chrono::duration_cast<std::chrono::milliseconds>(end - begin).count() <<std::endl;
@@ -292,6 +301,44 @@ GstFlowReturn GstSinkOpenCV::on_new_sample_from_sink( GstElement* elt, GstSinkOp
     return GST_FLOW_OK;
 }
 
+cv::Mat GstSinkOpenCV::copyFrame( const GstMapInfo& map )
+{
+    int w = mWidth;
+    int h = mHeight;
+
+    if( mFormat==SinkBGR )
+    {
+        size_t stride = GST_ROUND_UP_4( w*3 );
+
+        if( map.size < stride*(h-1) + w*3 )
+            return cv::Mat();
+
+        cv::Mat frame( h, w, CV_8UC3 );
+        cv::Mat( h, w, CV_8UC3, map.data, stride ).copyTo( frame );
+        return frame;
+    }
+
+    // >>>>> I420: the planes are packed one after the other in the OpenCV layout
+    size_t yStride = GST_ROUND_UP_4( w );
+    size_t cStride = GST_ROUND_UP_4( w/2 );
+    size_t uOffset = yStride*h;
+    size_t vOffset = uOffset + cStride*(h/2);
+
+    if( map.size < vOffset + cStride*(h/2-1) + w/2 )
+        return cv::Mat();
+
+    cv::Mat frame( h*3/2, w, CV_8UC1 );
+
+    cv::Mat( h, w, CV_8UC1, map.data, yStride ).copyTo( frame.rowRange(0, h) );
+    cv::Mat( h/2, w/2, CV_8UC1, map.data+uOffset, cStride ).copyTo(
+                cv::Mat( h/2, w/2, CV_8UC1, frame.data + w*h ) );
+    cv::Mat( h/2, w/2, CV_8UC1, map.data+vOffset, cStride ).copyTo(
+                cv::Mat( h/2, w/2, CV_8UC1, frame.data + w*h + (w/2)*(h/2) ) );
+    // <<<<< I420: the planes are packed one after the other in the OpenCV layout
+
+    return frame;
+}
+
 double GstSinkOpenCV::getBufPerc()
 {
     return static_cast<double>(mFrameBuffer.size())/mFrameBufferSize;
@@ -18,7 +18,8 @@ public:
     virtual ~QOpenCVScene();
 
 public slots:
-    /// Sets Background Image from OpenCV cv::Mat
+    /// Sets Background Image from OpenCV cv::Mat. Images larger than they appear in the views
+    /// are reduced with an area filter before the upload, the scene keeps their full size
     void setFgImage( cv::Mat& cvImg );
     void setFgImage( QImage& img);
 
@@ -27,9 +28,15 @@ public slots:
 //    virtual void mouseReleaseEvent(QGraphicsSceneMouseEvent *event);
 
 private:
-    /// Converts cv::Mat to QImage
+    /// Largest scale of the scene in its views, in device pixels per image pixel. 0 without views
+    double viewScale() const;
+
+    /// QImage on the pixels of the cv::Mat, without copies: BGR is wrapped as Format_BGR888
+    /// (Qt 5.14, converted to RGB32 by cv::cvtColor before), BGRA as Format_RGB32. The image keeps
+    /// a reference to the cv::Mat, so the pixels stay valid as long as the image and its copies
     QImage  cvMatToQImage( const cv::Mat &inMat );
-    /// Converts cv::Mat to QPixmap
+    /// Converts cv::Mat to QPixmap: the only conversion is the upload of QPixmap::fromImage,
+    /// none for RGB32
     QPixmap cvMatToQPixmap( const cv::Mat &inMat );
 
 signals:
@@ -3,8 +3,30 @@
 #include <QGraphicsSceneMouseEvent>
 #include <QGraphicsView>
 #include <QList>
+#include <QtMath>
 
 #include <opencv2/highgui/highgui.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+namespace
+{
+
+/// Cleanup of the images wrapping a cv::Mat: releases the reference to the pixels
+void releaseMat( void* info )
+{
+    delete static_cast<cv::Mat*>( info );
+}
+
+/// QImage on the pixels of mat, holding a reference to them
+QImage wrapMat( const cv::Mat& mat, QImage::Format format )
+{
+    cv::Mat* owner = new cv::Mat( mat );
+
+    return QImage( owner->data, owner->cols, owner->rows, static_cast<int>(owner->step), format,
+                   releaseMat, owner );
+}
+
+} // namespace
 
 QOpenCVScene::QOpenCVScene(QObject *parent) :
     QGraphicsScene(parent),
@@ -31,18 +53,50 @@ QOpenCVScene::~QOpenCVScene()
         delete mBgPixmapItem;
 }
 
+double QOpenCVScene::viewScale() const
+{
+    double scale = 0.0;
+
+    foreach( QGraphicsView* view, views() )
+    {
+        QTransform t = view->transform();
+
+        double s = qSqrt( t.m11()*t.m11() + t.m12()*t.m12() )*view->viewport()->devicePixelRatioF();
+        scale = qMax( scale, s );
+    }
+
+    return scale;
+}
+
 void QOpenCVScene::setFgImage( cv::Mat& cvImg )
 {
+    // >>>>> Downscaled to the resolution of the views: full resolution only when zoomed in
+    cv::Mat shown = cvImg;
+    double scale = viewScale();
+
+    if( scale>0.0 && scale<1.0 )
+    {
+        cv::Size size( qMax( 1, cvRound(cvImg.cols*scale) ), qMax( 1, cvRound(cvImg.rows*scale) ) );
+
+        // New buffer for every frame: the pixmap may share the last one
+        if( size.width<cvImg.cols && size.height<cvImg.rows )
+            cv::resize( cvImg, shown, size, 0.0, 0.0, cv::INTER_AREA );
+    }
+    // <<<<< Downscaled to the resolution of the views: full resolution only when zoomed in
+
     if(!mBgPixmapItem)
     {
-        mBgPixmapItem = new QGraphicsPixmapItem( cvMatToQPixmap(cvImg) );
+        mBgPixmapItem = new QGraphicsPixmapItem( cvMatToQPixmap(shown) );
         //cv::imshow( "Test", cvImg );
         mBgPixmapItem->setPos( 0,0 );
 
         addItem( mBgPixmapItem );
     }
     else
-        mBgPixmapItem->setPixmap( cvMatToQPixmap(cvImg) );
+        mBgPixmapItem->setPixmap( cvMatToQPixmap(shown) );
+
+    // The scene keeps the coordinates of the full resolution image
+    mBgPixmapItem->setScale( static_cast<double>(cvImg.cols)/shown.cols );
 
     //cv::imshow( "Test", cvImg );
     //qDebug() << tr("Image: %1 x %2").arg(cvImg.cols).arg(cvImg.rows);
@@ -69,6 +123,7 @@ void QOpenCVScene::setFgImage( QImage& img)
         QPixmap pmap;
         pmap.convertFromImage( img );
         mBgPixmapItem->setPixmap( pmap );
+        mBgPixmapItem->setScale( 1.0 );
     }
 
     mBgPixmapItem->setZValue( 1000.0 );
@@ -82,22 +137,29 @@ QImage QOpenCVScene::cvMatToQImage( const cv::Mat &inMat )
     // 8-bit, 4 channel
     case CV_8UC4:
     {
-        QImage image( inMat.data, inMat.cols, inMat.rows, inMat.step, QImage::Format_RGB32 );
-
-        return image;
+        return wrapMat( inMat, QImage::Format_RGB32 );
     }
 
         // 8-bit, 3 channel
     case CV_8UC3:
     {
-        QImage image( inMat.data, inMat.cols, inMat.rows, inMat.step, QImage::Format_RGB888 );
-
-        return image.rgbSwapped();
+#if QT_VERSION >= QT_VERSION_CHECK(5, 14, 0)
+        return wrapMat( inMat, QImage::Format_BGR888 );
+#else
+        // One pass to the layout QPixmap uses, instead of rgbSwapped and a second conversion
+        cv::Mat rgb32;
+        cv::cvtColor( inMat, rgb32, cv::COLOR_BGR2BGRA );
+
+        return wrapMat( rgb32, QImage::Format_RGB32 );
+#endif
     }
 
         // 8-bit, 1 channel
     case CV_8UC1:
     {
+#if QT_VERSION >= QT_VERSION_CHECK(5, 5, 0)
+        return wrapMat( inMat, QImage::Format_Grayscale8 );
+#else
         static QVector<QRgb>  sColorTable;
 
         // only create our color table once
@@ -107,11 +169,12 @@ QImage QOpenCVScene::cvMatToQImage( const cv::Mat &inMat )
                 sColorTable.push_back( qRgb( i, i, i ) );
         }
 
-        QImage image( inMat.data, inMat.cols, inMat.rows, inMat.step, QImage::Format_Indexed8 );
+        QImage image = wrapMat( inMat, QImage::Format_Indexed8 );
 
         image.setColorTable( sColorTable );
 
         return image;
+#endif
     }
 
     default:
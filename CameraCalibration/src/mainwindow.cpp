@@ -9,6 +9,11 @@
 #include <QMessageBox>
 #include <QFileDialog>
 #include <QSound>
+#include <QStandardPaths>
+#include <QDir>
+#include <QGuiApplication>
+#include <QScreen>
+#include <QElapsedTimer>
 
 #include <opencv2/core/core.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
@@ -16,8 +21,11 @@
 
 #include <vector>
 
-#include "qchessboardelab.h"
 #include "qcameracalibrate.h"
+#include "cornerdataset.h"
+#include "cameraundistort.h"
+#include "undistortmapcache.h"
+#include "calibpipeline.h"
 
 #include <iostream>
 
@@ -25,6 +33,9 @@
 
 using namespace std;
 
+#define MAP_REBUILD_DELAY_MSEC 40 // Pause in the parameter edits before the undistortion maps are rebuilt
+#define DETECT_THREADS 3
+
 MainWindow::MainWindow(QWidget *parent) :
     QMainWindow(parent),
     ui(new Ui::MainWindow),
@@ -41,6 +52,15 @@ MainWindow::MainWindow(QWidget *parent) :
 
     mCameraConnected = false;
 
+    mPipeline = new CalibPipeline( DETECT_THREADS );
+    mLastFoundCount = 0;
+
+    for( int v=0; v<ViewCount; v++ )
+    {
+        mViewSkips[v] = 0;
+        mViewMsec[v] = 0.0;
+    }
+
     mCbDetectedSnd = new QSound( "://sound/cell-phone-1-nr0.wav", this);
 
     updateOpenCvVer();
@@ -53,8 +73,23 @@ MainWindow::MainWindow(QWidget *parent) :
 
     // >>>>> Calibration INFO
     ui->statusBar->addWidget( &mCalibInfo );
+    ui->statusBar->addPermanentWidget( &mUndistInfo );
     // <<<<< Calibration INFO
 
+    // >>>>> Pipeline INFO
+    mPipelineInfo.setToolTip( tr("Pipeline stages: items per second, average latency, queue depth/capacity, items dropped") );
+    ui->statusBar->addWidget( &mPipelineInfo );
+    // <<<<< Pipeline INFO
+
+    // >>>>> Undistortion maps cache
+    QString mapCacheDir = QStandardPaths::writableLocation( QStandardPaths::CacheLocation ) + "/undistort_maps";
+
+    if( QDir().mkpath( mapCacheDir ) )
+    {
+        mMapCache = std::make_shared<UndistortMapCache>( mapCacheDir.toStdString() );
+    }
+    // <<<<< Undistortion maps cache
+
     on_pushButton_update_camera_list_clicked();
 
     // >>>>> Stream rendering
@@ -76,7 +111,12 @@ MainWindow::MainWindow(QWidget *parent) :
 
     // <<<<< Stream rendering
 
-    mElabPool.setMaxThreadCount( 3 );
+    // >>>>> Frames from the camera thread, drained at the refresh rate of the screen
+    qreal refreshRate = QGuiApplication::primaryScreen() ? QGuiApplication::primaryScreen()->refreshRate() : 60.0;
+    mDisplayTimer.setInterval( qMax( 1, qRound( 1000.0/qMax( refreshRate, 1.0 ) ) ) );
+    mDisplayTimer.setTimerType( Qt::PreciseTimer );
+    connect( &mDisplayTimer, &QTimer::timeout, this, &MainWindow::onDisplayTimer );
+    // <<<<< Frames from the camera thread, drained at the refresh rate of the screen
 
     int w,h;
     double fps;
@@ -95,7 +135,8 @@ MainWindow::~MainWindow()
         QApplication::processEvents( QEventLoop::AllEvents, 50 );
     }
 
-    mElabPool.clear();
+    // Stopped before the calibration it uses is deleted
+    delete mPipeline;
 
     delete ui;
 
@@ -182,16 +223,16 @@ bool MainWindow::startCamera()
 
     V4L2CompCamera::descr2params( ui->comboBox_camera_res->currentText(),w,h,fps,num,den);
 
-    mCameraThread = new CameraThread( fps );
+    // BGR frames: the raw view, the chessboard view and the sessions show and store them as they
+    // are. SinkI420 is for YUV consumers (CameraUndistort::undistortI420)
+    mCameraThread = new CameraThread( fps, SinkBGR );
 
     connect( mCameraThread, &CameraThread::cameraConnected,
              this, &MainWindow::onCameraConnected );
     connect( mCameraThread, &CameraThread::cameraDisconnected,
              this, &MainWindow::onCameraDisconnected );
-    connect( mCameraThread, &CameraThread::newImage,
-             this, &MainWindow::onNewImage );
-
     mCameraThread->start();
+    mDisplayTimer.start();
 
     return true;
 }
@@ -200,14 +241,14 @@ void MainWindow::stopCamera()
 {
     killGstLaunch();
 
+    mDisplayTimer.stop();
+
     if( mCameraThread )
     {
         disconnect( mCameraThread, &CameraThread::cameraConnected,
                     this, &MainWindow::onCameraConnected );
         disconnect( mCameraThread, &CameraThread::cameraDisconnected,
                     this, &MainWindow::onCameraDisconnected );
-        disconnect( mCameraThread, &CameraThread::newImage,
-                    this, &MainWindow::onNewImage );
 
         delete mCameraThread;
         mCameraThread = NULL;
@@ -244,6 +285,66 @@ void MainWindow::onCameraDisconnected()
                                                        "Width, Height and FPS"));
 }
 
+void MainWindow::onDisplayTimer()
+{
+    cv::Mat frame;
+
+    // Only the latest frame is shown, the ones the GUI was too slow for are counted as drops
+    if( mCameraThread && mCameraThread->getMailbox()->take( frame ) )
+        onNewImage( frame );
+
+    // >>>>> Present: latest outputs of the pipeline
+    cv::Mat undistFrame;
+    bool undistorted;
+
+    if( mPipeline->takeUndistorted( undistFrame, undistorted ) )
+        showUndistorted( undistFrame, undistorted );
+
+    cv::Mat cbImage;
+
+    if( mPipeline->takeCbImage( cbImage ) )
+        onNewCbImage( cbImage );
+
+    quint64 foundCount = mPipeline->getFoundCount();
+
+    if( foundCount!=mLastFoundCount )
+    {
+        mLastFoundCount = foundCount;
+        onCbDetected();
+    }
+    // <<<<< Present: latest outputs of the pipeline
+}
+
+void MainWindow::showUndistorted( cv::Mat& image, bool undistorted )
+{
+    // The preview size follows the view once the new maps are published
+    if( image.size()!=mUndistShownSize )
+    {
+        ui->graphicsView_undistorted->fitInView( QRectF(0,0, image.cols, image.rows), Qt::KeepAspectRatio );
+        mUndistShownSize = image.size();
+    }
+
+    // Display-ready RGB32 buffer: the scene uploads it without conversion
+    mCameraSceneUndistorted->setFgImage(image);
+    ui->graphicsView_undistorted->setBackgroundBrush( undistorted ? QBrush( QColor(50,150,50) )
+                                                                  : QBrush( QColor(150,50,50) ) );
+}
+
+/// False if the view cannot be seen: hidden, in a minimized window or clipped away by its parents.
+/// Other windows covering it are not detected
+bool MainWindow::isViewShown( QWidget* view )
+{
+    return !isMinimized() && view->isVisible() && !view->visibleRegion().isEmpty();
+}
+
+/// Running average of the cost of a frame of the view
+void MainWindow::updateViewCost( int view, qint64 nsecs )
+{
+    double msec = nsecs/1e6;
+
+    mViewMsec[view] = (mViewMsec[view]>0.0) ? 0.9*mViewMsec[view] + 0.1*msec : msec;
+}
+
 void MainWindow::onNewImage( cv::Mat frame )
 {
     static int frmCnt=0;
@@ -257,33 +358,111 @@ void MainWindow::onNewImage( cv::Mat frame )
                                         Qt::KeepAspectRatio );
         ui->graphicsView_checkboard->fitInView(QRectF(0,0, frame.cols, frame.rows),
                                                Qt::KeepAspectRatio );
-        ui->graphicsView_undistorted->fitInView(QRectF(0,0, frame.cols, frame.rows),
-                                                Qt::KeepAspectRatio );
         frameW = frame.cols;
         frameH = frame.rows;
     }
 
-    mCameraSceneRaw->setFgImage(frame);
+    // >>>>> Demand driven views
+    // The outputs of the hidden views are not computed, they restart with the next frame once shown
+    bool rawShown = isViewShown( ui->graphicsView_raw );
+    bool undistShown = isViewShown( ui->graphicsView_undistorted );
 
-    frmCnt++;
+    if( rawShown )
+    {
+        QElapsedTimer rawTimer;
+        rawTimer.start();
+
+        mCameraSceneRaw->setFgImage(frame);
 
-    if( ui->pushButton_calibrate->isChecked() && frmCnt%((int)mSrcFps) == 0 )
+        updateViewCost( ViewRaw, rawTimer.nsecsElapsed() );
+    }
+    else
     {
-        QChessboardElab* elab = new QChessboardElab( this, frame, mCbSize, mCbSizeMm, mCameraCalib );
-        mElabPool.tryStart(elab);
+        mViewSkips[ViewRaw]++;
     }
+    // <<<<< Demand driven views
+
+    frmCnt++;
+
+    // The calibration always needs the corners, only their drawing depends on the view
+    bool detect = ui->pushButton_calibrate->isChecked() && frmCnt%((int)mSrcFps) == 0;
+    bool drawCorners = detect && isViewShown( ui->graphicsView_checkboard );
 
-    cv::Mat rectified = mCameraCalib->undistort( frame );
+    if( detect && !drawCorners )
+        mViewSkips[ViewCheckboard]++;
 
-    if( rectified.empty() )
+    // >>>>> Undistorted preview at the size of its view
+    // Only the pixels shown are remapped, instead of a full frame scaled down by the view
+    QSize viewSize = ui->graphicsView_undistorted->viewport()->size();
+
+    if( undistShown && viewSize.width()>0 && viewSize.height()>0 )
     {
-        mCameraSceneUndistorted->setFgImage(frame);
-        ui->graphicsView_undistorted->setBackgroundBrush( QBrush( QColor(150,50,50) ) );
+        double scale = min( 1.0, min( static_cast<double>(viewSize.width())/frame.cols,
+                                      static_cast<double>(viewSize.height())/frame.rows ) );
+
+        cv::Size previewSize( max( 1, cvRound(frame.cols*scale) ), max( 1, cvRound(frame.rows*scale) ) );
+
+        if( previewSize!=mUndistPreviewSize )
+        {
+            mCameraCalib->getUndistort()->setOutputView( previewSize );
+            mUndistPreviewSize = previewSize;
+        }
     }
-    else
+    // <<<<< Undistorted preview at the size of its view
+
+    if( !undistShown )
+        mViewSkips[ViewUndistorted]++;
+
+    // Detected and remapped by the pipeline threads, the results are shown by onDisplayTimer
+    mPipeline->push( frame, undistShown, detect, drawCorners, mCbSize );
+
+    if( frmCnt%((int)mSrcFps) == 0 )
     {
-        mCameraSceneUndistorted->setFgImage(rectified);
-        ui->graphicsView_undistorted->setBackgroundBrush( QBrush( QColor(50,150,50) ) );
+        CameraUndistort* undist = mCameraCalib->getUndistort();
+
+        quint64 frameDrops = mCameraThread ? mCameraThread->getMailbox()->getDropCount() : 0;
+
+        mUndistInfo.setText( tr("Frames: %1 dropped - Undistort: %2 frames, %3 buffer allocations - Maps: %4 built, %5 dropped, %6 cached")
+                             .arg(frameDrops)
+                             .arg(undist->getUndistortCount()).arg(undist->getUndistortAllocCount())
+                             .arg(undist->getMapBuildCount()).arg(undist->getMapDropCount())
+                             .arg(undist->getMapCacheHitCount()) );
+
+        // >>>>> Pipeline stages
+        vector<StageStats> stages = mPipeline->getStats();
+
+        // The full solves run in the calibrator, after the views are accumulated
+        stages.insert( stages.begin()+3, mCameraCalib->getSolveStats() );
+
+        QStringList stageInfo;
+        for( size_t i=0; i<stages.size(); i++ )
+        {
+            const StageStats& st = stages[i];
+
+            stageInfo << tr("%1 %2/s %3 ms q%4/%5 -%6").arg( QString::fromStdString(st.name) )
+                         .arg( st.fps, 0, 'f', 1 ).arg( st.latencyMsec, 0, 'f', 1 )
+                         .arg( st.queueDepth ).arg( st.queueCapacity ).arg( st.dropped );
+
+            if( st.name=="undistort" && st.processed>0 )
+                mViewMsec[ViewUndistorted] = st.busyMsec;
+        }
+
+        mPipelineInfo.setText( stageInfo.join( " | " ) );
+        // <<<<< Pipeline stages
+
+        // >>>>> Work saved on the hidden views
+
+        double savedMsec = 0.0;
+        for( int v=0; v<ViewCount; v++ )
+        {
+            savedMsec += mViewSkips[v]*mViewMsec[v];
+        }
+
+        mUndistInfo.setText( mUndistInfo.text() +
+                             tr(" - Hidden views: %1 raw, %2 chessboard, %3 undistorted frames skipped (~%4 s CPU saved)")
+                             .arg(mViewSkips[ViewRaw]).arg(mViewSkips[ViewCheckboard])
+                             .arg(mViewSkips[ViewUndistorted]).arg(savedMsec/1000.0, 0, 'f', 1) );
+        // <<<<< Work saved on the hidden views
     }
 
     if(mCameraThread)
@@ -298,9 +477,12 @@ void MainWindow::onNewImage( cv::Mat frame )
 
 void MainWindow::onNewCbImage(cv::Mat cbImage)
 {
+    QElapsedTimer cbTimer;
+    cbTimer.start();
+
     mCameraSceneCheckboard->setFgImage(cbImage);
 
-    ui->lineEdit_cb_count->setText( tr("%1").arg(mCameraCalib->getCbCount()) );
+    updateViewCost( ViewCheckboard, cbTimer.nsecsElapsed() );
 }
 
 void MainWindow::onCbDetected()
@@ -308,6 +490,8 @@ void MainWindow::onCbDetected()
     //qDebug() << tr("Beep");
 
     mCbDetectedSnd->play();
+
+    ui->lineEdit_cb_count->setText( tr("%1").arg(mCameraCalib->getCbCount()) );
 }
 
 void MainWindow::onNewCameraParams(cv::Mat K, cv::Mat D, bool refining, double calibReprojErr)
@@ -340,6 +524,8 @@ void MainWindow::onNewCameraParams(cv::Mat K, cv::Mat D, bool refining, double c
     {
         updateParamGUI( K, D );
     }
+
+    updateSolverStatsGUI();
 }
 
 void MainWindow::on_pushButton_camera_connect_disconnect_clicked(bool checked)
@@ -367,16 +553,30 @@ void MainWindow::on_pushButton_camera_connect_disconnect_clicked(bool checked)
         {
             disconnect( mCameraCalib, &QCameraCalibrate::newCameraParams,
                         this, &MainWindow::onNewCameraParams );
+            disconnect( mCameraCalib, &QCameraCalibrate::modelsCompared,
+                        this, &MainWindow::onModelsCompared );
 
+            mPipeline->setCalibration( NULL );
             delete mCameraCalib;
         }
 
         bool fisheye = ui->checkBox_fisheye->isChecked();
 
         mCameraCalib = new QCameraCalibrate( cv::Size(mSrcWidth, mSrcHeight), mCbSize, mCbSizeMm, fisheye );
+        mCameraCalib->getUndistort()->setRebuildDelay( MAP_REBUILD_DELAY_MSEC );
+        mCameraCalib->getUndistort()->setMapCache( mMapCache );
+        mUndistPreviewSize = cv::Size();
+        mPipeline->setCalibration( mCameraCalib );
+        ui->pushButton_session_record->setChecked(false);
+        ui->plainTextEdit_solver_stats->clear();
+        ui->comboBox_model->clear();
 
         connect( mCameraCalib, &QCameraCalibrate::newCameraParams,
                  this, &MainWindow::onNewCameraParams );
+        connect( mCameraCalib, &QCameraCalibrate::modelsCompared,
+                 this, &MainWindow::onModelsCompared );
+
+        mCameraCalib->setProgressive( ui->checkBox_progressive->isChecked() );
 
         cv::Size imgSize;
         cv::Mat K, D;
@@ -533,6 +733,64 @@ void MainWindow::updateCbParams()
     mCbSizeMm = ui->lineEdit_cb_mm->text().toFloat();
 }
 
+void MainWindow::updateSolverStatsGUI()
+{
+    if( !mCameraCalib )
+        return;
+
+    vector<SolveStats> history = mCameraCalib->getSolveHistory();
+
+    if( history.empty() )
+    {
+        ui->plainTextEdit_solver_stats->clear();
+        ui->comboBox_model->clear();
+        return;
+    }
+
+    const SolveStats& stats = history.back();
+
+    QString term;
+    switch( stats.termination )
+    {
+    case SolveStats::TermConverged:
+        term = tr("converged");
+        break;
+    case SolveStats::TermMaxIter:
+        term = tr("iteration cap");
+        break;
+    case SolveStats::TermNotTraced:
+        term = tr("not traced");
+        break;
+    default:
+        term = tr("FAILED");
+        break;
+    }
+
+    QStringList traj;
+    for( size_t i=0; i<stats.errTrajectory.size(); i++ )
+    {
+        traj << QString::number( stats.errTrajectory[i], 'f', 4 );
+    }
+
+    double totWallMsec = 0.0;
+    for( size_t i=0; i<history.size(); i++ )
+    {
+        totWallMsec += history[i].wallMsec;
+    }
+
+    QString text;
+    text += tr("%1 stage: %2 views, %3 corners, %4\n").arg(QCameraCalibrate::stageName(stats.stage))
+            .arg(stats.views).arg(stats.corners)
+            .arg( stats.useGuess?tr("refining"):tr("from scratch") );
+    text += tr("Iterations: %1/%2 (%3)\n")
+            .arg( stats.iterations<0?tr("n/a"):QString::number(stats.iterations) ).arg(stats.maxIterations).arg(term);
+    text += tr("Wall: %1 msec - CPU: %2 msec\n").arg(stats.wallMsec,0,'f',1).arg(stats.cpuMsec,0,'f',1);
+    text += tr("RMS: %1\n").arg( traj.join(" > ") );
+    text += tr("Last %1 solves: %2 msec").arg(history.size()).arg(totWallMsec,0,'f',1);
+
+    ui->plainTextEdit_solver_stats->setPlainText( text );
+}
+
 void MainWindow::updateParamGUI( cv::Mat K, cv::Mat D )
 {
     double fx = K.ptr<double>(0)[0];
@@ -598,9 +856,22 @@ void MainWindow::setNewCameraParams()
         return;
     }
 
+    bool fisheye = ui->checkBox_fisheye->isChecked();
+
+    // >>>>> The coefficients without a field (s1..s4 of ModelThinPrism) are kept
+    cv::Size curSize;
+    cv::Mat curK, curD;
+    double curAlpha;
+    bool curFisheye;
+    mCameraCalib->getCameraParams( curSize, curK, curD, curAlpha, curFisheye );
+
     cv::Mat K(3, 3, CV_64F, cv::Scalar::all(0.0f) );
     cv::Mat D( 8, 1, CV_64F, cv::Scalar::all(0.0f) );
 
+    if( !fisheye && !curFisheye && curD.total()>8 )
+        curD.reshape( 1, static_cast<int>(curD.total()) ).convertTo( D, CV_64F );
+    // <<<<< The coefficients without a field (s1..s4 of ModelThinPrism) are kept
+
     K.ptr<double>(0)[0] = ui->lineEdit_fx->text().toDouble();
     K.ptr<double>(0)[1] = ui->lineEdit_K_01->text().toDouble();
     K.ptr<double>(0)[2] = ui->lineEdit_cx->text().toDouble();
@@ -614,7 +885,7 @@ void MainWindow::setNewCameraParams()
     D.ptr<double>(0)[0] = ui->lineEdit_k1->text().toDouble();
     D.ptr<double>(1)[0] = ui->lineEdit_k2->text().toDouble();
 
-    if(ui->checkBox_fisheye->isChecked())
+    if(fisheye)
     {
         D.ptr<double>(2)[0] = ui->lineEdit_k3->text().toDouble();
         D.ptr<double>(3)[0] = ui->lineEdit_k4->text().toDouble();
@@ -634,7 +905,6 @@ void MainWindow::setNewCameraParams()
     }
 
     double alpha = static_cast<double>(ui->horizontalSlider_alpha->value())/ui->horizontalSlider_alpha->maximum();
-    bool fisheye = ui->checkBox_fisheye->isChecked();
 
     mCameraCalib->setCameraParams( cv::Size(mSrcWidth,mSrcHeight), K, D, alpha, fisheye );
 }
@@ -829,23 +1099,9 @@ void MainWindow::on_pushButton_save_params_clicked()
         }
     }
 
-    cv::FileStorage fs( fileName.toStdString(), cv::FileStorage::WRITE );
-
-    if( fs.isOpened() )
+    if( !mCameraCalib->saveCameraParams( fileName.toStdString() ) )
     {
-        cv::Size imgSize;
-        cv::Mat K,D;
-        bool fisheye;
-        double alpha;
-
-        mCameraCalib->getCameraParams( imgSize,K,D,alpha,fisheye );
-
-        fs << "Width" << imgSize.width;
-        fs << "Height" << imgSize.height;
-        fs << "FishEye" << fisheye;
-        fs << "Alpha" << alpha;
-        fs << "CameraMatrix" << K;
-        fs << "DistCoeffs" << D;
+        QMessageBox::warning( this, tr("Warning"), tr("Cannot write the file:\n%1").arg(fileName) );
     }
 }
 
@@ -872,10 +1128,19 @@ void MainWindow::on_horizontalSlider_alpha_valueChanged(int value)
 
 void MainWindow::on_checkBox_fisheye_clicked(bool checked)
 {
-    if( mCameraCalib )
+    if( !mCameraCalib )
+    {
+        return;
+    }
+
+    // A model of the last comparison is applied at once, otherwise the stored views are solved
+    // again with the new model, instead of waiting for new chessboards
+    if( !mCameraCalib->applyModel( checked?ModelFisheye:ModelRational ) )
     {
         mCameraCalib->setFisheye( checked );
+        mCameraCalib->recalibrate();
     }
+
     cv::Size imgSize;
     cv::Mat K,D;
     bool fisheye;
@@ -885,3 +1150,193 @@ void MainWindow::on_checkBox_fisheye_clicked(bool checked)
 
     updateParamGUI( K,D );
 }
+
+void MainWindow::on_pushButton_session_record_clicked(bool checked)
+{
+    if( !checked )
+    {
+        if( mCameraCalib )
+        {
+            mCameraCalib->stopRecording();
+        }
+        return;
+    }
+
+    if( !mCameraCalib )
+    {
+        ui->pushButton_session_record->setChecked(false);
+        QMessageBox::warning( this, tr("Warning"), tr("Start the camera before recording a session") );
+        return;
+    }
+
+    QString fileName = QFileDialog::getSaveFileName(this,
+                                                    tr("Record Calibration Session"), QDir::homePath(),
+                                                    tr("Corner dataset (*.qccd)") );
+
+    if( fileName.isEmpty() )
+    {
+        ui->pushButton_session_record->setChecked(false);
+        return;
+    }
+
+    if( !fileName.endsWith( ".qccd", Qt::CaseInsensitive) )
+    {
+        fileName += ".qccd";
+    }
+
+    if( !mCameraCalib->startRecording( fileName.toStdString() ) )
+    {
+        ui->pushButton_session_record->setChecked(false);
+        QMessageBox::warning( this, tr("Warning"), tr("Cannot write the file:\n%1").arg(fileName) );
+    }
+}
+
+void MainWindow::on_pushButton_session_load_clicked()
+{
+    QString fileName = QFileDialog::getOpenFileName(this,
+                                                    tr("Load Calibration Session"), QDir::homePath(),
+                                                    tr("Corner dataset (*.qccd)") );
+
+    if( fileName.isEmpty() )
+        return;
+
+    CornerDataset dataset;
+
+    if( !dataset.load( fileName.toStdString(), false ) )
+    {
+        QMessageBox::warning( this, tr("Warning"), tr("Invalid corner dataset:\n%1").arg(fileName) );
+        return;
+    }
+
+    cv::Size imgSize = dataset.getImgSize();
+
+    if( !ui->pushButton_camera_connect_disconnect->isChecked() )
+    {
+        // >>>>> Without a camera the calibrator follows the geometry of the session
+        if(mCameraCalib)
+        {
+            disconnect( mCameraCalib, &QCameraCalibrate::newCameraParams,
+                        this, &MainWindow::onNewCameraParams );
+            disconnect( mCameraCalib, &QCameraCalibrate::modelsCompared,
+                        this, &MainWindow::onModelsCompared );
+
+            mPipeline->setCalibration( NULL );
+            delete mCameraCalib;
+        }
+
+        mSrcWidth = imgSize.width;
+        mSrcHeight = imgSize.height;
+
+        mCbSize = dataset.getCbSize();
+        mCbSizeMm = dataset.getCbSizeMm();
+
+        ui->lineEdit_cb_cols->setText( tr("%1").arg(mCbSize.width) );
+        ui->lineEdit_cb_rows->setText( tr("%1").arg(mCbSize.height) );
+        ui->lineEdit_cb_mm->setText( tr("%1").arg(mCbSizeMm) );
+
+        bool fisheye = ui->checkBox_fisheye->isChecked();
+
+        mCameraCalib = new QCameraCalibrate( imgSize, mCbSize, mCbSizeMm, fisheye );
+        mCameraCalib->getUndistort()->setRebuildDelay( MAP_REBUILD_DELAY_MSEC );
+        mCameraCalib->getUndistort()->setMapCache( mMapCache );
+        mUndistPreviewSize = cv::Size();
+        mPipeline->setCalibration( mCameraCalib );
+
+        connect( mCameraCalib, &QCameraCalibrate::newCameraParams,
+                 this, &MainWindow::onNewCameraParams );
+        connect( mCameraCalib, &QCameraCalibrate::modelsCompared,
+                 this, &MainWindow::onModelsCompared );
+
+        mCameraCalib->setProgressive( ui->checkBox_progressive->isChecked() );
+        ui->comboBox_model->clear();
+
+        mCameraCalib->setNewAlpha( static_cast<double>(ui->horizontalSlider_alpha->value())/ui->horizontalSlider_alpha->maximum() );
+        // <<<<< Without a camera the calibrator follows the geometry of the session
+    }
+
+    if( !mCameraCalib->loadSession( fileName.toStdString() ) )
+    {
+        QMessageBox::warning( this, tr("Warning"), tr("The session does not match the current camera and chessboard\n"
+                                                      "or contains less than 5 chessboards:\n%1").arg(fileName) );
+        return;
+    }
+
+    ui->lineEdit_cb_count->setText( tr("%1").arg(mCameraCalib->getCbCount()) );
+    ui->pushButton_save_params->setEnabled(true);
+}
+
+void MainWindow::on_pushButton_compare_models_clicked()
+{
+    if( !mCameraCalib )
+        return;
+
+    if( mCameraCalib->getCbCount() < 5 )
+    {
+        QMessageBox::warning( this, tr("Warning"), tr("At least 5 chessboards are required") );
+        return;
+    }
+
+    ui->pushButton_compare_models->setEnabled(false);
+    ui->pushButton_compare_models->setText( tr("Comparing...") );
+
+    mCameraCalib->compareModelsAsync();
+}
+
+void MainWindow::onModelsCompared()
+{
+    ui->pushButton_compare_models->setEnabled(true);
+    ui->pushButton_compare_models->setText( tr("Compare models") );
+
+    if( !mCameraCalib )
+        return;
+
+    vector<ModelCandidate> candidates = mCameraCalib->getModelCandidates();
+    CameraModel recommended = mCameraCalib->getRecommendedModel();
+    CameraModel current = mCameraCalib->getModel();
+
+    ui->comboBox_model->clear();
+
+    for( size_t i=0; i<candidates.size(); i++ )
+    {
+        const ModelCandidate& cand = candidates[i];
+
+        if( !cand.valid )
+            continue;
+
+        QString descr = tr("%1 - held-out %2 px, RMS %3 px").arg(QCameraCalibrate::modelName(cand.model))
+                .arg(cand.heldOutErr,0,'f',3).arg(cand.reprojErr,0,'f',3);
+
+        if( cand.model==recommended )
+        {
+            descr += tr(" [best]");
+        }
+
+        ui->comboBox_model->addItem( descr, static_cast<int>(cand.model) );
+
+        if( cand.model==current )
+        {
+            ui->comboBox_model->setCurrentIndex( ui->comboBox_model->count()-1 );
+        }
+    }
+}
+
+void MainWindow::on_comboBox_model_activated(int index)
+{
+    if( !mCameraCalib || index<0 )
+        return;
+
+    CameraModel model = static_cast<CameraModel>( ui->comboBox_model->itemData(index).toInt() );
+
+    // The parameter panel layout follows the checkbox
+    ui->checkBox_fisheye->setChecked( model==ModelFisheye );
+
+    mCameraCalib->applyModel( model );
+}
+
+void MainWindow::on_checkBox_progressive_clicked(bool checked)
+{
+    if( mCameraCalib )
+    {
+        mCameraCalib->setProgressive( checked );
+    }
+}
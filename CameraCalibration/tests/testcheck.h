@@ -0,0 +1,30 @@
+#ifndef TESTCHECK_H
+#define TESTCHECK_H
+
+#include <cstdio>
+
+/// Failed checks of the test executable
+static int gTestFailures = 0;
+
+/// Reports the failed condition and goes on with the test
+#define CHECK( cond ) \
+    do { \
+        if( !(cond) ) \
+        { \
+            std::fprintf( stderr, "%s:%d: CHECK( %s ) failed\n", __FILE__, __LINE__, #cond ); \
+            gTestFailures++; \
+        } \
+    } while( 0 )
+
+/// Exit code of main()
+inline int testResult( const char* name )
+{
+    if( gTestFailures )
+        std::fprintf( stderr, "%s: %d failed checks\n", name, gTestFailures );
+    else
+        std::printf( "%s: passed\n", name );
+
+    return gTestFailures ? 1 : 0;
+}
+
+#endif // TESTCHECK_H
@@ -0,0 +1,19 @@
+# Common settings of the tests: console executables linking calib_core
+
+QT       += core
+QT       -= gui
+
+CONFIG   += console testcase
+CONFIG   -= app_bundle
+
+TEMPLATE = app
+
+QMAKE_CXXFLAGS += -std=c++11
+
+INCLUDEPATH += $$PWD
+
+include(../libs/calib_core/calib_core.pri)
+include(../libs/opencv.pri)
+
+HEADERS += \
+    $$PWD/testcheck.h
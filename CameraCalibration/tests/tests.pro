@@ -0,0 +1,17 @@
+#-------------------------------------------------
+#
+# Unit tests of the core library, plain executables
+# returning non zero on failure. Run with "make check".
+#
+# Under the sanitizers:
+#   qmake CONFIG+=sanitizer CONFIG+=sanitize_thread
+#   qmake CONFIG+=sanitizer CONFIG+=sanitize_address CONFIG+=sanitize_undefined
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    tst_fastremap \
+    tst_pipelinestage \
+    tst_pointundistorter
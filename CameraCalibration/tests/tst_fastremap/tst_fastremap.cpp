@@ -0,0 +1,184 @@
+#include <cmath>
+#include <cstdlib>
+
+#include <opencv2/core/core.hpp>
+
+#include "fastremap.h"
+#include "testcheck.h"
+
+using namespace std;
+
+#define TRIALS 40
+#define TAB_BITS 5
+#define TAB_SIZE (1<<TAB_BITS)
+
+static const char* ISAS[] = { "Scalar", "SSE4.1", "AVX2", "NEON" };
+
+/// Source pixel, black outside the image
+static int sourceValue( const cv::Mat& src, int x, int y, int c )
+{
+    if( x<0 || y<0 || x>=src.cols || y>=src.rows )
+        return 0;
+
+    return src.ptr<uchar>(y)[x*src.channels()+c];
+}
+
+/// Bilinear interpolation of cv::remap with the fixed-point maps: the weights are exact on the
+/// 1/32 grid, the sum is rounded from 10 fractional bits
+static int bilinear( const cv::Mat& src, int sx, int sy, int fxy, int c )
+{
+    double fx = (fxy & (TAB_SIZE-1))/double(TAB_SIZE);
+    double fy = ((fxy >> TAB_BITS) & (TAB_SIZE-1))/double(TAB_SIZE);
+
+    double v = (1.0-fx)*(1.0-fy)*sourceValue( src, sx, sy, c ) + fx*(1.0-fy)*sourceValue( src, sx+1, sy, c )
+             + (1.0-fx)*fy*sourceValue( src, sx, sy+1, c ) + fx*fy*sourceValue( src, sx+1, sy+1, c );
+
+    int sum = static_cast<int>( lround( v*1024.0 ) );
+    return (sum+512) >> 10;
+}
+
+/// The fraction rounds to the closest source pixel
+static int nearestValue( const cv::Mat& src, int sx, int sy, int fxy, int c )
+{
+    sx += (fxy & (TAB_SIZE-1)) >= TAB_SIZE/2;
+    sy += ((fxy >> TAB_BITS) & (TAB_SIZE-1)) >= TAB_SIZE/2;
+
+    return sourceValue( src, sx, sy, c );
+}
+
+/// Display bytes: B G R 255, gray replicated
+static int displayChannel( int cn, int c )
+{
+    return (c<3 && cn>1) ? c : 0;
+}
+
+/// Compares every output byte with the reference, counts the differences
+static int compare( const cv::Mat& src, const cv::Mat& dst, const cv::Mat& map1, const cv::Mat& map2,
+                    bool nearest, bool display )
+{
+    int cn = src.channels();
+    int dcn = display ? 4 : cn;
+    int bad = 0;
+
+    if( dst.rows!=map1.rows || dst.cols!=map1.cols || dst.channels()!=dcn )
+        return 1;
+
+    for( int y=0; y<dst.rows; y++ )
+    {
+        const short* xy = map1.ptr<short>(y);
+        const ushort* fxy = map2.ptr<ushort>(y);
+        const uchar* d = dst.ptr<uchar>(y);
+
+        for( int x=0; x<dst.cols; x++ )
+        {
+            for( int c=0; c<dcn; c++ )
+            {
+                int expected;
+
+                if( display && c==3 )
+                    expected = 255;
+                else if( nearest )
+                    expected = nearestValue( src, xy[2*x], xy[2*x+1], fxy[x], display ? displayChannel( cn, c ) : c );
+                else
+                    expected = bilinear( src, xy[2*x], xy[2*x+1], fxy[x], display ? displayChannel( cn, c ) : c );
+
+                if( d[x*dcn+c]!=expected )
+                    bad++;
+            }
+        }
+    }
+    return bad;
+}
+
+/// Random image and maps. 1 pixel in 8 maps around or outside the border
+static void makeCase( int trial, int cn, cv::Mat& src, cv::Mat& map1, cv::Mat& map2 )
+{
+    int w = 1 + rand()%(trial<TRIALS/2 ? 6 : 300);
+    int h = 1 + rand()%(trial<TRIALS/2 ? 4 : 120);
+    int outW = 1 + rand()%400;
+    int outH = 1 + rand()%80;
+
+    src = cv::Mat( h, w, CV_MAKETYPE(CV_8U, cn) );
+    for( int y=0; y<h; y++ )
+    {
+        uchar* s = src.ptr<uchar>(y);
+        for( int x=0; x<w*cn; x++ )
+        {
+            s[x] = static_cast<uchar>( rand() );
+        }
+    }
+
+    map1 = cv::Mat( outH, outW, CV_16SC2 );
+    map2 = cv::Mat( outH, outW, CV_16UC1 );
+
+    for( int y=0; y<outH; y++ )
+    {
+        short* xy = map1.ptr<short>(y);
+        ushort* fxy = map2.ptr<ushort>(y);
+
+        for( int x=0; x<outW; x++ )
+        {
+            bool inside = (rand()%8)!=0;
+
+            xy[2*x] = static_cast<short>( inside ? rand()%w : rand()%(w+6)-3 );
+            xy[2*x+1] = static_cast<short>( inside ? rand()%h : rand()%(h+6)-3 );
+            fxy[x] = static_cast<ushort>( rand() & (TAB_SIZE*TAB_SIZE-1) );
+        }
+    }
+}
+
+static void testIsa( const char* isa )
+{
+    if( !fastRemapUseIsa( isa ) )
+    {
+        std::printf( "%s: not supported by this CPU, skipped\n", isa );
+        return;
+    }
+
+    srand( 1 );
+
+    const int cns[] = { 1, 3, 4 };
+    int bad[4] = { 0, 0, 0, 0 }; // Bilinear, display, nearest, nearest display
+
+    for( int i=0; i<3; i++ )
+    {
+        for( int trial=0; trial<TRIALS; trial++ )
+        {
+            cv::Mat src, map1, map2;
+            makeCase( trial, cns[i], src, map1, map2 );
+
+            for( int mode=0; mode<4; mode++ )
+            {
+                bool display = (mode%2)!=0;
+                bool nearest = mode>=2;
+
+                cv::Mat dst;
+                bool ok = display ? fastRemapDisplay( src, dst, map1, map2, nearest )
+                                  : fastRemap( src, dst, map1, map2, nearest );
+
+                CHECK( ok );
+                bad[mode] += ok ? compare( src, dst, map1, map2, nearest, display ) : 1;
+            }
+        }
+    }
+
+    std::printf( "%s: %d %d %d %d bytes differ (bilinear, display, nearest, nearest display)\n",
+                 isa, bad[0], bad[1], bad[2], bad[3] );
+
+    CHECK( bad[0]==0 );
+    CHECK( bad[1]==0 );
+    CHECK( bad[2]==0 );
+    CHECK( bad[3]==0 );
+}
+
+int main()
+{
+    for( size_t i=0; i<sizeof(ISAS)/sizeof(ISAS[0]); i++ )
+    {
+        testIsa( ISAS[i] );
+    }
+
+    fastRemapUseIsa( NULL );
+
+    return testResult( "tst_fastremap" );
+}
@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# fastRemap kernels of every instruction set the
+# CPU runs (scalar, SSE4.1, AVX2, NEON), bit exact
+# against a reference bilinear interpolation.
+#
+#-------------------------------------------------
+
+TARGET = tst_fastremap
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_fastremap.cpp
@@ -0,0 +1,178 @@
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <thread>
+
+#include "pipelinestage.h"
+#include "testcheck.h"
+
+using namespace std;
+
+#define BLOCK_ITEMS 200000
+#define LATEST_ITEMS 20000
+
+/// Fan out to a pool, fan in to one worker: every item arrives exactly once
+static void testBlockNothingLost()
+{
+    atomic<uint64_t> sum( 0 );
+    atomic<uint64_t> count( 0 );
+
+    {
+        PipelineStage<uint64_t> accumulate( "accumulate", [&]( uint64_t& item, int )
+        {
+            sum += item;
+            count++;
+        }, 4, QueueBlock, 1, 3 );
+
+        // The workers of the pool are the producers of accumulate, one index each
+        PipelineStage<uint64_t> detect( "detect", [&]( uint64_t& item, int worker )
+        {
+            accumulate.push( item, worker );
+        }, 2, QueueBlock, 3, 1 );
+
+        for( uint64_t i=1; i<=BLOCK_ITEMS; i++ )
+        {
+            CHECK( detect.push( i ) );
+        }
+
+        while( count<BLOCK_ITEMS )
+        {
+            this_thread::yield();
+        }
+
+        StageStats stats = accumulate.getStats();
+        CHECK( stats.processed==BLOCK_ITEMS );
+        CHECK( stats.dropped==0 );
+    }
+
+    CHECK( sum==uint64_t(BLOCK_ITEMS)*(BLOCK_ITEMS+1)/2 );
+}
+
+/// The worker is busy while 1..10 are pushed: it must process 10 next, not 2
+static void testKeepLatestReplaces()
+{
+    atomic<bool> release( false );
+    atomic<int> last( 0 );
+    atomic<int> count( 0 );
+
+    PipelineStage<int> stage( "latest", [&]( int& item, int )
+    {
+        while( item==1 && !release )
+        {
+            this_thread::yield();
+        }
+        last = item;
+        count++;
+    }, 1, QueueKeepLatest );
+
+    CHECK( stage.push( 1 ) );
+
+    // 1 taken by the worker, which waits for the release
+    while( stage.getQueueDepth()>0 )
+    {
+        this_thread::yield();
+    }
+
+    for( int i=2; i<=10; i++ )
+    {
+        CHECK( stage.push( i ) );
+    }
+
+    CHECK( stage.getQueueDepth()==1 );
+
+    release = true;
+
+    while( count<2 )
+    {
+        this_thread::yield();
+    }
+    this_thread::sleep_for( chrono::milliseconds( 20 ) );
+
+    StageStats stats = stage.getStats();
+    CHECK( last==10 );
+    CHECK( count==2 );
+    CHECK( stats.processed==2 );
+    CHECK( stats.dropped==8 );
+}
+
+/// Under load every item is either processed or counted as dropped
+static void testKeepLatestAccounting()
+{
+    atomic<int> last( -1 );
+    bool ordered = true;
+
+    PipelineStage<int> stage( "latest", [&]( int& item, int )
+    {
+        if( item<=last )
+            ordered = false;
+        last = item;
+        this_thread::sleep_for( chrono::microseconds( 50 ) );
+    }, 1, QueueKeepLatest );
+
+    for( int i=0; i<LATEST_ITEMS; i++ )
+    {
+        CHECK( stage.push( i ) );
+    }
+
+    while( last<LATEST_ITEMS-1 )
+    {
+        this_thread::yield();
+    }
+    this_thread::sleep_for( chrono::milliseconds( 20 ) );
+
+    StageStats stats = stage.getStats();
+    CHECK( ordered );
+    CHECK( stats.processed+stats.dropped==LATEST_ITEMS );
+    CHECK( stats.queueDepth==0 );
+}
+
+/// The destructor stops the workers and discards the queued items
+static void testStopWithItemsQueued()
+{
+    atomic<int> count( 0 );
+
+    {
+        PipelineStage<int> stage( "stop", [&]( int&, int )
+        {
+            this_thread::sleep_for( chrono::milliseconds( 1 ) );
+            count++;
+        }, 8, QueueBlock );
+
+        for( int i=0; i<8; i++ )
+        {
+            CHECK( stage.push( i ) );
+        }
+    }
+
+    CHECK( count<=8 );
+}
+
+static void testOutputKeepsLatest()
+{
+    PipelineOutput<int> output( "output" );
+    int item = 0;
+
+    CHECK( !output.take( item ) );
+
+    output.post( 1, PipelineClock::now() );
+    output.post( 2, PipelineClock::now() );
+
+    CHECK( output.take( item ) );
+    CHECK( item==2 );
+    CHECK( !output.take( item ) );
+    CHECK( output.getStats().dropped==1 );
+}
+
+int main()
+{
+    for( int rep=0; rep<3; rep++ )
+    {
+        testBlockNothingLost();
+    }
+    testKeepLatestReplaces();
+    testKeepLatestAccounting();
+    testStopWithItemsQueued();
+    testOutputKeepsLatest();
+
+    return testResult( "tst_pipelinestage" );
+}
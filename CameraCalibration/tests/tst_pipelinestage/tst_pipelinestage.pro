@@ -0,0 +1,14 @@
+#-------------------------------------------------
+#
+# PipelineStage and LatestSlot: no item lost with
+# QueueBlock, the latest item kept with
+# QueueKeepLatest, stop with items queued.
+#
+#-------------------------------------------------
+
+TARGET = tst_pipelinestage
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_pipelinestage.cpp
@@ -0,0 +1,127 @@
+#include <cmath>
+#include <vector>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+
+#include "pointundistorter.h"
+#include "testcheck.h"
+
+using namespace std;
+
+#define IMG_W 1280
+#define IMG_H 720
+#define GRID_STEP 16
+
+#define OPENCV_TOLERANCE 0.05   // Pixels. Moderate distortion: the 5 iterations of OpenCV converge
+#define ROUND_TRIP_TOLERANCE 0.02
+
+static cv::Mat cameraMatrix()
+{
+    return (cv::Mat_<double>(3,3) << 800.0, 0.0, 640.0,
+                                     0.0, 780.0, 360.0,
+                                     0.0, 0.0, 1.0);
+}
+
+/// Pixels of the raw image, borders included
+static vector<cv::Point2f> imagePoints()
+{
+    vector<cv::Point2f> pts;
+
+    for( int y=0; y<=IMG_H; y+=GRID_STEP )
+    {
+        for( int x=0; x<=IMG_W; x+=GRID_STEP )
+        {
+            pts.push_back( cv::Point2f( static_cast<float>(x), static_cast<float>(y) ) );
+        }
+    }
+    return pts;
+}
+
+static double maxDistance( const vector<cv::Point2f>& a, const vector<cv::Point2f>& b )
+{
+    double maxDist = 0.0;
+
+    for( size_t i=0; i<a.size(); i++ )
+    {
+        double d = cv::norm( a[i]-b[i] );
+
+        // NaN must fail the comparison
+        if( !(d <= maxDist) )
+            maxDist = std::isnan(d) ? HUGE_VAL : d;
+    }
+    return maxDist;
+}
+
+/// undistort as OpenCV, and distort back to the raw points
+static void checkModel( const char* name, const cv::Mat& D, bool fishEye )
+{
+    cv::Mat K = cameraMatrix();
+    cv::Mat newK = K.clone();
+    newK.at<double>(0,0) *= 0.8;
+    newK.at<double>(1,1) *= 0.8;
+
+    PointUndistorter undistorter( K, D, fishEye, newK, cv::Size(IMG_W, IMG_H) );
+    CHECK( !undistorter.empty() );
+
+    vector<cv::Point2f> raw = imagePoints();
+
+    vector<cv::Point2f> expected;
+    if( fishEye )
+        cv::fisheye::undistortPoints( raw, expected, K, D, cv::Mat(), newK );
+    else
+        cv::undistortPoints( raw, expected, K, D, cv::Mat(), newK );
+
+    vector<cv::Point2f> undist( raw.size() );
+    undistorter.undistort( raw.data(), undist.data(), raw.size() );
+
+    double errOpenCv = maxDistance( undist, expected );
+
+    vector<cv::Point2f> back( raw.size() );
+    undistorter.distort( undist.data(), back.data(), undist.size() );
+
+    double errRoundTrip = maxDistance( back, raw );
+
+    std::printf( "%s: %.4f px from OpenCV, %.4f px round trip\n", name, errOpenCv, errRoundTrip );
+
+    CHECK( errOpenCv < OPENCV_TOLERANCE );
+    CHECK( errRoundTrip < ROUND_TRIP_TOLERANCE );
+}
+
+/// NaN and far away points must not break the radial table lookup
+static void checkInvalidPoints()
+{
+    cv::Mat D = (cv::Mat_<double>(8,1) << -0.1, 0.02, 0.0, 0.0, 0.0, 0.0, 0.0, 0.0);
+    PointUndistorter undistorter( cameraMatrix(), D, false, cameraMatrix(), cv::Size(IMG_W, IMG_H) );
+
+    vector<cv::Point2f> pts;
+    pts.push_back( cv::Point2f( NAN, 10.0f ) );
+    pts.push_back( cv::Point2f( 1e30f, -1e30f ) );
+    pts.push_back( cv::Point2f( INFINITY, 0.0f ) );
+    pts.push_back( cv::Point2f( 640.0f, 360.0f ) );
+
+    undistorter.undistort( pts.data(), pts.data(), pts.size() );
+
+    CHECK( std::isnan( pts[0].x ) );
+    CHECK( std::abs( pts[3].x-640.0f ) < 1e-3f && std::abs( pts[3].y-360.0f ) < 1e-3f );
+}
+
+int main()
+{
+    // k1 k2 p1 p2 k3
+    checkModel( "polynomial", (cv::Mat_<double>(8,1) << -0.12, 0.03, 0.0008, -0.0005, -0.004, 0.0, 0.0, 0.0), false );
+
+    // k1 k2 p1 p2 k3 k4 k5 k6
+    checkModel( "rational", (cv::Mat_<double>(8,1) << 0.08, -0.02, 0.0006, 0.0004, 0.001, 0.14, -0.01, 0.004), false );
+
+    // Rational and s1 s2 s3 s4
+    checkModel( "thin prism", (cv::Mat_<double>(12,1) << 0.08, -0.02, 0.0006, 0.0004, 0.001, 0.14, -0.01, 0.004,
+                                                         0.001, -0.0004, 0.0008, 0.0002), false );
+
+    // k1 k2 k3 k4
+    checkModel( "fisheye", (cv::Mat_<double>(4,1) << 0.04, -0.008, 0.001, -0.0003), true );
+
+    checkInvalidPoints();
+
+    return testResult( "tst_pointundistorter" );
+}
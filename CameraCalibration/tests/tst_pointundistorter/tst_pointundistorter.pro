@@ -0,0 +1,13 @@
+#-------------------------------------------------
+#
+# PointUndistorter against cv::undistortPoints and
+# cv::fisheye::undistortPoints, for every model.
+#
+#-------------------------------------------------
+
+TARGET = tst_pointundistorter
+
+include(../tests.pri)
+
+SOURCES += \
+    tst_pointundistorter.cpp
@@ -0,0 +1,25 @@
+#-------------------------------------------------
+#
+# Top level project: the core library first, then
+# the GUI, the CLI and the tests that link it.
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+
+SUBDIRS += \
+    calib_core \
+    gui \
+    cli \
+    tests
+
+calib_core.file = CameraCalibration/libs/calib_core/calib_core.pro
+
+gui.file = CameraCalibration/CameraCalibration.pro
+gui.depends = calib_core
+
+cli.file = CameraCalibration/cli/CameraCalibrationCli.pro
+cli.depends = calib_core
+
+tests.file = CameraCalibration/tests/tests.pro
+tests.depends = calib_core